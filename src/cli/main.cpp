@@ -0,0 +1,403 @@
+// spectreguard-cli - headless batch protection for release pipelines
+//
+//   spectreguard-cli --mode exe --output out/ build/bin
+//   spectreguard-cli --mode source --manifest files.txt --output out/ --summary summary.json
+//   spectreguard-cli --mode exe --cache --output out/ build/bin
+//
+// Inputs are a directory (searched recursively) or a manifest with one path
+// per line. Files are processed in parallel on a JobQueue and a JSON summary
+// with per-file timing, sizes and ratio is written to --summary or stdout.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <set>
+#include "core/jobqueue.h"
+#include "core/resultcache.h"
+#include "core/settings.h"
+#include "protection/exe_protection.h"
+#include "protection/llvm_obfuscation.h"
+#include "protection/source_protection.h"
+
+namespace {
+
+enum class Mode { Exe, Source, Llvm };
+
+struct FileResult {
+    QString input;
+    QString output;
+    bool success = false;
+    QString error;
+    double seconds = 0;
+    qint64 inputSize = 0;
+    qint64 outputSize = 0;
+};
+
+struct BatchOptions {
+    Mode mode = Mode::Exe;
+    QString outputDir;
+    bool useUPX = true;
+    bool obfuscateNames = true;
+    bool xorStrings = false;
+    bool xorCompileTime = false;
+    int llvmLevel = 2;
+};
+
+QStringList defaultPatterns(Mode mode) {
+    switch (mode) {
+    case Mode::Exe:
+        return {"*.exe", "*.dll"};
+    case Mode::Source:
+        return {"*.cpp", "*.cc", "*.cxx", "*.c", "*.h", "*.hpp"};
+    case Mode::Llvm:
+        return {"*.exe"};
+    }
+    return {};
+}
+
+// All string literals of a source file, same rules as the source protection page
+std::vector<std::string> extractStrings(const std::string& sourcePath) {
+    std::set<QString> uniqueStrings;
+    static const QRegularExpression stringRegex("\"([^\"]*)\"");
+    const QString content = QString::fromStdString(SourceProtection::readFile(sourcePath));
+    QRegularExpressionMatchIterator it = stringRegex.globalMatch(content);
+    while (it.hasNext()) {
+        QString str = it.next().captured(1);
+        if (str.length() > 1) {
+            uniqueStrings.insert(str);
+        }
+    }
+
+    std::vector<std::string> result;
+    for (const QString& str : uniqueStrings) {
+        result.push_back(str.toStdString());
+    }
+    return result;
+}
+
+// With a cache, unchanged inputs are served from it instead of being protected again
+bool protectFile(const BatchOptions& options, ResultCache *cache, const std::string& input,
+                 const std::string& output, const JobQueue::ProgressCallback& progress,
+                 const JobQueue::CancelCallback& isCancelled) {
+    auto run = [&](const std::string& configuration, bool deterministic, const std::function<bool()>& protect) {
+        return cache ? cache->run(input, output, configuration, deterministic, progress, protect) : protect();
+    };
+
+    switch (options.mode) {
+    case Mode::Exe: {
+        ExeProtection::ProtectionConfig config;
+        config.useUPX = options.useUPX;
+        config.progressCallback = progress;
+        config.cancelCallback = isCancelled;
+        return run(config.cacheKey(), config.isDeterministic(), [&] {
+            return ExeProtection::protect(input, output, config);
+        });
+    }
+    case Mode::Source: {
+        SourceProtection::ProtectionConfig config;
+        config.obfuscateNames = options.obfuscateNames;
+        config.xorEncryptStrings = options.xorStrings;
+        config.xorCompileTimeStrings = options.xorCompileTime;
+        if (options.xorStrings) {
+            config.xorStringsToEncrypt = extractStrings(input);
+        }
+        config.progressCallback = progress;
+        config.cancelCallback = isCancelled;
+        return run(config.cacheKey(), config.isDeterministic(), [&] {
+            return SourceProtection::protect(input, output, config);
+        });
+    }
+    case Mode::Llvm: {
+        LLVMObfuscation::ObfuscationConfig config;
+        config.obfuscationLevel = options.llvmLevel;
+        config.progressCallback = progress;
+        config.cancelCallback = isCancelled;
+        return run(config.cacheKey(), config.isDeterministic(), [&] {
+            progress(10, "Running LLVM obfuscation...");
+            return LLVMObfuscation::obfuscateExecutable(input, output, config);
+        });
+    }
+    }
+    return false;
+}
+
+// True if path is dir itself or below it
+bool isInside(const QDir& dir, const QString& path) {
+    const QString relative = dir.relativeFilePath(path);
+    return relative != ".." && !relative.startsWith("../") && !QDir::isAbsolutePath(relative);
+}
+
+// Input files with the output path relative to outputDir
+QList<QPair<QString, QString>> collectInputs(const QString& inputDir, const QString& manifest,
+                                             const QStringList& patterns, QString *error) {
+    QList<QPair<QString, QString>> inputs;
+
+    if (!manifest.isEmpty()) {
+        QFile file(manifest);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            *error = "Cannot open manifest: " + manifest;
+            return inputs;
+        }
+        const QDir baseDir = QFileInfo(manifest).absoluteDir();
+        QStringList paths;
+        QTextStream in(&file);
+        while (!in.atEnd()) {
+            const QString line = in.readLine().trimmed();
+            if (line.isEmpty() || line.startsWith('#')) {
+                continue;
+            }
+            paths.append(QDir::cleanPath(baseDir.absoluteFilePath(line)));
+        }
+
+        // Outputs keep the directory layout below the deepest directory that
+        // holds the manifest and all entries, so that files with the same
+        // name in different directories get different outputs
+        QDir root = baseDir;
+        for (const QString& path : paths) {
+            while (!isInside(root, path)) {
+                if (!root.cdUp()) {
+                    *error = "Manifest entries have no common directory: " + path;
+                    return {};
+                }
+            }
+        }
+        std::set<QString> outputs;
+        for (const QString& path : paths) {
+            const QString relative = root.relativeFilePath(path);
+            if (!outputs.insert(relative).second) {
+                *error = "File is listed more than once in the manifest: " + path;
+                return {};
+            }
+            inputs.append({path, relative});
+        }
+        return inputs;
+    }
+
+    const QDir baseDir(inputDir);
+    if (!baseDir.exists()) {
+        *error = "Input directory does not exist: " + inputDir;
+        return inputs;
+    }
+    QDirIterator it(baseDir.absolutePath(), patterns, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        inputs.append({path, baseDir.relativeFilePath(path)});
+    }
+    std::sort(inputs.begin(), inputs.end());
+    return inputs;
+}
+
+QJsonObject toJson(const FileResult& result) {
+    QJsonObject obj;
+    obj["input"] = result.input;
+    obj["output"] = result.output;
+    obj["status"] = result.success ? "ok" : "failed";
+    if (!result.error.isEmpty()) {
+        obj["error"] = result.error;
+    }
+    obj["seconds"] = result.seconds;
+    obj["input_size"] = result.inputSize;
+    obj["output_size"] = result.outputSize;
+    obj["ratio"] = result.inputSize > 0 ? double(result.outputSize) / double(result.inputSize) : 0.0;
+    return obj;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("spectreguard-cli");
+    QCoreApplication::setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Protect all files of a directory or manifest in parallel.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("directory", "Input directory (searched recursively).", "[directory]");
+
+    QCommandLineOption modeOption("mode", "Protection to apply: exe, source or llvm (default: exe).", "mode", "exe");
+    QCommandLineOption manifestOption("manifest", "File with one input path per line ('#' starts a comment).", "file");
+    QCommandLineOption outputOption({"o", "output"}, "Output directory (required).", "directory");
+    QCommandLineOption patternOption("pattern", "File pattern for directory input, may be repeated.", "glob");
+    QCommandLineOption jobsOption({"j", "jobs"}, "Number of parallel jobs (default: number of cores).", "n");
+    QCommandLineOption summaryOption("summary", "Write the JSON summary to this file instead of stdout.", "file");
+    QCommandLineOption noUpxOption("no-upx", "exe mode: copy files without UPX packing.");
+    QCommandLineOption noNamesOption("no-obfuscate-names", "source mode: keep identifier names.");
+    QCommandLineOption xorOption("xor-strings", "source mode: XOR-encrypt all string literals.");
+    QCommandLineOption xorStaticOption("xor-static", "source mode: emit XOR strings as constexpr arrays decrypted once.");
+    QCommandLineOption levelOption("level", "llvm mode: obfuscation level 1-3 (default: 2).", "n", "2");
+    QCommandLineOption llvmPathOption("llvm-path", "llvm mode: directory containing opt and llc.", "directory");
+    QCommandLineOption cacheOption("cache", "Reuse results for unchanged inputs and options (UPX packing and other deterministic protections).");
+    QCommandLineOption cacheRandomizedOption("cache-randomized",
+        "With --cache, also reuse results of protections that use fresh random keys or names.");
+    QCommandLineOption cacheDirOption("cache-dir", "Cache directory (default: cache/ in the configured output directory).", "directory");
+    parser.addOptions({modeOption, manifestOption, outputOption, patternOption, jobsOption, summaryOption,
+                       noUpxOption, noNamesOption, xorOption, xorStaticOption, levelOption, llvmPathOption,
+                       cacheOption, cacheRandomizedOption, cacheDirOption});
+    parser.process(app);
+
+    QTextStream err(stderr);
+
+    BatchOptions options;
+    const QString mode = parser.value(modeOption);
+    if (mode == "exe") {
+        options.mode = Mode::Exe;
+    } else if (mode == "source") {
+        options.mode = Mode::Source;
+    } else if (mode == "llvm") {
+        options.mode = Mode::Llvm;
+    } else {
+        err << "Unknown mode: " << mode << "\n";
+        return 2;
+    }
+    options.useUPX = !parser.isSet(noUpxOption);
+    options.obfuscateNames = !parser.isSet(noNamesOption);
+    options.xorStrings = parser.isSet(xorOption) || parser.isSet(xorStaticOption);
+    options.xorCompileTime = parser.isSet(xorStaticOption);
+    options.llvmLevel = qBound(1, parser.value(levelOption).toInt(), 3);
+    if (parser.isSet(llvmPathOption)) {
+        LLVMObfuscation::setLLVMPath(parser.value(llvmPathOption));
+    }
+
+    const QStringList positional = parser.positionalArguments();
+    const bool hasDirectory = positional.size() == 1;
+    const bool hasManifest = parser.isSet(manifestOption);
+    if (!parser.isSet(outputOption) || positional.size() > 1 || hasDirectory == hasManifest) {
+        err << "Give an output directory and either an input directory or --manifest.\n";
+        parser.showHelp(2);
+    }
+    options.outputDir = QDir(parser.value(outputOption)).absolutePath();
+
+    QStringList patterns = parser.values(patternOption);
+    if (patterns.isEmpty()) {
+        patterns = defaultPatterns(options.mode);
+    }
+
+    QString error;
+    const auto inputs = collectInputs(positional.value(0), parser.value(manifestOption), patterns, &error);
+    if (!error.isEmpty()) {
+        err << error << "\n";
+        return 2;
+    }
+
+    std::unique_ptr<ResultCache> cache;
+    if (parser.isSet(cacheOption)) {
+        if (parser.isSet(cacheDirOption)) {
+            cache = std::make_unique<ResultCache>(parser.value(cacheDirOption));
+        } else {
+            cache = std::make_unique<ResultCache>(Settings::instance().getCacheDirectory(),
+                                                  Settings::instance().getCacheSizeLimit());
+        }
+        cache->setAllowNondeterministic(parser.isSet(cacheRandomizedOption));
+    }
+
+    // Declared before the queue: its destructor waits for the workers,
+    // which write to the results
+    QMutex resultsMutex;
+    QVector<FileResult> results(inputs.size());
+
+    JobQueue queue;
+    const int jobs = parser.isSet(jobsOption) ? parser.value(jobsOption).toInt() : QThread::idealThreadCount();
+    queue.setMaxConcurrentJobs(qMax(1, jobs));
+
+    QElapsedTimer totalTimer;
+    totalTimer.start();
+
+    for (int i = 0; i < inputs.size(); ++i) {
+        const QString input = inputs[i].first;
+        const QString output = QDir(options.outputDir).filePath(inputs[i].second);
+        results[i].input = input;
+        results[i].output = output;
+
+        queue.submit(QFileInfo(input).fileName(),
+            [&, i, input, output](const JobQueue::ProgressCallback& progress,
+                                  const JobQueue::CancelCallback& isCancelled) {
+                QElapsedTimer timer;
+                timer.start();
+                QString lastError;
+                auto report = [&](int value, const std::string& status) {
+                    progress(value, status);
+                    if (value == 0 && !status.empty()) {
+                        lastError = QString::fromStdString(status);
+                    }
+                };
+
+                bool success = QDir().mkpath(QFileInfo(output).absolutePath());
+                if (!success) {
+                    lastError = "Failed to create output directory";
+                } else {
+                    success = protectFile(options, cache.get(), input.toStdString(), output.toStdString(), report,
+                                          isCancelled);
+                }
+
+                if (!success && lastError.isEmpty()) {
+                    lastError = "Protection failed";
+                }
+
+                QMutexLocker lock(&resultsMutex);
+                FileResult& result = results[i];
+                result.success = success;
+                result.error = success ? QString() : lastError;
+                result.seconds = timer.nsecsElapsed() / 1e9;
+                result.inputSize = QFileInfo(input).size();
+                result.outputSize = success ? QFileInfo(output).size() : 0;
+                return success;
+            });
+    }
+
+    // allJobsFinished fires whenever the queue runs empty, which can happen
+    // while jobs are still being submitted; wait for all of them instead
+    queue.waitForDone();
+
+    QJsonArray files;
+    int failed = 0;
+    qint64 inputBytes = 0;
+    qint64 outputBytes = 0;
+    for (const FileResult& result : results) {
+        files.append(toJson(result));
+        if (!result.success) {
+            ++failed;
+        }
+        inputBytes += result.inputSize;
+        outputBytes += result.outputSize;
+    }
+
+    QJsonObject summary;
+    summary["mode"] = mode;
+    summary["jobs"] = qMax(1, jobs);
+    summary["files_total"] = int(results.size());
+    summary["files_failed"] = failed;
+    summary["seconds"] = totalTimer.nsecsElapsed() / 1e9;
+    summary["input_size"] = inputBytes;
+    summary["output_size"] = outputBytes;
+    summary["ratio"] = inputBytes > 0 ? double(outputBytes) / double(inputBytes) : 0.0;
+    summary["files"] = files;
+    const QByteArray json = QJsonDocument(summary).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(summaryOption)) {
+        QFile file(parser.value(summaryOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << "Cannot write summary: " << file.fileName() << "\n";
+            return 2;
+        }
+        file.write(json);
+    } else {
+        fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    }
+
+    return failed == 0 ? 0 : 1;
+}
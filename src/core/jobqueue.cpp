@@ -0,0 +1,120 @@
+#include "jobqueue.h"
+#include <QRunnable>
+#include <QDebug>
+
+JobQueue::JobQueue(QObject *parent) : QObject(parent) {
+}
+
+JobQueue::~JobQueue() {
+    cancelAll();
+    pool.waitForDone();
+}
+
+int JobQueue::submit(const QString& name, Job job) {
+    auto state = std::make_shared<JobState>();
+
+    QMutexLocker lock(&mutex);
+    const int jobId = nextJobId++;
+    state->runnable = QRunnable::create([this, jobId, state, name, job = std::move(job)]() {
+        run(jobId, state, name, job);
+    });
+    jobs.insert(jobId, state);
+    pool.start(state->runnable);
+    return jobId;
+}
+
+void JobQueue::run(int jobId, const std::shared_ptr<JobState>& state, const QString& name, const Job& job) {
+    {
+        QMutexLocker lock(&mutex);
+        state->started = true;
+    }
+
+    bool success = false;
+    if (!state->cancelled) {
+        emit jobStarted(jobId, name);
+
+        ProgressCallback progress = [this, jobId, state](int value, const std::string& status) {
+            if (!state->cancelled) {
+                emit jobProgress(jobId, value, QString::fromStdString(status));
+            }
+        };
+        CancelCallback isCancelled = [state]() {
+            return state->cancelled.load();
+        };
+
+        try {
+            success = job(progress, isCancelled);
+        }
+        catch (const std::exception& e) {
+            qWarning() << "Job" << jobId << "failed:" << e.what();
+            emit jobProgress(jobId, 0, QString("Error: %1").arg(e.what()));
+            success = false;
+        }
+    }
+
+    const bool cancelled = state->cancelled;
+    finish(jobId, success && !cancelled, cancelled);
+}
+
+void JobQueue::finish(int jobId, bool success, bool cancelled) {
+    bool idle = false;
+    {
+        QMutexLocker lock(&mutex);
+        jobs.remove(jobId);
+        idle = jobs.isEmpty();
+    }
+
+    emit jobFinished(jobId, success, cancelled);
+    if (idle) {
+        emit allJobsFinished();
+    }
+}
+
+void JobQueue::cancel(int jobId) {
+    bool dropped = false;
+    {
+        QMutexLocker lock(&mutex);
+        auto it = jobs.find(jobId);
+        if (it == jobs.end()) {
+            return;
+        }
+        std::shared_ptr<JobState> state = it.value();
+        state->cancelled = true;
+
+        // Not started yet: the runnable is still alive, take it off the queue.
+        // If the pool already dequeued it, run() sees the flag and returns.
+        if (!state->started && pool.tryTake(state->runnable)) {
+            delete state->runnable;
+            state->runnable = nullptr;
+            dropped = true;
+        }
+    }
+
+    if (dropped) {
+        finish(jobId, false, true);
+    }
+}
+
+void JobQueue::cancelAll() {
+    QList<int> ids;
+    {
+        QMutexLocker lock(&mutex);
+        ids = jobs.keys();
+    }
+    for (int jobId : ids) {
+        cancel(jobId);
+    }
+}
+
+int JobQueue::activeJobs() const {
+    QMutexLocker lock(&mutex);
+    return jobs.size();
+}
+
+void JobQueue::setMaxConcurrentJobs(int count) {
+    pool.setMaxThreadCount(count);
+}
+
+void JobQueue::waitForDone() {
+    pool.waitForDone();
+}
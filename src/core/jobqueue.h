@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <QMutex>
+#include <QHash>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+class QRunnable;
+
+// Runs protection jobs on a QThreadPool. All signals are emitted from the
+// worker threads; connect them to QObjects living in the GUI thread and Qt
+// delivers them as queued calls.
+class JobQueue : public QObject {
+    Q_OBJECT
+
+public:
+    using ProgressCallback = std::function<void(int progress, const std::string& status)>;
+    // True once the job has been cancelled; safe to call from any thread
+    using CancelCallback = std::function<bool()>;
+    // Job body: report progress through the callback and return success.
+    // It should poll isCancelled between its stages and then stop, removing
+    // any partial output. It must not touch any widget.
+    using Job = std::function<bool(const ProgressCallback& progress, const CancelCallback& isCancelled)>;
+
+    explicit JobQueue(QObject *parent = nullptr);
+    ~JobQueue() override;
+
+    // Queue a job and return its id
+    int submit(const QString& name, Job job);
+
+    // Jobs which have not started yet are dropped; running jobs stop at
+    // their next cancellation check.
+    void cancel(int jobId);
+    void cancelAll();
+
+    int activeJobs() const;
+    void setMaxConcurrentJobs(int count);
+
+    // Block until every submitted job has finished
+    void waitForDone();
+
+signals:
+    void jobStarted(int jobId, const QString& name);
+    void jobProgress(int jobId, int progress, const QString& status);
+    void jobFinished(int jobId, bool success, bool cancelled);
+    void allJobsFinished();
+
+private:
+    struct JobState {
+        QRunnable *runnable = nullptr; // owned by the pool
+        bool started = false;          // guarded by mutex
+        std::atomic<bool> cancelled{false};
+    };
+
+    void run(int jobId, const std::shared_ptr<JobState>& state, const QString& name, const Job& job);
+    void finish(int jobId, bool success, bool cancelled);
+
+    QThreadPool pool;
+    mutable QMutex mutex;
+    QHash<int, std::shared_ptr<JobState>> jobs;
+    int nextJobId = 1;
+};
@@ -0,0 +1,120 @@
+#include "resultcache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include "protection/mapped_file.h"
+
+ResultCache::ResultCache(const QString& directory, qint64 maxBytes)
+    : directory(directory), maxBytes(maxBytes) {
+}
+
+bool ResultCache::run(const std::string& inputPath, const std::string& outputPath,
+                      const std::string& configuration, bool deterministic,
+                      const ProgressCallback& progress, const std::function<bool()>& protect) {
+    if (!deterministic && !allowNondeterministic) {
+        return protect();
+    }
+
+    const QString entryKey = key(inputPath, configuration);
+    if (entryKey.isEmpty()) {
+        return protect();
+    }
+
+    if (fetch(entryKey, outputPath)) {
+        if (progress) {
+            progress(100, "Reused cached result");
+        }
+        return true;
+    }
+
+    if (!protect()) {
+        return false;
+    }
+    store(entryKey, outputPath);
+    return true;
+}
+
+QString ResultCache::key(const std::string& inputPath, const std::string& configuration) {
+    MappedFile input;
+    if (!input.open(inputPath)) {
+        return QString();
+    }
+
+    // BLAKE2b runs at memory speed and, unlike a non-cryptographic hash,
+    // makes accidental collisions between different inputs a non-issue
+    QCryptographicHash hash(QCryptographicHash::Blake2b_256);
+    hash.addData(QByteArray::fromRawData(reinterpret_cast<const char*>(input.data()), qsizetype(input.size())));
+    hash.addData(QByteArray(1, '\0'));
+    hash.addData(QByteArray::fromRawData(configuration.data(), qsizetype(configuration.size())));
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+QString ResultCache::entryPath(const QString& key) const {
+    return QDir(directory).filePath(key + ".bin");
+}
+
+bool ResultCache::fetch(const QString& key, const std::string& outputPath) const {
+    const QString entry = entryPath(key);
+    if (!QFileInfo::exists(entry)) {
+        return false;
+    }
+
+    const QString output = QString::fromStdString(outputPath);
+    QFile::remove(output);
+    if (!QFile::copy(entry, output)) {
+        qWarning() << "Failed to copy cached result" << entry << "to" << output;
+        return false;
+    }
+
+    // The modification time is the entry's last use for eviction
+    QFile file(entry);
+    if (file.open(QIODevice::ReadWrite)) {
+        file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    }
+    return true;
+}
+
+void ResultCache::store(const QString& key, const std::string& outputPath) const {
+    if (!QDir().mkpath(directory)) {
+        qWarning() << "Failed to create cache directory" << directory;
+        return;
+    }
+
+    const QString entry = entryPath(key);
+    const QString temporary = entry + QString(".%1.tmp").arg(QRandomGenerator::global()->generate(), 8, 16, QChar('0'));
+    if (!QFile::copy(QString::fromStdString(outputPath), temporary)) {
+        qWarning() << "Failed to add result to cache" << entry;
+        return;
+    }
+    // Another process may have stored the same entry meanwhile; either copy will do
+    QFile::remove(entry);
+    if (!QFile::rename(temporary, entry)) {
+        QFile::remove(temporary);
+    }
+
+    evict();
+}
+
+void ResultCache::evict() const {
+    // Newest first: keep entries until the limit is reached, delete the rest
+    const QFileInfoList entries = QDir(directory).entryInfoList({"*.bin"}, QDir::Files, QDir::Time);
+    qint64 total = 0;
+    for (const QFileInfo& entry : entries) {
+        total += entry.size();
+        if (total > maxBytes) {
+            QFile::remove(entry.absoluteFilePath());
+        }
+    }
+
+    // Temporary files left behind by a process that died while storing
+    const QDateTime staleBefore = QDateTime::currentDateTime().addSecs(-3600);
+    for (const QFileInfo& temporary : QDir(directory).entryInfoList({"*.tmp"}, QDir::Files)) {
+        if (temporary.lastModified() < staleBefore) {
+            QFile::remove(temporary.absoluteFilePath());
+        }
+    }
+}
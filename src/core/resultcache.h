@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QString>
+#include <QtGlobal>
+#include <functional>
+#include <string>
+
+// On-disk cache of protection results. An entry is keyed by a hash of the
+// input file's bytes plus a description of the configuration and the tool
+// versions the output depends on (see the cacheKey() of each protection
+// config). Entries are plain files in one directory; the least recently used
+// ones are deleted once the directory grows beyond its size limit.
+//
+// Several processes may share a directory: entries are written to a temporary
+// name and renamed into place, and eviction tolerates files vanishing.
+class ResultCache {
+public:
+    using ProgressCallback = std::function<void(int progress, const std::string& status)>;
+
+    static constexpr qint64 defaultMaxBytes = qint64(1024) * 1024 * 1024;
+
+    explicit ResultCache(const QString& directory, qint64 maxBytes = defaultMaxBytes);
+
+    // Protections that draw fresh random keys or names are not deterministic;
+    // reusing their output also reuses those keys, so it must be allowed explicitly
+    void setAllowNondeterministic(bool allow) { allowNondeterministic = allow; }
+
+    // Runs protect() unless a result for the same input bytes and configuration
+    // is cached, in which case the cached output is copied to outputPath.
+    // A fresh successful result is added to the cache.
+    bool run(const std::string& inputPath, const std::string& outputPath,
+             const std::string& configuration, bool deterministic,
+             const ProgressCallback& progress, const std::function<bool()>& protect);
+
+    // Hex key for the input file's contents and the configuration, empty if
+    // the input cannot be read
+    static QString key(const std::string& inputPath, const std::string& configuration);
+
+    // Copies the entry to outputPath and marks it as recently used
+    bool fetch(const QString& key, const std::string& outputPath) const;
+    // Adds outputPath as the entry for key, then evicts down to the size limit
+    void store(const QString& key, const std::string& outputPath) const;
+
+private:
+    QString entryPath(const QString& key) const;
+    void evict() const;
+
+    QString directory;
+    qint64 maxBytes;
+    bool allowNondeterministic = false;
+};
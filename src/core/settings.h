@@ -26,11 +26,30 @@ public:
             getOutputDirectory() + "/source_protection").toString();
     }
 
+    // Protection results reused by ResultCache
+    bool isCacheEnabled() const {
+        return settings.value("cache_enabled", true).toBool();
+    }
+
+    QString getCacheDirectory() const {
+        return settings.value("cache_directory", 
+            getOutputDirectory() + "/cache").toString();
+    }
+
+    qint64 getCacheSizeLimit() const {
+        return settings.value("cache_size_limit", 
+            qint64(1024) * 1024 * 1024).toLongLong();
+    }
+
     void setOutputDirectory(const QString& path) {
         settings.setValue("output_directory", path);
         createDirectories();
     }
     
+    void setCacheEnabled(bool enabled) {
+        settings.setValue("cache_enabled", enabled);
+    }
+
     void setExeProtectionDirectory(const QString& path) {
         settings.setValue("exe_protection_directory", path);
         QDir dir;
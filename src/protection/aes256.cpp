@@ -0,0 +1,342 @@
+#include "aes256.h"
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SG_AES_X86 1
+#include <wmmintrin.h>
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(SG_AES_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SG_AES_TARGET __attribute__((target("aes,sse2")))
+#else
+#define SG_AES_TARGET
+#endif
+
+namespace {
+
+constexpr int kRounds = 14;
+
+uint8_t rotl8(uint8_t x, int n) {
+    return static_cast<uint8_t>((x << n) | (x >> (8 - n)));
+}
+
+uint8_t xtime(uint8_t x) {
+    return static_cast<uint8_t>((x << 1) ^ ((x & 0x80) ? 0x1B : 0));
+}
+
+// The S-box derived from the GF(2^8) inverse and the affine transform,
+// computed once instead of shipping a 256-byte table
+struct SBox {
+    uint8_t table[256];
+
+    SBox() {
+        uint8_t p = 1, q = 1;
+        do {
+            p = static_cast<uint8_t>(p ^ (p << 1) ^ ((p & 0x80) ? 0x1B : 0));
+            q = static_cast<uint8_t>(q ^ (q << 1));
+            q = static_cast<uint8_t>(q ^ (q << 2));
+            q = static_cast<uint8_t>(q ^ (q << 4));
+            if (q & 0x80) {
+                q ^= 0x09;
+            }
+            table[p] = static_cast<uint8_t>(q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4) ^ 0x63);
+        } while (p != 1);
+        table[0] = 0x63;
+    }
+};
+
+const uint8_t* sbox() {
+    static const SBox box;
+    return box.table;
+}
+
+void incrementCounter(uint8_t counter[16]) {
+    for (int i = 15; i >= 0; --i) {
+        if (++counter[i] != 0) {
+            break;
+        }
+    }
+}
+
+#ifdef SG_AES_X86
+bool cpuHasAesNi() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 25)) != 0;
+#else
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (ecx & (1u << 25)) != 0;
+#endif
+}
+
+// Four independent counter blocks per iteration keep the AES unit busy
+SG_AES_TARGET void ctrAesNi(const uint8_t* roundKeys, uint8_t counter[16],
+                            const uint8_t* in, uint8_t* out, size_t length) {
+    __m128i rk[kRounds + 1];
+    for (int r = 0; r <= kRounds; ++r) {
+        rk[r] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(roundKeys + 16 * r));
+    }
+
+    while (length >= 64) {
+        __m128i s[4];
+        for (int b = 0; b < 4; ++b) {
+            s[b] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counter)), rk[0]);
+            incrementCounter(counter);
+        }
+        for (int r = 1; r < kRounds; ++r) {
+            for (int b = 0; b < 4; ++b) {
+                s[b] = _mm_aesenc_si128(s[b], rk[r]);
+            }
+        }
+        for (int b = 0; b < 4; ++b) {
+            s[b] = _mm_aesenclast_si128(s[b], rk[kRounds]);
+            const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * b));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * b), _mm_xor_si128(s[b], data));
+        }
+        in += 64;
+        out += 64;
+        length -= 64;
+    }
+
+    while (length > 0) {
+        __m128i s = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counter)), rk[0]);
+        incrementCounter(counter);
+        for (int r = 1; r < kRounds; ++r) {
+            s = _mm_aesenc_si128(s, rk[r]);
+        }
+        s = _mm_aesenclast_si128(s, rk[kRounds]);
+
+        alignas(16) uint8_t keystream[16];
+        _mm_store_si128(reinterpret_cast<__m128i*>(keystream), s);
+        const size_t n = length < 16 ? length : 16;
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = in[i] ^ keystream[i];
+        }
+        in += n;
+        out += n;
+        length -= n;
+    }
+}
+#endif
+
+} // namespace
+
+Aes256::Aes256(const Key& key) {
+    const uint8_t* box = sbox();
+
+    std::memcpy(roundKeys, key.data(), 32);
+    uint8_t rcon = 1;
+    for (int i = 32; i < (kRounds + 1) * 16; i += 4) {
+        uint8_t t[4] = {roundKeys[i - 4], roundKeys[i - 3], roundKeys[i - 2], roundKeys[i - 1]};
+        if (i % 32 == 0) {
+            const uint8_t t0 = t[0];
+            t[0] = static_cast<uint8_t>(box[t[1]] ^ rcon);
+            t[1] = box[t[2]];
+            t[2] = box[t[3]];
+            t[3] = box[t0];
+            rcon = xtime(rcon);
+        } else if (i % 32 == 16) {
+            for (uint8_t& b : t) {
+                b = box[b];
+            }
+        }
+        for (int j = 0; j < 4; ++j) {
+            roundKeys[i + j] = static_cast<uint8_t>(roundKeys[i - 32 + j] ^ t[j]);
+        }
+    }
+
+    useAesNi = hasHardwareSupport();
+}
+
+bool Aes256::hasHardwareSupport() {
+#ifdef SG_AES_X86
+    static const bool supported = cpuHasAesNi();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+void Aes256::encryptBlock(const uint8_t in[16], uint8_t out[16]) const {
+    const uint8_t* box = sbox();
+
+    uint8_t s[16];
+    for (int i = 0; i < 16; ++i) {
+        s[i] = in[i] ^ roundKeys[i];
+    }
+
+    for (int round = 1; round <= kRounds; ++round) {
+        // SubBytes + ShiftRows; the state is stored column by column
+        uint8_t t[16];
+        for (int i = 0; i < 16; ++i) {
+            t[i] = box[s[(i + 4 * (i % 4)) % 16]];
+        }
+
+        if (round < kRounds) {
+            for (int c = 0; c < 16; c += 4) {
+                const uint8_t a0 = t[c], a1 = t[c + 1], a2 = t[c + 2], a3 = t[c + 3];
+                const uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+                t[c] = static_cast<uint8_t>(a0 ^ all ^ xtime(a0 ^ a1));
+                t[c + 1] = static_cast<uint8_t>(a1 ^ all ^ xtime(a1 ^ a2));
+                t[c + 2] = static_cast<uint8_t>(a2 ^ all ^ xtime(a2 ^ a3));
+                t[c + 3] = static_cast<uint8_t>(a3 ^ all ^ xtime(a3 ^ a0));
+            }
+        }
+
+        for (int i = 0; i < 16; ++i) {
+            s[i] = t[i] ^ roundKeys[round * 16 + i];
+        }
+    }
+
+    std::memcpy(out, s, 16);
+}
+
+void Aes256::ctrCrypt(const Block& iv, const uint8_t* in, uint8_t* out, size_t length) const {
+    uint8_t counter[16];
+    std::memcpy(counter, iv.data(), 16);
+
+#ifdef SG_AES_X86
+    if (useAesNi) {
+        ctrAesNi(roundKeys, counter, in, out, length);
+        return;
+    }
+#endif
+
+    uint8_t keystream[16];
+    while (length > 0) {
+        encryptBlock(counter, keystream);
+        incrementCounter(counter);
+        const size_t n = length < 16 ? length : 16;
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = in[i] ^ keystream[i];
+        }
+        in += n;
+        out += n;
+        length -= n;
+    }
+}
+
+std::string Aes256::encryptToHex(const Block& iv, const std::string& plaintext) const {
+    static const char digits[] = "0123456789abcdef";
+
+    std::vector<uint8_t> data(16 + plaintext.size());
+    std::memcpy(data.data(), iv.data(), 16);
+    ctrCrypt(iv, reinterpret_cast<const uint8_t*>(plaintext.data()), data.data() + 16, plaintext.size());
+
+    std::string hex;
+    hex.reserve(data.size() * 2);
+    for (uint8_t b : data) {
+        hex += digits[b >> 4];
+        hex += digits[b & 0x0F];
+    }
+    return hex;
+}
+
+std::string Aes256::decryptorStub(const Key& key) {
+    std::string keyBytes;
+    for (size_t i = 0; i < key.size(); ++i) {
+        static const char digits[] = "0123456789abcdef";
+        keyBytes += i ? ", 0x" : "0x";
+        keyBytes += digits[key[i] >> 4];
+        keyBytes += digits[key[i] & 0x0F];
+    }
+
+    return R"(
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace _obf_ns {
+    class _obf_aes_decryptor {
+        struct _ctx {
+            uint8_t sbox[256];
+            uint8_t rk[240];
+            static uint8_t rotl(uint8_t x, int n) { return static_cast<uint8_t>((x << n) | (x >> (8 - n))); }
+            static uint8_t xt(uint8_t x) { return static_cast<uint8_t>((x << 1) ^ ((x & 0x80) ? 0x1B : 0)); }
+            _ctx() {
+                static const uint8_t key[32] = { )" + keyBytes + R"( };
+                uint8_t p = 1, q = 1;
+                do {
+                    p = static_cast<uint8_t>(p ^ (p << 1) ^ ((p & 0x80) ? 0x1B : 0));
+                    q = static_cast<uint8_t>(q ^ (q << 1));
+                    q = static_cast<uint8_t>(q ^ (q << 2));
+                    q = static_cast<uint8_t>(q ^ (q << 4));
+                    if (q & 0x80) q ^= 0x09;
+                    sbox[p] = static_cast<uint8_t>(q ^ rotl(q, 1) ^ rotl(q, 2) ^ rotl(q, 3) ^ rotl(q, 4) ^ 0x63);
+                } while (p != 1);
+                sbox[0] = 0x63;
+                std::memcpy(rk, key, 32);
+                uint8_t rcon = 1;
+                for (int i = 32; i < 240; i += 4) {
+                    uint8_t t[4] = { rk[i - 4], rk[i - 3], rk[i - 2], rk[i - 1] };
+                    if (i % 32 == 0) {
+                        uint8_t t0 = t[0];
+                        t[0] = static_cast<uint8_t>(sbox[t[1]] ^ rcon); t[1] = sbox[t[2]]; t[2] = sbox[t[3]]; t[3] = sbox[t0];
+                        rcon = xt(rcon);
+                    } else if (i % 32 == 16) {
+                        for (int j = 0; j < 4; ++j) t[j] = sbox[t[j]];
+                    }
+                    for (int j = 0; j < 4; ++j) rk[i + j] = static_cast<uint8_t>(rk[i - 32 + j] ^ t[j]);
+                }
+            }
+            void encrypt(uint8_t s[16]) const {
+                for (int i = 0; i < 16; ++i) s[i] ^= rk[i];
+                for (int r = 1; r <= 14; ++r) {
+                    uint8_t t[16];
+                    for (int i = 0; i < 16; ++i) t[i] = sbox[s[(i + 4 * (i % 4)) % 16]];
+                    if (r < 14) {
+                        for (int c = 0; c < 16; c += 4) {
+                            uint8_t a0 = t[c], a1 = t[c + 1], a2 = t[c + 2], a3 = t[c + 3];
+                            uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+                            t[c] = static_cast<uint8_t>(a0 ^ all ^ xt(a0 ^ a1));
+                            t[c + 1] = static_cast<uint8_t>(a1 ^ all ^ xt(a1 ^ a2));
+                            t[c + 2] = static_cast<uint8_t>(a2 ^ all ^ xt(a2 ^ a3));
+                            t[c + 3] = static_cast<uint8_t>(a3 ^ all ^ xt(a3 ^ a0));
+                        }
+                    }
+                    for (int i = 0; i < 16; ++i) s[i] = t[i] ^ rk[r * 16 + i];
+                }
+            }
+        };
+        static int hexValue(char c) {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return 0;
+        }
+    public:
+        static std::string decrypt(const char* hex) {
+            static const _ctx ctx;
+            std::string bytes;
+            for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+                bytes += static_cast<char>((hexValue(hex[i]) << 4) | hexValue(hex[i + 1]));
+            }
+            if (bytes.size() < 16) return "";
+            uint8_t counter[16];
+            std::memcpy(counter, bytes.data(), 16);
+            std::string decoded = bytes.substr(16);
+            for (size_t pos = 0; pos < decoded.size(); pos += 16) {
+                uint8_t ks[16];
+                std::memcpy(ks, counter, 16);
+                ctx.encrypt(ks);
+                for (int i = 15; i >= 0 && ++counter[i] == 0; --i) {}
+                for (size_t i = 0; i < 16 && pos + i < decoded.size(); ++i) {
+                    decoded[pos + i] = static_cast<char>(decoded[pos + i] ^ ks[i]);
+                }
+            }
+            return decoded;
+        }
+    };
+}
+)";
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// AES-256 block cipher used for in-process string encryption. Only the
+// forward direction is implemented: strings are encrypted in CTR mode, so
+// decryption is the same operation with the same IV.
+//
+// The key schedule is computed once per key. Blocks are encrypted with
+// AES-NI when the CPU supports it and with a portable table-free
+// implementation otherwise; both produce identical output.
+class Aes256 {
+public:
+    using Key = std::array<uint8_t, 32>;
+    using Block = std::array<uint8_t, 16>;
+
+    explicit Aes256(const Key& key);
+
+    void encryptBlock(const uint8_t in[16], uint8_t out[16]) const;
+
+    // CTR mode: out = in ^ E(iv), in ^ E(iv + 1), ... (iv as 128-bit big endian)
+    void ctrCrypt(const Block& iv, const uint8_t* in, uint8_t* out, size_t length) const;
+
+    static bool hasHardwareSupport();
+
+    // C++ source of _obf_ns::_obf_aes_decryptor::decrypt(const char* hex) which
+    // reverses encryptToHex() for this key. Kept small: the S-box is computed
+    // at first use instead of being embedded.
+    static std::string decryptorStub(const Key& key);
+
+    // Hex of iv || ciphertext, the format expected by decryptorStub()
+    std::string encryptToHex(const Block& iv, const std::string& plaintext) const;
+
+private:
+    alignas(16) uint8_t roundKeys[15 * 16];
+    bool useAesNi;
+};
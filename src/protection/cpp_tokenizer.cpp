@@ -0,0 +1,145 @@
+#include "cpp_tokenizer.h"
+
+namespace {
+
+bool isIdentStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool isIdentChar(char c) {
+    return isIdentStart(c) || (c >= '0' && c <= '9');
+}
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+bool isEncodingPrefix(std::string_view s) {
+    return s == "L" || s == "u" || s == "U" || s == "u8";
+}
+
+bool isRawPrefix(std::string_view s) {
+    return s == "R" || s == "LR" || s == "uR" || s == "UR" || s == "u8R";
+}
+
+// End of a quoted literal starting at the quote at pos; stops at an
+// unescaped newline so an unterminated literal cannot swallow the file
+size_t skipQuoted(std::string_view src, size_t pos) {
+    const char quote = src[pos++];
+    while (pos < src.size()) {
+        const char c = src[pos];
+        if (c == '\\' && pos + 1 < src.size()) {
+            pos += 2;
+            continue;
+        }
+        if (c == quote) {
+            return pos + 1;
+        }
+        if (c == '\n') {
+            return pos;
+        }
+        ++pos;
+    }
+    return pos;
+}
+
+// End of a raw string whose opening quote is at pos
+size_t skipRawString(std::string_view src, size_t pos) {
+    const size_t open = src.find('(', pos + 1);
+    if (open == std::string_view::npos) {
+        return src.size();
+    }
+    std::string terminator = ")";
+    terminator.append(src.substr(pos + 1, open - pos - 1));
+    terminator += '"';
+    const size_t close = src.find(terminator, open + 1);
+    return close == std::string_view::npos ? src.size() : close + terminator.size();
+}
+
+// pp-number: digits, letters, '.', digit separators and exponent signs
+size_t skipNumber(std::string_view src, size_t pos) {
+    while (pos < src.size()) {
+        const char c = src[pos];
+        if (isIdentChar(c) || c == '.') {
+            ++pos;
+        } else if (c == '\'' && pos + 1 < src.size() && isIdentChar(src[pos + 1])) {
+            pos += 2;
+        } else if ((c == '+' || c == '-') &&
+                   (src[pos - 1] == 'e' || src[pos - 1] == 'E' || src[pos - 1] == 'p' || src[pos - 1] == 'P')) {
+            ++pos;
+        } else {
+            break;
+        }
+    }
+    return pos;
+}
+
+} // namespace
+
+std::vector<CppTokenizer::Token> CppTokenizer::tokenize(std::string_view src) {
+    std::vector<Token> tokens;
+    tokens.reserve(src.size() / 4);
+
+    size_t pos = 0;
+    while (pos < src.size()) {
+        const size_t begin = pos;
+        const char c = src[pos];
+        Kind kind;
+
+        if (isSpace(c)) {
+            kind = Kind::Whitespace;
+            while (pos < src.size() && isSpace(src[pos])) {
+                ++pos;
+            }
+        } else if (c == '/' && pos + 1 < src.size() && src[pos + 1] == '/') {
+            kind = Kind::Comment;
+            // Up to the end of the line, honoring backslash continuations
+            while (pos < src.size() && src[pos] != '\n') {
+                if (src[pos] == '\\' && pos + 1 < src.size() && src[pos + 1] == '\n') {
+                    ++pos;
+                }
+                ++pos;
+            }
+        } else if (c == '/' && pos + 1 < src.size() && src[pos + 1] == '*') {
+            kind = Kind::Comment;
+            const size_t end = src.find("*/", pos + 2);
+            pos = end == std::string_view::npos ? src.size() : end + 2;
+        } else if (isIdentStart(c)) {
+            while (pos < src.size() && isIdentChar(src[pos])) {
+                ++pos;
+            }
+            kind = Kind::Identifier;
+            // Encoding prefixes glue to a directly following literal
+            if (pos < src.size() && (src[pos] == '"' || src[pos] == '\'')) {
+                const std::string_view prefix = src.substr(begin, pos - begin);
+                if (src[pos] == '"' && isRawPrefix(prefix)) {
+                    kind = Kind::RawString;
+                    pos = skipRawString(src, pos);
+                } else if (isEncodingPrefix(prefix)) {
+                    kind = src[pos] == '"' ? Kind::String : Kind::Char;
+                    pos = skipQuoted(src, pos);
+                }
+            }
+        } else if (isDigit(c) || (c == '.' && pos + 1 < src.size() && isDigit(src[pos + 1]))) {
+            kind = Kind::Number;
+            pos = skipNumber(src, pos + 1);
+        } else if (c == '"') {
+            kind = Kind::String;
+            pos = skipQuoted(src, pos);
+        } else if (c == '\'') {
+            kind = Kind::Char;
+            pos = skipQuoted(src, pos);
+        } else {
+            kind = Kind::Punctuation;
+            pos += (c == ':' && pos + 1 < src.size() && src[pos + 1] == ':') ? 2 : 1;
+        }
+
+        tokens.push_back({kind, begin, pos - begin});
+    }
+
+    return tokens;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Minimal C++ lexer used by the source protection passes. It splits a
+// translation unit into tokens in a single pass and knows about comments,
+// string/char literals (with encoding prefixes), raw strings and numbers,
+// so that identifier renaming never touches text inside them.
+// Concatenating the text of all tokens gives back the input exactly.
+class CppTokenizer {
+public:
+    enum class Kind {
+        Identifier,
+        Number,
+        String,       // "..." with optional L/u/U/u8 prefix
+        RawString,    // R"delim(...)delim" with optional prefix
+        Char,         // '...'
+        Comment,      // // ... or /* ... */
+        Whitespace,
+        Punctuation   // "::" is one token, everything else a single char
+    };
+
+    struct Token {
+        Kind kind;
+        size_t begin;
+        size_t length;
+    };
+
+    static std::vector<Token> tokenize(std::string_view source);
+
+    static std::string_view text(std::string_view source, const Token& token) {
+        return source.substr(token.begin, token.length);
+    }
+
+    // Comments and whitespace
+    static bool isTrivia(const Token& token) {
+        return token.kind == Kind::Whitespace || token.kind == Kind::Comment;
+    }
+};
@@ -2,13 +2,32 @@
 #include <fstream>
 #include <sstream>
 #include <random>
-#include <QProcess>
 #include <QFileInfo>
+#include <QDateTime>
+#include <QDeadlineTimer>
 #include <QDir>
 #include <QFile>
+#include <QProcess>
 #include <QStandardPaths>
 #include <QSettings>
 #include "llvm_obfuscation.h"
+#include "mapped_file.h"
+#include "upx/src/libupx.h"
+#include "upx/src/version.h"
+
+std::string ExeProtection::ProtectionConfig::cacheKey() const {
+    // Bump the format number when packWithUPX changes its options
+    std::ostringstream key;
+    key << "exe/1;version=" << SPECTREGUARD_VERSION << ";upx=" << useUPX;
+#ifdef SPECTREGUARD_WITH_UPX_ENGINE
+    key << ";upx-version=" << UPX_VERSION_STRING;
+#else
+    // The external packer's version is unknown, use its size and date
+    const QFileInfo tool(upxToolPath());
+    key << ";upx-tool=" << tool.size() << '@' << tool.lastModified().toMSecsSinceEpoch();
+#endif
+    return key.str();
+}
 
 bool ExeProtection::protect(const std::string& exePath, 
                           const std::string& outputPath, 
@@ -21,7 +40,10 @@ bool ExeProtection::protect(const std::string& exePath,
         
         // Only do UPX packing
         if (config.useUPX) {
-            if (!packWithUPX(exePath, outputPath, config.progressCallback)) {
+            if (!packWithUPX(exePath, outputPath, config)) {
+                if (config.cancelled()) {
+                    return false;
+                }
                 if (config.progressCallback) {
                     config.progressCallback(0, "UPX packing failed");
                 }
@@ -40,13 +62,28 @@ bool ExeProtection::protect(const std::string& exePath,
                 config.progressCallback(25, "Copying file...");
             }
             
-            std::vector<uint8_t> exeData = readFile(exePath);
+            // Copying a file onto itself is a no-op, and writing it while
+            // it is mapped would truncate the mapping
+            if (isSameFile(exePath, outputPath)) {
+                if (config.progressCallback) {
+                    config.progressCallback(100, "Protection completed successfully");
+                }
+                return true;
+            }
+
+            MappedFile exeData;
+            openInput(exePath, exeData);
+
+            // Nothing has been written yet
+            if (config.cancelled()) {
+                return false;
+            }
             
             if (config.progressCallback) {
                 config.progressCallback(75, "Writing output file...");
             }
             
-            if (!writeFile(outputPath, exeData)) {
+            if (!writeFile(outputPath, exeData.data(), exeData.size())) {
                 if (config.progressCallback) {
                     config.progressCallback(0, "Failed to write output file");
                 }
@@ -69,18 +106,103 @@ bool ExeProtection::protect(const std::string& exePath,
     }
 }
 
-bool ExeProtection::packWithUPX(const std::string& exePath, const std::string& outputPath, const ProgressCallback& callback) {
+bool ExeProtection::packWithUPX(const std::string& exePath, const std::string& outputPath, const ProtectionConfig& config) {
+#ifndef SPECTREGUARD_WITH_UPX_ENGINE
+    return packWithUPXTool(exePath, outputPath, config);
+#else
+    const ProgressCallback& callback = config.progressCallback;
+
+    // Check if source file exists
+    if (!QFileInfo::exists(QString::fromStdString(exePath))) {
+        qWarning() << "Source file not found for UPX compression:" << QString::fromStdString(exePath);
+        if (callback) {
+            callback(0, "Source file not found");
+        }
+        return false;
+    }
+
+    if (callback) {
+        callback(30, "Reading input file...");
+    }
+
+    MappedFile input;
+    openInput(exePath, input);
+
+    if (callback) {
+        callback(50, "Running UPX compression...");
+    }
+
+    // Same as "upx --best --force", using all CPU cores
+    upx_lib_options_t options;
+    options.level = 10;
+    options.threads = 0;
+    options.force = 1;
+    options.name = exePath.c_str();
+    // Checked by the UPX engine before each compression call
+    if (config.cancelCallback) {
+        options.cancelled = [](void *user) {
+            return (*static_cast<const CancelCallback*>(user))();
+        };
+        options.cancelled_user = const_cast<CancelCallback*>(&config.cancelCallback);
+    }
+
+    std::vector<uint8_t> output;
+    std::string error;
+    if (!upx_lib_pack(input.data(), input.size(), &output, options, &error)) {
+        if (config.cancelled()) {
+            qDebug() << "UPX compression cancelled";
+            return false;
+        }
+        qWarning() << "UPX compression failed:" << QString::fromStdString(error);
+        if (callback) {
+            callback(0, "UPX compression failed: " + error);
+        }
+        return false;
+    }
+
+    // Release the mapping before writing, the output may be the input file
+    const size_t inputSize = input.size();
+    input.close();
+
+    // The output has not been touched yet
+    if (config.cancelled()) {
+        return false;
+    }
+
+    if (callback) {
+        callback(80, "Writing output file...");
+    }
+
+    if (!writeFile(outputPath, output.data(), output.size())) {
+        qWarning() << "Failed to write output file:" << QString::fromStdString(outputPath);
+        if (callback) {
+            callback(0, "Failed to write output file");
+        }
+        return false;
+    }
+
+    if (callback) {
+        callback(90, "UPX compression completed successfully");
+    }
+
+    qDebug() << "UPX compression successful. File size:" << inputSize << "->" << output.size() << "bytes";
+    return true;
+#endif
+}
+
+QString ExeProtection::upxToolPath() {
     // Use a standard relative path to UPX
-    QString upxPath = "tools/upx/upx.exe";
-    
+    return QDir::current().absoluteFilePath("tools/upx/upx.exe");
+}
+
+bool ExeProtection::packWithUPXTool(const std::string& exePath, const std::string& outputPath, const ProtectionConfig& config) {
+    const ProgressCallback& callback = config.progressCallback;
+
     if (callback) {
         callback(20, "Checking UPX installation...");
     }
-    
-    qDebug() << "Using standard UPX path:" << upxPath;
 
-    // Convert relative path to absolute
-    QString absoluteUpxPath = QDir::current().absoluteFilePath(upxPath);
+    const QString absoluteUpxPath = upxToolPath();
     qDebug() << "Absolute UPX path:" << absoluteUpxPath;
 
     // Check if UPX executable exists
@@ -105,22 +227,18 @@ bool ExeProtection::packWithUPX(const std::string& exePath, const std::string& o
         callback(30, "Preparing files for packing...");
     }
 
-    // First, copy the file to the output path if it's not already there
-    QFile sourceFile(QString::fromStdString(exePath));
-    QFile outputFile(QString::fromStdString(outputPath));
-    
-    if (exePath != outputPath) {
-        if (outputFile.exists()) {
-            if (!outputFile.remove()) {
-                qWarning() << "Failed to remove existing output file:" << QString::fromStdString(outputPath);
-                if (callback) {
-                    callback(0, "Failed to remove existing output file");
-                }
-                return false;
+    // UPX packs in place: copy the file to the output path first
+    const QString output = QString::fromStdString(outputPath);
+    const bool inPlace = isSameFile(exePath, outputPath);
+    if (!inPlace) {
+        if (QFile::exists(output) && !QFile::remove(output)) {
+            qWarning() << "Failed to remove existing output file:" << output;
+            if (callback) {
+                callback(0, "Failed to remove existing output file");
             }
+            return false;
         }
-        
-        if (!sourceFile.copy(QString::fromStdString(outputPath))) {
+        if (!QFile::copy(QString::fromStdString(exePath), output)) {
             qWarning() << "Failed to copy source file to output path";
             if (callback) {
                 callback(0, "Failed to copy source file");
@@ -128,94 +246,84 @@ bool ExeProtection::packWithUPX(const std::string& exePath, const std::string& o
             return false;
         }
     }
-    
+
+    // The copy is not a packed file; never leave it behind on failure
+    auto discardOutput = [&]() {
+        if (!inPlace) {
+            QFile::remove(output);
+        }
+        return false;
+    };
+
     if (callback) {
         callback(50, "Running UPX compression...");
     }
-    
-    // Convert paths to Windows format
-    QString windowsUpxPath = QDir::toNativeSeparators(absoluteUpxPath);
-    QString windowsOutputPath = QDir::toNativeSeparators(QString::fromStdString(outputPath));
-    
-    // Build UPX command arguments
+
     QStringList arguments;
-    arguments << "--best" << "--force" << windowsOutputPath;
-    
-    qDebug() << "Running UPX command:" << windowsUpxPath << arguments.join(" ");
-    
+    arguments << "--best" << "--force" << QDir::toNativeSeparators(output);
+
     QProcess process;
     process.setProcessChannelMode(QProcess::MergedChannels);
-    process.start(windowsUpxPath, arguments);
-    
+    process.start(QDir::toNativeSeparators(absoluteUpxPath), arguments);
+
     if (!process.waitForStarted(10000)) {
         qWarning() << "Failed to start UPX process:" << process.errorString();
         if (callback) {
             callback(0, "Failed to start UPX process");
         }
-        return false;
+        return discardOutput();
     }
-    
-    // Wait up to 2 minutes for completion
-    if (!process.waitForFinished(120000)) {
-        qWarning() << "UPX process timed out after 2 minutes";
-        process.kill();
-        if (callback) {
-            callback(0, "UPX process timed out");
+
+    // Wait up to 2 minutes for completion; UPX writes a temporary file and
+    // renames it at the end, so killing it leaves the output unpacked
+    QDeadlineTimer deadline(120000);
+    while (!process.waitForFinished(100)) {
+        if (config.cancelled()) {
+            process.kill();
+            process.waitForFinished();
+            return discardOutput();
+        }
+        if (deadline.hasExpired()) {
+            qWarning() << "UPX process timed out after 2 minutes";
+            process.kill();
+            process.waitForFinished();
+            if (callback) {
+                callback(0, "UPX process timed out");
+            }
+            return discardOutput();
         }
-        return false;
     }
 
-    if (callback) {
-        callback(80, "Finalizing...");
-    }
+    qDebug() << "UPX process output:" << QString::fromLocal8Bit(process.readAll());
 
-    QString output = QString::fromLocal8Bit(process.readAll());
-    qDebug() << "UPX process output:" << output;
-    qDebug() << "UPX exit code:" << process.exitCode() << "exit status:" << process.exitStatus();
-    
-    if (process.exitCode() != 0) {
+    if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0) {
         qWarning() << "UPX process failed with exit code:" << process.exitCode();
         if (callback) {
             callback(0, "UPX process failed with error code: " + std::to_string(process.exitCode()));
         }
-        return false;
+        return discardOutput();
     }
 
-    // Verify output file exists and has changed size
-    QFileInfo outputFileInfo(QString::fromStdString(outputPath));
-    if (!outputFileInfo.exists()) {
-        qWarning() << "Output file does not exist after UPX compression:" << QString::fromStdString(outputPath);
-        if (callback) {
-            callback(0, "Output file does not exist after UPX compression");
-        }
-        return false;
-    }
-    
     if (callback) {
         callback(90, "UPX compression completed successfully");
     }
-    
-    qDebug() << "UPX compression successful. File size:" << outputFileInfo.size() << "bytes";
+
+    qDebug() << "UPX compression successful. File size:" << QFileInfo(output).size() << "bytes";
     return true;
 }
 
-std::vector<uint8_t> ExeProtection::readFile(const std::string& path) {
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open()) {
+void ExeProtection::openInput(const std::string& path, MappedFile& file) {
+    if (!file.open(path)) {
         throw std::runtime_error("Cannot open file: " + path);
     }
-    return std::vector<uint8_t>(
-        std::istreambuf_iterator<char>(file),
-        std::istreambuf_iterator<char>()
-    );
 }
 
-bool ExeProtection::writeFile(const std::string& path, const std::vector<uint8_t>& data) {
+bool ExeProtection::writeFile(const std::string& path, const uint8_t* data, size_t size) {
     std::ofstream file(path, std::ios::binary);
     if (!file.is_open()) {
         return false;
     }
-    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    file.write(reinterpret_cast<const char*>(data), std::streamsize(size));
     return file.good();
 }
 
@@ -8,14 +8,26 @@
 #include <QDebug>
 #include <functional>
 
+class MappedFile;
+
 class ExeProtection {
 public:
     // Progress callback type
     using ProgressCallback = std::function<void(int progress, const std::string& status)>;
+    // Returns true once the caller wants the protection to stop
+    using CancelCallback = std::function<bool()>;
     
     struct ProtectionConfig {
         bool useUPX = true;               // Use UPX packing
         ProgressCallback progressCallback; // Progress callback function
+        CancelCallback cancelCallback;     // Polled between stages, may be empty
+
+        bool cancelled() const { return cancelCallback && cancelCallback(); }
+
+        // Options and tool versions the output depends on, for ResultCache
+        std::string cacheKey() const;
+        // UPX output is a pure function of the input and the options
+        bool isDeterministic() const { return true; }
     };
 
     static bool protect(const std::string& exePath, 
@@ -23,11 +35,15 @@ public:
                        const ProtectionConfig& config);
 
 private:
-    // UPX packing
-    static bool packWithUPX(const std::string& exePath, const std::string& outputPath, const ProgressCallback& callback);
+    // UPX packing, in-process when built with SPECTREGUARD_WITH_UPX_ENGINE
+    static bool packWithUPX(const std::string& exePath, const std::string& outputPath, const ProtectionConfig& config);
+    // UPX packing by running tools/upx/upx.exe
+    static bool packWithUPXTool(const std::string& exePath, const std::string& outputPath, const ProtectionConfig& config);
+    static QString upxToolPath();
     
     // Helper functions
-    static std::vector<uint8_t> readFile(const std::string& path);
-    static bool writeFile(const std::string& path, const std::vector<uint8_t>& data);
+    // Maps the whole input file, throws if it cannot be opened
+    static void openInput(const std::string& path, MappedFile& file);
+    static bool writeFile(const std::string& path, const uint8_t* data, size_t size);
     static bool isValidPE(const std::vector<uint8_t>& data);
 }; 
\ No newline at end of file
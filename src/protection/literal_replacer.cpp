@@ -0,0 +1,121 @@
+#include "literal_replacer.h"
+#include "text_sink.h"
+#include <algorithm>
+#include <deque>
+
+LiteralReplacer::LiteralReplacer(const std::map<std::string, std::string>& replacementMap) {
+    nodes.emplace_back(); // root
+
+    // Trie of all patterns
+    for (const auto& pair : replacementMap) {
+        if (pair.first.empty()) {
+            continue;
+        }
+        int node = 0;
+        for (unsigned char c : pair.first) {
+            int next = child(node, c);
+            if (next < 0) {
+                next = int(nodes.size());
+                nodes.emplace_back();
+                auto& edges = nodes[node].next;
+                edges.insert(std::lower_bound(edges.begin(), edges.end(), std::make_pair(c, 0)),
+                             std::make_pair(c, next));
+            }
+            node = next;
+        }
+        nodes[node].pattern = int(patterns.size());
+        patterns.push_back(pair.first);
+        replacements.push_back(pair.second);
+    }
+
+    // Failure and output links, breadth first
+    std::deque<int> queue;
+    for (const auto& edge : nodes[0].next) {
+        queue.push_back(edge.second);
+    }
+    while (!queue.empty()) {
+        const int node = queue.front();
+        queue.pop_front();
+        for (const auto& edge : nodes[node].next) {
+            const int target = edge.second;
+            int fail = nodes[node].fail;
+            while (fail != 0 && child(fail, edge.first) < 0) {
+                fail = nodes[fail].fail;
+            }
+            const int next = child(fail, edge.first);
+            nodes[target].fail = (next >= 0 && next != target) ? next : 0;
+            const Node& failNode = nodes[nodes[target].fail];
+            nodes[target].outputLink = failNode.pattern >= 0 ? nodes[target].fail : failNode.outputLink;
+            queue.push_back(target);
+        }
+    }
+}
+
+int LiteralReplacer::child(int node, unsigned char c) const {
+    const auto& edges = nodes[node].next;
+    auto it = std::lower_bound(edges.begin(), edges.end(), std::make_pair(c, 0));
+    return (it != edges.end() && it->first == c) ? it->second : -1;
+}
+
+std::string LiteralReplacer::replaceAll(std::string_view text) const {
+    std::string result;
+    StringSink sink(result);
+    replaceAll(text, sink);
+    return result;
+}
+
+void LiteralReplacer::replaceAll(std::string_view text, TextSink& output) const {
+    if (patterns.empty()) {
+        output.write(text);
+        return;
+    }
+
+    // All matches as (start, pattern)
+    std::vector<std::pair<size_t, int>> matches;
+    int node = 0;
+    for (size_t pos = 0; pos < text.size(); ++pos) {
+        const unsigned char c = static_cast<unsigned char>(text[pos]);
+        int next;
+        while ((next = child(node, c)) < 0 && node != 0) {
+            node = nodes[node].fail;
+        }
+        node = next < 0 ? 0 : next;
+        for (int out = nodes[node].pattern >= 0 ? node : nodes[node].outputLink; out >= 0;
+             out = nodes[out].outputLink) {
+            const int pattern = nodes[out].pattern;
+            matches.emplace_back(pos + 1 - patterns[pattern].size(), pattern);
+        }
+    }
+    if (matches.empty()) {
+        output.write(text);
+        return;
+    }
+
+    // Leftmost-longest, non-overlapping
+    std::sort(matches.begin(), matches.end(), [&](const auto& a, const auto& b) {
+        if (a.first != b.first) {
+            return a.first < b.first;
+        }
+        return patterns[a.second].size() > patterns[b.second].size();
+    });
+    std::vector<std::pair<size_t, int>> selected;
+    size_t covered = 0;
+    size_t outputSize = text.size();
+    for (const auto& match : matches) {
+        if (match.first < covered) {
+            continue;
+        }
+        selected.push_back(match);
+        covered = match.first + patterns[match.second].size();
+        outputSize = outputSize - patterns[match.second].size() + replacements[match.second].size();
+    }
+
+    output.reserve(outputSize);
+    size_t pos = 0;
+    for (const auto& match : selected) {
+        output.write(text.substr(pos, match.first - pos));
+        output.write(replacements[match.second]);
+        pos = match.first + patterns[match.second].size();
+    }
+    output.write(text.substr(pos));
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class TextSink;
+
+// Replaces many fixed strings in one pass. The patterns are compiled once
+// into an Aho-Corasick automaton; replaceAll() scans the text a single time
+// and writes the result into one preallocated buffer. Patterns are plain
+// bytes - no escaping of regex metacharacters is needed.
+//
+// Overlapping matches are resolved leftmost-longest, i.e. like replacing
+// from left to right and preferring the longest pattern at each position.
+class LiteralReplacer {
+public:
+    // pattern -> replacement; empty patterns are ignored
+    explicit LiteralReplacer(const std::map<std::string, std::string>& replacements);
+
+    std::string replaceAll(std::string_view text) const;
+    void replaceAll(std::string_view text, TextSink& output) const;
+
+    bool empty() const { return patterns.empty(); }
+
+private:
+    struct Node {
+        std::vector<std::pair<unsigned char, int>> next; // sorted by byte
+        int fail = 0;
+        int pattern = -1;     // pattern ending exactly here
+        int outputLink = -1;  // nearest node on the fail chain with a pattern
+    };
+
+    int child(int node, unsigned char c) const;
+
+    std::vector<Node> nodes;
+    std::vector<std::string> patterns;
+    std::vector<std::string> replacements;
+};
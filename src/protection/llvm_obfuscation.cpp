@@ -11,80 +11,88 @@
 #include <QTextStream>
 #include <Windows.h>
 #include <QStandardPaths>
+#include <iterator>
+#include "payload_kernel.h"
+#include "payload_kernel_source.h"
 
 bool LLVMObfuscation::obfuscateExecutable(const std::string& exePath, 
                                         const std::string& outputPath, 
                                         const ObfuscationConfig& config) {
+    auto fail = [&config](const char* reason) {
+        qWarning() << reason;
+        if (config.progressCallback) {
+            config.progressCallback(0, reason);
+        }
+        return false;
+    };
+
     try {
         // Check if LLVM tools are available
         if (!checkLLVMTools()) {
-            qWarning() << "LLVM tools are not available";
-            return false;
+            return fail("LLVM tools are not available");
         }
 
         // Create a temporary directory for processing
         std::string tempDir = createTempDirectory();
         if (tempDir.empty()) {
-            qWarning() << "Failed to create temporary directory";
-            return false;
+            return fail("Failed to create temporary directory");
         }
 
         qDebug() << "Using temporary directory:" << QString::fromStdString(tempDir);
 
+        // The tools cannot be interrupted, the job stops after the running one
+        auto cancelled = [&config, &tempDir]() {
+            if (!config.cancelled()) {
+                return false;
+            }
+            cleanupTempDirectory(tempDir);
+            return true;
+        };
+
         // Extract code sections for processing
-        if (!extractCodeSections(exePath, tempDir)) {
-            qWarning() << "Failed to extract code sections";
+        if (!extractCodeSections(exePath, tempDir, config)) {
             cleanupTempDirectory(tempDir);
+            return fail("Failed to extract code sections");
+        }
+        if (cancelled()) {
             return false;
         }
 
         std::string bitcodePath = tempDir + "/code.bc";
 
-        // Apply obfuscations based on config
-        if (config.controlFlowFlattening) {
-            if (!applyControlFlowFlattening(bitcodePath, config.obfuscationLevel)) {
-                qWarning() << "Control flow flattening failed";
-                cleanupTempDirectory(tempDir);
-                return false;
+        // Run the passes the plugin provides over a single parse of the module
+        // when opt is available; the others, or all of them if the pipeline
+        // fails, run as one tool invocation per pass
+        ObfuscationConfig remaining = config;
+        if (config.singlePassPipeline && hasOptTool) {
+            if (!applyPassPipeline(bitcodePath, config, remaining)) {
+                qWarning() << "Pass pipeline failed, applying passes separately";
+                remaining = config;
             }
-        }
-
-        if (config.instructionSubstitution) {
-            if (!applyInstructionSubstitution(bitcodePath, config.obfuscationLevel)) {
-                qWarning() << "Instruction substitution failed";
-                cleanupTempDirectory(tempDir);
+            if (cancelled()) {
                 return false;
             }
         }
 
-        if (config.bogusControlFlow) {
-            if (!applyBogusControlFlow(bitcodePath, config.obfuscationLevel)) {
-                qWarning() << "Bogus control flow insertion failed";
-                cleanupTempDirectory(tempDir);
-                return false;
-            }
-        }
-
-        if (config.deadCodeInsertion) {
-            if (!applyDeadCodeInsertion(bitcodePath, config.obfuscationLevel)) {
-                qWarning() << "Dead code insertion failed";
-                cleanupTempDirectory(tempDir);
+        if (!applyPassesSeparately(bitcodePath, remaining)) {
+            cleanupTempDirectory(tempDir);
+            if (config.cancelled()) {
                 return false;
             }
+            return fail("Applying obfuscation passes failed");
         }
-
-        if (config.stringEncryption) {
-            if (!applyStringEncryption(bitcodePath)) {
-                qWarning() << "String encryption failed";
-                cleanupTempDirectory(tempDir);
-                return false;
-            }
+        if (cancelled()) {
+            return false;
         }
 
         // Recompile and relink
         if (!recompileAndLink(bitcodePath, exePath, outputPath)) {
-            qWarning() << "Recompiling and relinking failed";
             cleanupTempDirectory(tempDir);
+            return fail("Recompiling and relinking failed");
+        }
+        // Cancelled while linking: do not leave an output the job disowns
+        if (cancelled()) {
+            QFile::remove(QString::fromStdString(outputPath));
             return false;
         }
 
@@ -94,11 +102,168 @@ bool LLVMObfuscation::obfuscateExecutable(const std::string& exePath,
     }
     catch (const std::exception& e) {
         qWarning() << "Exception in LLVM obfuscation:" << e.what();
+        if (config.progressCallback) {
+            config.progressCallback(0, std::string("Error: ") + e.what());
+        }
+        return false;
+    }
+}
+
+bool LLVMObfuscation::applyPassesSeparately(const std::string& bitcodePath, const ObfuscationConfig& config) {
+    // Each pass is one tool run; a cancelled job stops between them
+    if (config.controlFlowFlattening) {
+        if (!applyControlFlowFlattening(bitcodePath, config.obfuscationLevel)) {
+            qWarning() << "Control flow flattening failed";
+            return false;
+        }
+    }
+
+    if (config.cancelled()) {
+        return false;
+    }
+    if (config.instructionSubstitution) {
+        if (!applyInstructionSubstitution(bitcodePath, config.obfuscationLevel)) {
+            qWarning() << "Instruction substitution failed";
+            return false;
+        }
+    }
+
+    if (config.cancelled()) {
         return false;
     }
+    if (config.bogusControlFlow) {
+        if (!applyBogusControlFlow(bitcodePath, config.obfuscationLevel)) {
+            qWarning() << "Bogus control flow insertion failed";
+            return false;
+        }
+    }
+
+    if (config.cancelled()) {
+        return false;
+    }
+    if (config.deadCodeInsertion) {
+        if (!applyDeadCodeInsertion(bitcodePath, config.obfuscationLevel)) {
+            qWarning() << "Dead code insertion failed";
+            return false;
+        }
+    }
+
+    if (config.cancelled()) {
+        return false;
+    }
+    if (config.stringEncryption) {
+        if (!applyStringEncryption(bitcodePath)) {
+            qWarning() << "String encryption failed";
+            return false;
+        }
+    }
+
+    return true;
 }
 
-bool LLVMObfuscation::extractCodeSections(const std::string& exePath, const std::string& tempDir) {
+// Passes registered by the pass plugin, see
+// tools/llvm/ObfuscationPasses/src/Plugin.cpp. opt rejects a whole
+// -passes= pipeline that names any other pass.
+static const QStringList pluginFunctionPasses = {"flatten", "subst", "bogusflow", "deadcode"};
+static const QStringList pluginModulePasses = {"stringobf"};
+
+// Pipeline element of a plugin pass with its options for the obfuscation level
+static QString pluginPass(const QString& name, int level) {
+    QString options;
+    if (name == "subst") {
+        options = level > 2 ? "prob=70;all" : level > 1 ? "prob=70" : "";
+    } else if (name == "bogusflow") {
+        options = level > 2 ? "prob=60;loop" : level > 1 ? "prob=60" : "";
+    } else if (name == "deadcode") {
+        options = level > 2 ? "prob=70;complex" : level > 1 ? "prob=70" : "";
+    }
+    return options.isEmpty() ? name : name + "<" + options + ">";
+}
+
+bool LLVMObfuscation::applyPassPipeline(const std::string& bitcodePath, const ObfuscationConfig& config,
+                                        ObfuscationConfig& remaining) {
+    const int level = config.obfuscationLevel;
+    QStringList functionPasses;
+    QStringList modulePasses;
+    std::vector<bool ObfuscationConfig::*> piped;
+
+    // Same passes and level options as the separate invocations, in the same
+    // order; the module pass comes last, so the function passes can share one
+    // function(...) adaptor. The pipeline takes the selected passes up to the
+    // first one the plugin does not register; that one and all later ones run
+    // separately.
+    bool registered = true;
+    auto select = [&](bool ObfuscationConfig::*enabled, const QString& name) {
+        if (!(config.*enabled)) {
+            return;
+        }
+        const bool isFunctionPass = pluginFunctionPasses.contains(name);
+        registered = registered && (isFunctionPass || pluginModulePasses.contains(name));
+        if (registered) {
+            (isFunctionPass ? functionPasses : modulePasses) << pluginPass(name, level);
+            piped.push_back(enabled);
+        }
+    };
+    select(&ObfuscationConfig::controlFlowFlattening, "flatten");
+    select(&ObfuscationConfig::instructionSubstitution, "subst");
+    select(&ObfuscationConfig::bogusControlFlow, "bogusflow");
+    select(&ObfuscationConfig::deadCodeInsertion, "deadcode");
+    select(&ObfuscationConfig::stringEncryption, "stringobf");
+
+    QStringList passes;
+    if (!functionPasses.isEmpty()) {
+        passes << "function(" + functionPasses.join(",") + ")";
+    }
+    passes << modulePasses;
+    if (passes.isEmpty()) {
+        return true;
+    }
+
+    qDebug() << "Applying pass pipeline:" << passes.join(",");
+
+    QString optPath = llvmBinDirPath + QDir::separator() + "opt.exe";
+    QString windowsBitcodePath = QDir::toNativeSeparators(QString::fromStdString(bitcodePath));
+    // Written next to the input so a failed run leaves code.bc intact for the fallback
+    QString windowsOutputPath = windowsBitcodePath + ".pipeline.bc";
+
+    QProcess optProcess;
+    QStringList optArgs;
+    optArgs << "-load-pass-plugin=LLVMObfuscation.dll"
+            << "-passes=" + passes.join(",")
+            << "-o" << windowsOutputPath
+            << windowsBitcodePath;
+
+    optProcess.start(optPath, optArgs);
+    if (!optProcess.waitForFinished(60000 * int(piped.size()))) {
+        qWarning() << "Pass pipeline timed out";
+        optProcess.kill();
+        QFile::remove(windowsOutputPath);
+        return false;
+    }
+
+    if (optProcess.exitCode() != 0) {
+        qWarning() << "Pass pipeline failed with exit code:" << optProcess.exitCode();
+        qWarning() << "Error output:" << QString::fromLocal8Bit(optProcess.readAllStandardError());
+        QFile::remove(windowsOutputPath);
+        return false;
+    }
+
+    QFile::remove(windowsBitcodePath);
+    if (!QFile::rename(windowsOutputPath, windowsBitcodePath)) {
+        return false;
+    }
+    for (bool ObfuscationConfig::*enabled : piped) {
+        remaining.*enabled = false;
+    }
+    return true;
+}
+
+const char* LLVMObfuscation::payloadDecryptorSource() {
+    return payloadKernelSource;
+}
+
+bool LLVMObfuscation::extractCodeSections(const std::string& exePath, const std::string& tempDir,
+                                          const ObfuscationConfig& config) {
     qDebug() << "Creating obfuscated loader for" << QString::fromStdString(exePath);
     
     // Get paths to LLVM tools
@@ -136,17 +301,15 @@ bool LLVMObfuscation::extractCodeSections(const std::string& exePath, const std:
     std::random_device rd;
     std::mt19937 gen(rd());
     std::uniform_int_distribution<> dis(1, 255);
-    std::vector<unsigned char> xorKeys;
-    for (int i = 0; i < 4; i++) {
-        xorKeys.push_back(static_cast<unsigned char>(dis(gen)));
+    unsigned char xorKeys[4];
+    for (unsigned char& key : xorKeys) {
+        key = static_cast<unsigned char>(dis(gen));
     }
     
     // Encrypt the executable data with multiple keys
-    QByteArray encryptedExe = exeData;
-    for (int i = 0; i < encryptedExe.size(); i++) {
-        unsigned char key = xorKeys[i % xorKeys.size()];
-        encryptedExe[i] = encryptedExe[i] ^ key ^ (i & 0xFF);
-    }
+    QByteArray encryptedExe(exeData.size(), Qt::Uninitialized);
+    encryptPayload(reinterpret_cast<const unsigned char*>(exeData.constData()),
+                   reinterpret_cast<unsigned char*>(encryptedExe.data()), unsigned(exeData.size()), xorKeys);
     
     // Create the C++ loader with embedded encrypted executable
     QTextStream out(&loaderFile);
@@ -157,20 +320,26 @@ bool LLVMObfuscation::extractCodeSections(const std::string& exePath, const std:
     out << "#include <time.h>\n";
     out << "#include <TlHelp32.h>\n\n";
     
-    // Write the encrypted executable as a byte array
-    out << "// Encrypted executable data\n";
-    out << "unsigned char encrypted_exe[] = {\n    ";
-    
-    for (int i = 0; i < encryptedExe.size(); i++) {
-        out << QString("0x%1").arg((unsigned char)encryptedExe[i], 2, 16, QChar('0')).toUpper();
-        if (i < encryptedExe.size() - 1) {
-            out << ", ";
-            if ((i + 1) % 16 == 0) {
-                out << "\n    ";
-            }
-        }
+    // The payload is written as a raw file and pulled in by the assembler with
+    // .incbin from module-level asm, so clang never parses it as source and the
+    // obfuscation passes leave it alone. The asm label keeps the symbol name the
+    // same on x86 (leading underscore) and x64.
+    QString payloadPath = windowsTempDir + QDir::separator() + "payload.bin";
+    QFile payloadFile(payloadPath);
+    if (!payloadFile.open(QIODevice::WriteOnly) ||
+        payloadFile.write(encryptedExe) != encryptedExe.size()) {
+        qWarning() << "Failed to write encrypted payload";
+        return false;
     }
-    out << "\n};\n\n";
+    payloadFile.close();
+
+    out << "// Encrypted executable data\n";
+    out << "__asm__(\".section .rdata,\\\"dr\\\"\\n\"\n";
+    out << "        \".p2align 4\\n\"\n";
+    out << "        \"sg_encrypted_exe:\\n\"\n";
+    out << "        \".incbin \\\"" << QDir::fromNativeSeparators(payloadPath) << "\\\"\\n\"\n";
+    out << "        \".text\\n\");\n";
+    out << "extern \"C\" const unsigned char encrypted_exe[] __asm__(\"sg_encrypted_exe\");\n\n";
     
     out << "// Size of the encrypted executable\n";
     out << "const unsigned int encrypted_exe_size = " << encryptedExe.size() << ";\n\n";
@@ -178,14 +347,18 @@ bool LLVMObfuscation::extractCodeSections(const std::string& exePath, const std:
     // Write XOR keys array
     out << "// XOR keys for decryption\n";
     out << "const unsigned char xor_keys[] = {";
-    for (size_t i = 0; i < xorKeys.size(); i++) {
+    for (size_t i = 0; i < std::size(xorKeys); i++) {
         out << "0x" << QString("%1").arg(xorKeys[i], 2, 16, QChar('0')).toUpper();
-        if (i < xorKeys.size() - 1) {
+        if (i < std::size(xorKeys) - 1) {
             out << ", ";
         }
     }
     out << "};\n";
-    out << "const int num_keys = " << xorKeys.size() << ";\n\n";
+    out << "const int num_keys = " << std::size(xorKeys) << ";\n\n";
+
+    if (config.vectorizedDecrypt) {
+        out << payloadDecryptorSource();
+    }
     
     // Add various anti-debugging and VM detection functions
     out << "// Anti-debugging and anti-VM detection\n\n";
@@ -300,21 +473,25 @@ bool LLVMObfuscation::extractCodeSections(const std::string& exePath, const std:
     out << "    unsigned char* decrypted = (unsigned char*)malloc(encrypted_exe_size);\n";
     out << "    if (!decrypted) return -1;\n\n";
     
-    out << "    // Complex decryption algorithm with timing protection\n";
-    out << "    DWORD startTime = GetTickCount();\n";
-    out << "    \n";
-    out << "    for (unsigned int i = 0; i < encrypted_exe_size; i++) {\n";
-    out << "        unsigned char key = xor_keys[i % num_keys];\n";
-    out << "        decrypted[i] = encrypted_exe[i] ^ key ^ (i & 0xFF);\n";
-    out << "        \n";
-    out << "        // Add timing protection - make sure decryption isn't too fast\n";
-    out << "        if (i % 100000 == 0) {\n";
-    out << "            DWORD currentTime = GetTickCount();\n";
-    out << "            if (currentTime - startTime < 10) { // If decrypting too fast, it might be an emulator\n";
-    out << "                Sleep(50); // Slow it down a bit to match expected timing\n";
-    out << "            }\n";
-    out << "        }\n";
-    out << "    }\n\n";
+    if (config.vectorizedDecrypt) {
+        out << "    decryptPayload(encrypted_exe, decrypted, encrypted_exe_size, xor_keys);\n\n";
+    } else {
+        out << "    // Complex decryption algorithm with timing protection\n";
+        out << "    DWORD startTime = GetTickCount();\n";
+        out << "    \n";
+        out << "    for (unsigned int i = 0; i < encrypted_exe_size; i++) {\n";
+        out << "        unsigned char key = xor_keys[i % num_keys];\n";
+        out << "        decrypted[i] = encrypted_exe[i] ^ key ^ (i & 0xFF);\n";
+        out << "        \n";
+        out << "        // Add timing protection - make sure decryption isn't too fast\n";
+        out << "        if (i % 100000 == 0) {\n";
+        out << "            DWORD currentTime = GetTickCount();\n";
+        out << "            if (currentTime - startTime < 10) { // If decrypting too fast, it might be an emulator\n";
+        out << "                Sleep(50); // Slow it down a bit to match expected timing\n";
+        out << "            }\n";
+        out << "        }\n";
+        out << "    }\n\n";
+    }
     
     out << "    // Write decrypted executable to temporary file\n";
     out << "    FILE* file = fopen(tempFilePath, \"wb\");\n";
@@ -480,13 +657,8 @@ bool LLVMObfuscation::applyInstructionSubstitution(const std::string& bitcodePat
     QProcess optProcess;
     QStringList optArgs;
     
-    // Substitution options based on level
-    QString passOptions = "subst";
-    if (level > 1) passOptions += ",subst-prob=70";
-    if (level > 2) passOptions += ",subst-all=1";
-    
-    optArgs << "-load" << "LLVMObfuscation.dll"
-            << "-" + passOptions
+    optArgs << "-load-pass-plugin=LLVMObfuscation.dll"
+            << "-passes=" + pluginPass("subst", level)
             << "-o" << windowsOutputPath
             << windowsBitcodePath;
     
@@ -524,13 +696,8 @@ bool LLVMObfuscation::applyBogusControlFlow(const std::string& bitcodePath, int
     QProcess optProcess;
     QStringList optArgs;
     
-    // Bogus control flow options based on level
-    QString passOptions = "bogusflow";
-    if (level > 1) passOptions += ",bogus-prob=60";
-    if (level > 2) passOptions += ",bogus-loop=1";
-    
-    optArgs << "-load" << "LLVMObfuscation.dll"
-            << "-" + passOptions
+    optArgs << "-load-pass-plugin=LLVMObfuscation.dll"
+            << "-passes=" + pluginPass("bogusflow", level)
             << "-o" << windowsOutputPath
             << windowsBitcodePath;
     
@@ -675,13 +842,8 @@ bool LLVMObfuscation::applyDeadCodeInsertion(const std::string& bitcodePath, int
     QProcess optProcess;
     QStringList optArgs;
     
-    // Dead code insertion options
-    QString passOptions = "deadcode";
-    if (level > 1) passOptions += ",deadcode-prob=70";
-    if (level > 2) passOptions += ",deadcode-complex=1";
-    
-    optArgs << "-load" << "LLVMObfuscation.dll"
-            << "-" + passOptions
+    optArgs << "-load-pass-plugin=LLVMObfuscation.dll"
+            << "-passes=" + pluginPass("deadcode", level)
             << "-o" << windowsOutputPath
             << windowsBitcodePath;
     
@@ -795,8 +957,8 @@ bool LLVMObfuscation::applyStringEncryption(const std::string& bitcodePath) {
     QProcess optProcess;
     QStringList optArgs;
     
-    optArgs << "-load" << "LLVMObfuscation.dll"
-            << "-stringobf"
+    optArgs << "-load-pass-plugin=LLVMObfuscation.dll"
+            << "-passes=stringobf"
             << "-o" << windowsOutputPath
             << windowsBitcodePath;
     
@@ -1063,6 +1225,31 @@ bool LLVMObfuscation::initializeLLVM() {
     return true;
 }
 
+std::string LLVMObfuscation::ObfuscationConfig::cacheKey() const {
+    // Bump the format number when the generated loader changes
+    std::ostringstream key;
+    key << "llvm/2;version=" << SPECTREGUARD_VERSION << ";flatten=" << controlFlowFlattening << ";subst=" << instructionSubstitution
+        << ";bogus=" << bogusControlFlow << ";deadcode=" << deadCodeInsertion
+        << ";strings=" << stringEncryption << ";level=" << obfuscationLevel
+        << ";pipeline=" << singlePassPipeline << ";vectorized=" << vectorizedDecrypt
+        << ";tools=" << toolFingerprint();
+    return key.str();
+}
+
+std::string LLVMObfuscation::toolFingerprint() {
+    if (llvmBinDirPath.isEmpty() && !checkLLVMTools()) {
+        return "none";
+    }
+
+    std::ostringstream fingerprint;
+    fingerprint << llvmBinDirPath.toStdString();
+    for (const char* tool : {"clang.exe", "opt.exe", "llc.exe", "LLVMObfuscation.dll"}) {
+        QFileInfo info(llvmBinDirPath + QDir::separator() + tool);
+        fingerprint << ';' << tool << '=' << info.size() << '@' << info.lastModified().toMSecsSinceEpoch();
+    }
+    return fingerprint.str();
+}
+
 void LLVMObfuscation::setLLVMPath(const QString& path) {
     if (!path.isEmpty() && QDir(path).exists()) {
         llvmBinDirPath = path;
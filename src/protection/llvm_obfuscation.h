@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <string>
 #include <vector>
 #include <cstdint>
@@ -8,6 +9,11 @@
 
 class LLVMObfuscation {
 public:
+    // Progress callback type; progress 0 reports the reason of a failure
+    using ProgressCallback = std::function<void(int progress, const std::string& status)>;
+    // Returns true once the caller wants the obfuscation to stop
+    using CancelCallback = std::function<bool()>;
+
     struct ObfuscationConfig {
         bool controlFlowFlattening = true;  // Control flow flattening obfuscation
         bool instructionSubstitution = true; // Replace instructions with equivalent ones
@@ -15,6 +21,17 @@ public:
         bool deadCodeInsertion = true;      // Insert dead code
         bool stringEncryption = true;       // Encrypt string literals
         int obfuscationLevel = 2;           // Obfuscation level (1-3)
+        bool singlePassPipeline = true;     // Run all passes in one opt invocation
+        bool vectorizedDecrypt = true;      // SIMD payload decryption in the loader
+        ProgressCallback progressCallback;  // Progress callback function
+        CancelCallback cancelCallback;      // Polled between tool runs, may be empty
+
+        bool cancelled() const { return cancelCallback && cancelCallback(); }
+
+        // Options and LLVM tool versions the output depends on, for ResultCache
+        std::string cacheKey() const;
+        // The loader is encrypted with fresh random keys on every run
+        bool isDeterministic() const { return false; }
     };
 
     // Obfuscate an executable using LLVM
@@ -22,6 +39,10 @@ public:
                                    const std::string& outputPath, 
                                    const ObfuscationConfig& config);
     
+    // Size and modification time of the LLVM tools and the pass plugin, so
+    // cached results are invalidated when the toolchain changes
+    static std::string toolFingerprint();
+
     // Set the LLVM bin directory path
     static void setLLVMPath(const QString& path);
 
@@ -32,8 +53,22 @@ private:
     static inline bool hasLlcTool = false;
     
     // Extract executable code sections for LLVM processing
-    static bool extractCodeSections(const std::string& exePath, const std::string& tempDir);
+    static bool extractCodeSections(const std::string& exePath, const std::string& tempDir,
+                                    const ObfuscationConfig& config);
+
+    // Loader source for decryptPayload(in, out, size, keys): the text of
+    // payload_kernel.h, whose encryptPayload() encodes the payload
+    static const char* payloadDecryptorSource();
     
+    // Run the selected passes that the pass plugin registers through one
+    // opt -passes= pipeline so the bitcode is parsed, verified and written
+    // once. On success the passes it ran are cleared in remaining.
+    static bool applyPassPipeline(const std::string& bitcodePath, const ObfuscationConfig& config,
+                                  ObfuscationConfig& remaining);
+
+    // Run the selected passes as one tool invocation each
+    static bool applyPassesSeparately(const std::string& bitcodePath, const ObfuscationConfig& config);
+
     // Apply control flow flattening
     static bool applyControlFlowFlattening(const std::string& bitcodePath, int level);
     
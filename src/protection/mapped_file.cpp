@@ -0,0 +1,143 @@
+#include "mapped_file.h"
+
+#include <filesystem>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+std::string_view crlfToLf(std::string_view text, std::string& storage) {
+    size_t pos = text.find("\r\n");
+    if (pos == std::string_view::npos) {
+        return text;
+    }
+    storage.clear();
+    storage.reserve(text.size() - 1);
+    size_t start = 0;
+    do {
+        storage.append(text.data() + start, pos - start);
+        storage += '\n';
+        start = pos + 2;
+        pos = text.find("\r\n", start);
+    } while (pos != std::string_view::npos);
+    storage.append(text.data() + start, text.size() - start);
+    return storage;
+}
+
+std::string_view MappedFile::textView(std::string& storage) const {
+#ifdef _WIN32
+    return crlfToLf(view(), storage);
+#else
+    (void)storage;
+    return view();
+#endif
+}
+
+bool isSameFile(const std::string& a, const std::string& b) {
+    std::error_code ec;
+    return std::filesystem::equivalent(a, b, ec) && !ec;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    fileHandle = file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || uint64_t(fileSize.QuadPart) > SIZE_MAX) {
+        close();
+        return false;
+    }
+    length = size_t(fileSize.QuadPart);
+    if (length == 0) {
+        return true; // empty files cannot be mapped
+    }
+
+    mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle == nullptr) {
+        close();
+        return false;
+    }
+    mapped = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (mapped == nullptr) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapped != nullptr) {
+        UnmapViewOfFile(mapped);
+    }
+    if (mappingHandle != nullptr) {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle != nullptr) {
+        CloseHandle(fileHandle);
+    }
+    mapped = nullptr;
+    length = 0;
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close();
+        return false;
+    }
+    length = size_t(st.st_size);
+    if (length == 0) {
+        return true; // empty files cannot be mapped
+    }
+
+    void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        close();
+        return false;
+    }
+    madvise(p, length, MADV_SEQUENTIAL);
+    mapped = static_cast<const uint8_t*>(p);
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapped != nullptr) {
+        munmap(const_cast<uint8_t*>(mapped), length);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    mapped = nullptr;
+    length = 0;
+    fd = -1;
+}
+
+#endif
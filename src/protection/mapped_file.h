@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole file. The contents are paged in by the
+// OS on access instead of being copied into a heap buffer; the view stays
+// valid until close() or destruction. Empty files open fine with size() 0.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    const uint8_t* data() const { return mapped; }
+    size_t size() const { return length; }
+    std::string_view view() const {
+        return std::string_view(reinterpret_cast<const char*>(mapped), length);
+    }
+    // The contents as a text-mode std::ifstream reads them: on Windows each
+    // "\r\n" becomes "\n". This is view() itself if nothing changes,
+    // otherwise the converted text is kept in storage.
+    std::string_view textView(std::string& storage) const;
+
+private:
+    const uint8_t* mapped = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// text with each "\r\n" replaced by "\n"; text itself if it has none
+std::string_view crlfToLf(std::string_view text, std::string& storage);
+
+// True if both paths name the same existing file (also through links).
+// A file must not be written while it is mapped: protecting in place has
+// to release or copy the input first.
+bool isSameFile(const std::string& a, const std::string& b);
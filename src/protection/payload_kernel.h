@@ -0,0 +1,116 @@
+// Encryption of the payload of the LLVM loader.
+//
+// This file is compiled into the application and its tests, and its text is
+// also embedded verbatim into every generated loader.cpp (see
+// payload_kernel_source.h.in), so it must stay self-contained. It uses an
+// include guard because #pragma once warns in a main file.
+//
+// The key for byte i is keys[i % NumKeys] ^ (i & 0xFF). With NumKeys dividing
+// 256 that repeats every 256 bytes, so decryptPayload() expands it into one pad
+// and XORs the payload with it 32 or 16 bytes at a time. Block offsets stay
+// multiples of the vector width, so a load from the pad never crosses its end.
+
+#ifndef SPECTREGUARD_PAYLOAD_KERNEL_H
+#define SPECTREGUARD_PAYLOAD_KERNEL_H
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PAYLOAD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PAYLOAD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define PAYLOAD_TARGET(isa)
+#endif
+
+template <unsigned int NumKeys>
+inline void buildPayloadPad(const unsigned char (&keys)[NumKeys], unsigned char* pad) {
+    static_assert(256 % NumKeys == 0, "the key stream repeats every 256 bytes only if the key count divides 256");
+    for (unsigned int i = 0; i < 256; i++) {
+        pad[i] = (unsigned char)(keys[i % NumKeys] ^ i);
+    }
+}
+
+// Reference implementation, used by the encoder
+template <unsigned int NumKeys>
+inline void encryptPayload(const unsigned char* in, unsigned char* out, unsigned int size,
+                           const unsigned char (&keys)[NumKeys]) {
+    for (unsigned int i = 0; i < size; i++) {
+        out[i] = (unsigned char)(in[i] ^ keys[i % NumKeys] ^ (i & 0xFF));
+    }
+}
+
+inline void decryptPayloadScalar(const unsigned char* in, unsigned char* out,
+                                 unsigned int begin, unsigned int end, const unsigned char* pad) {
+    for (unsigned int i = begin; i < end; i++) {
+        out[i] = in[i] ^ pad[i & 0xFF];
+    }
+}
+
+#ifdef PAYLOAD_X86
+// Both return the number of bytes done, a multiple of the vector width
+PAYLOAD_TARGET("sse2")
+inline unsigned int decryptPayloadSse2(const unsigned char* in, unsigned char* out,
+                                       unsigned int size, const unsigned char* pad) {
+    unsigned int i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i k = _mm_loadu_si128((const __m128i*)(pad + (i & 0xFF)));
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_xor_si128(v, k));
+    }
+    return i;
+}
+
+PAYLOAD_TARGET("avx2")
+inline unsigned int decryptPayloadAvx2(const unsigned char* in, unsigned char* out,
+                                       unsigned int size, const unsigned char* pad) {
+    unsigned int i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i k = _mm256_loadu_si256((const __m256i*)(pad + (i & 0xFF)));
+        __m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_xor_si256(v, k));
+    }
+    return i;
+}
+
+#ifdef _MSC_VER
+#define PAYLOAD_CPUID(leaf, r) __cpuidex((int*)(r), leaf, 0)
+#else
+#define PAYLOAD_CPUID(leaf, r) __cpuid_count(leaf, 0, (r)[0], (r)[1], (r)[2], (r)[3])
+#endif
+
+PAYLOAD_TARGET("xsave")
+inline bool cpuHasAvx2() {
+    unsigned int regs[4]; // eax, ebx, ecx, edx
+    PAYLOAD_CPUID(0, regs);
+    if (regs[0] < 7) return false;
+    // AVX state must be enabled by the OS as well as supported by the CPU
+    PAYLOAD_CPUID(1, regs);
+    if ((regs[2] & (1u << 27)) == 0 || (regs[2] & (1u << 28)) == 0) return false;
+    if ((_xgetbv(0) & 6) != 6) return false;
+    PAYLOAD_CPUID(7, regs);
+    return (regs[1] & (1u << 5)) != 0;
+}
+#endif
+
+template <unsigned int NumKeys>
+inline void decryptPayload(const unsigned char* in, unsigned char* out, unsigned int size,
+                           const unsigned char (&keys)[NumKeys]) {
+    unsigned char pad[256];
+    buildPayloadPad(keys, pad);
+
+    unsigned int done = 0;
+#ifdef PAYLOAD_X86
+    done = cpuHasAvx2() ? decryptPayloadAvx2(in, out, size, pad)
+                        : decryptPayloadSse2(in, out, size, pad);
+#endif
+    decryptPayloadScalar(in, out, done, size, pad);
+}
+
+#endif // SPECTREGUARD_PAYLOAD_KERNEL_H
@@ -1,20 +1,28 @@
 #include "source_protection.h"
+#include "aes256.h"
+#include "cpp_tokenizer.h"
+#include "literal_replacer.h"
+#include "mapped_file.h"
+#include "text_sink.h"
 #include <string>
 #include <vector>
 #include <random>
 #include <algorithm>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <set>
-#include <regex>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <fstream>
 #include <sstream>
 #include <cstdint>
+#include <cstring>
 #include <array>
 #include <chrono>
 #include <iomanip>
 #include <Windows.h>
-#include <QProcess>
 #include <QDir>
 #include <QFileInfo>
 #include <QDebug>
@@ -23,14 +31,68 @@
 #include <QTextStream>
 #include <QRandomGenerator>
 
+namespace {
+// Per thread: protection jobs run concurrently on the job queue, and rand()
+// is neither guaranteed to be thread-safe nor independent between jobs
+std::mt19937& randomEngine() {
+    thread_local std::mt19937 gen(std::random_device{}());
+    return gen;
+}
+
+// Uniform in [0, bound)
+int randomBelow(int bound) {
+    return std::uniform_int_distribution<int>(0, bound - 1)(randomEngine());
+}
+} // namespace
+
 std::string SourceProtection::readFile(const std::string& path) {
-    std::ifstream file(path);
-    if (!file.is_open()) {
+    MappedFile file;
+    if (!file.open(path)) {
         return "";
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    std::string text;
+    const std::string_view view = file.textView(text);
+    if (view.data() != text.data()) {
+        text.assign(view);
+    }
+    return text;
+}
+
+bool SourceProtection::runPasses(std::string_view input, const std::string& headers,
+                                 const std::vector<TextPass>& passes, const std::string& outputPath,
+                                 const ProtectionConfig& config) {
+    // At most two intermediate buffers are alive: the input of the running
+    // pass and its output. The last pass writes to the file directly.
+    std::string current;
+    std::string next;
+    std::string_view text = input;
+    for (size_t i = 0; i + 1 < passes.size(); ++i) {
+        if (config.cancelled()) {
+            return false;
+        }
+        next.clear();
+        StringSink sink(next);
+        passes[i](text, sink);
+        current.swap(next);
+        text = current;
+    }
+
+    // The output is only created for the last pass, so a cancelled job
+    // leaves no partial file behind (nor truncates an in-place input)
+    if (config.cancelled()) {
+        return false;
+    }
+    FileSink output(outputPath);
+    if (!output.isOpen()) {
+        return false;
+    }
+    output.write(headers);
+    if (passes.empty()) {
+        output.write(text);
+    } else {
+        passes.back()(text, output);
+    }
+    return output.finish();
 }
 
 namespace _obf_ns {
@@ -161,6 +223,29 @@ namespace _obf_ns {
         sizeof(_obf_junk_generator::_obf_operations[0]);
 }
 
+std::string SourceProtection::ProtectionConfig::cacheKey() const {
+    // The passes are part of this program, so its version is part of the key;
+    // bump the format number when the generated code changes within a version
+    const bool useAes = aesEncryptStrings && !aesStringsToEncrypt.empty();
+    const bool useXor = xorEncryptStrings && !xorStringsToEncrypt.empty();
+    std::ostringstream key;
+    key << "source/2;version=" << SPECTREGUARD_VERSION << ";passes=" << (obfuscateNames ? "names," : "")
+        << (useAes ? "aes," : "") << (useXor ? (xorCompileTimeStrings ? "xor-static" : "xor") : "")
+        << ";names=" << obfuscateNames << ";strings=" << encryptStrings
+        << ";antidebug=" << addAntiDebug << ";junk=" << addJunkCode << ':' << junkCodeAmount
+        << ";split=" << splitCode << ";virtualize=" << useVirtualization
+        << ";xor=" << xorEncryptStrings << ";xor-static=" << xorCompileTimeStrings
+        << ";aes=" << aesEncryptStrings;
+    // Length-prefixed, so different string lists never serialize the same
+    for (const auto& str : xorStringsToEncrypt) {
+        key << ";x" << str.size() << ':' << str;
+    }
+    for (const auto& str : aesStringsToEncrypt) {
+        key << ";a" << str.size() << ':' << str;
+    }
+    return key.str();
+}
+
 bool SourceProtection::protect(const std::string& sourcePath, const std::string& outputPath, const ProtectionConfig& config) {
     try {
         // Initial progress update
@@ -168,8 +253,26 @@ bool SourceProtection::protect(const std::string& sourcePath, const std::string&
             config.progressCallback(10, "Reading source file...");
         }
         
-        // Read source file
-        std::string sourceCode = readFile(sourcePath);
+        // Map the source file; the first pass reads straight from the mapping
+        // unless newlines have to be converted (see MappedFile::textView)
+        MappedFile input;
+        if (!input.open(sourcePath)) {
+            if (config.progressCallback) {
+                config.progressCallback(0, "Error: Cannot open source file");
+            }
+            return false;
+        }
+        std::string sourceCopy;
+        std::string_view sourceCode = input.textView(sourceCopy);
+        if (isSameFile(sourcePath, outputPath)) {
+            // Protecting in place: the output file is truncated before the
+            // passes read the input, so they run on a copy instead
+            if (sourceCode.data() != sourceCopy.data()) {
+                sourceCopy.assign(sourceCode);
+            }
+            input.close();
+            sourceCode = sourceCopy;
+        }
         if (sourceCode.empty()) {
             if (config.progressCallback) {
                 config.progressCallback(0, "Error: Source file is empty");
@@ -181,6 +284,8 @@ bool SourceProtection::protect(const std::string& sourcePath, const std::string&
         bool useAesEncryption = config.aesEncryptStrings && !config.aesStringsToEncrypt.empty();
         bool useXorEncryption = config.xorEncryptStrings && !config.xorStringsToEncrypt.empty();
 
+        Aes256::Key aesKey{};
+        QString keyFilePath;
         if (useAesEncryption) {
             // Determine directory of the final protected file
             QFileInfo outInfo(QString::fromStdString(outputPath));
@@ -191,13 +296,14 @@ bool SourceProtection::protect(const std::string& sourcePath, const std::string&
             keyBytes.resize(32);
             for (int i = 0; i < 32; ++i) {
                 keyBytes[i] = static_cast<char>(QRandomGenerator::global()->generate() & 0xFF);
+                aesKey[i] = static_cast<uint8_t>(keyBytes[i]);
             }
             QString keyHexStr = QString::fromLatin1(keyBytes.toHex());
 
             // Name key file with timestamp to avoid collisions
-            QString timeStamp = QDateTime::currentDateTime().toString("yyyyMMdd_HHmmss");
+            QString timeStamp = QDateTime::currentDateTime().toString("yyyyMMdd_HHmmss_zzz");
             QString keyFileName = QString("aes_key_%1.txt").arg(timeStamp);
-            QString keyFilePath = QDir(outputDirPath).filePath(keyFileName);
+            keyFilePath = QDir(outputDirPath).filePath(keyFileName);
 
             // Write key to file
             QFile keyFile(keyFilePath);
@@ -216,12 +322,19 @@ bool SourceProtection::protect(const std::string& sourcePath, const std::string&
         }
         // End of AES key generation block
 
+        // The passes run in order over the previous pass' output, the last one
+        // streams into the output file; headers are written ahead of the body
+        std::vector<TextPass> passes;
+        std::string headers;
+
         // Apply obfuscation first
         if (config.obfuscateNames) {
-            if (config.progressCallback) {
-                config.progressCallback(20, "Applying identifier obfuscation...");
-            }
-            sourceCode = obfuscateIdentifiers(sourceCode, config.progressCallback);
+            passes.push_back([&config](std::string_view text, TextSink& output) {
+                if (config.progressCallback) {
+                    config.progressCallback(20, "Applying identifier obfuscation...");
+                }
+                obfuscateIdentifiers(text, output, config.progressCallback);
+            });
         } else if (config.progressCallback) {
             config.progressCallback(50, "Skipping identifier obfuscation...");
         }
@@ -229,89 +342,50 @@ bool SourceProtection::protect(const std::string& sourcePath, const std::string&
         // Apply string encryption after obfuscation
         if (useAesEncryption && !config.aesStringsToEncrypt.empty()) {
             if (config.progressCallback) {
-                config.progressCallback(60, "Applying string encryption...");
+                config.progressCallback(16, "Encrypting strings using AES...");
             }
             
+            // All strings are encrypted in-process with the key generated above
+            // and replaced in one pass
+            const Aes256 aes(aesKey);
+            std::map<std::string, std::string> aesReplacements;
+
             // Process only the strings that were selected for encryption
             for (const auto& str : config.aesStringsToEncrypt) {
                 // Skip empty strings
                 if (str.empty()) continue;
                 
-                // Use QProcess to run AES encryptor
-                QProcess process;
-                process.setProcessChannelMode(QProcess::MergedChannels);
-                
-                // Convert relative path to absolute
-                QString aesPath = QDir::current().absoluteFilePath("tools/aes/aes_encrypt_single.exe");
-                qDebug() << "Using AES path:" << aesPath;
-                
-                // Check if AES executable exists
-                if (!QFileInfo::exists(aesPath)) {
-                    qWarning() << "AES executable not found at:" << aesPath;
-                    if (config.progressCallback) {
-                        config.progressCallback(0, "Error: AES executable not found at " + aesPath.toStdString());
-                    }
-                    continue;
-                }
-                
-                // Prepare arguments
-                QStringList arguments;
-                arguments << QString::fromStdString(str);
-                
-                qDebug() << "Running AES command:" << aesPath << arguments.join(" ");
-                if (config.progressCallback) {
-                    config.progressCallback(65, "Encrypting string: " + str);
-                }
-                
-                // Start process
-                process.start(aesPath, arguments);
-                
-                if (!process.waitForStarted(10000)) {
-                    qWarning() << "Failed to start AES process:" << process.errorString();
-                    if (config.progressCallback) {
-                        config.progressCallback(0, "Error: Failed to start AES process - " + process.errorString().toStdString());
-                    }
-                    continue;
-                }
-                
-                // Wait for completion
-                if (!process.waitForFinished(120000)) {
-                    qWarning() << "AES process timed out after 2 minutes";
-                    process.kill();
-                    if (config.progressCallback) {
-                        config.progressCallback(0, "Error: AES process timed out");
-                    }
-                    continue;
-                }
-                
-                // Read output
-                QString encrypted = QString::fromLocal8Bit(process.readAll()).trimmed();
-                qDebug() << "Encrypted string:" << encrypted;
-                
-                if (encrypted.isEmpty()) {
-                    qWarning() << "Got empty encrypted string for input:" << str;
-                    if (config.progressCallback) {
-                        config.progressCallback(0, "Error: Got empty encrypted string");
-                    }
-                    continue;
-                }
-                
+                quint32 ivWords[4];
+                QRandomGenerator::global()->fillRange(ivWords);
+                Aes256::Block iv;
+                static_assert(sizeof(ivWords) == sizeof(iv), "IV size");
+                memcpy(iv.data(), ivWords, iv.size());
+                const std::string encrypted = aes.encryptToHex(iv, str);
+
                 // Replace the original string with the encrypted one
-                std::string pattern = "\"" + str + "\"";
-                std::string replacement = "\"" + encrypted.toStdString() + "\"";
-                sourceCode = std::regex_replace(sourceCode, std::regex(pattern), replacement);
-                
+                aesReplacements["\"" + str + "\""] = "_obf_ns::_obf_aes_decryptor::decrypt(\"" + encrypted + "\")";
+            }
+
+            if (config.progressCallback) {
+                config.progressCallback(17, "Encrypted " + std::to_string(aesReplacements.size()) + " strings");
+            }
+
+            auto replacer = std::make_shared<const LiteralReplacer>(aesReplacements);
+            passes.push_back([replacer, &config](std::string_view text, TextSink& output) {
                 if (config.progressCallback) {
-                    config.progressCallback(70, "Successfully encrypted string: " + str);
+                    config.progressCallback(60, "Applying string encryption...");
                 }
+                replacer->replaceAll(text, output);
+            });
+
+            // Decryption stub for the generated key (only added once)
+            if (sourceCode.find("class _obf_aes_decryptor") == std::string::npos) {
+                headers = Aes256::decryptorStub(aesKey) + headers;
             }
         }
 
         // Apply XOR string encryption after AES (if requested)
         if (useXorEncryption && !config.xorStringsToEncrypt.empty()) {
-            if (config.progressCallback) {
-                config.progressCallback(75, "Applying XOR string encryption...");
-            }
 
             // String decryption stub (only added once)
             const std::string xorHeader = R"(
@@ -352,54 +426,63 @@ namespace _obf_ns {
 )";
 
             // Insert header only once
-            if (sourceCode.find("_obf_string_decryptor") == std::string::npos) {
-                sourceCode = xorHeader + sourceCode;
+            if (config.xorCompileTimeStrings) {
+                if (sourceCode.find("class _obf_static_string") == std::string::npos) {
+                    headers = generateCompileTimeStringStub() + headers;
+                }
+            } else if (sourceCode.find("_obf_string_decryptor") == std::string::npos) {
+                headers = xorHeader + headers;
             }
 
             if (config.progressCallback) {
-                config.progressCallback(78, "Encrypting selected strings using XOR...");
+                config.progressCallback(18, "Encrypting selected strings using XOR...");
             }
 
-            std::map<std::string, std::string> encryptedStrings;
+            std::map<std::string, std::string> replacements;
             for (const auto& str : config.xorStringsToEncrypt) {
                 if (str.empty()) continue;
 
-                unsigned char key = static_cast<unsigned char>(rand() % 256);
+                unsigned char key = static_cast<unsigned char>(randomBelow(256));
                 std::string encrypted;
                 encrypted += static_cast<char>(key);
                 for (size_t i = 0; i < str.length(); ++i) {
                     encrypted += static_cast<char>(static_cast<unsigned char>(str[i]) ^ (key + i));
                 }
 
+                if (config.xorCompileTimeStrings) {
+                    replacements["\"" + str + "\""] = compileTimeString(encrypted);
+                    continue;
+                }
+
                 std::stringstream ss;
                 for (unsigned char c : encrypted) {
                     ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(c);
                 }
 
-                encryptedStrings[str] = ss.str();
+                replacements["\"" + str + "\""] = "_obf_ns::_obf_string_decryptor::decrypt(\"" + ss.str() + "\")";
             }
 
-            if (config.progressCallback) {
-                config.progressCallback(82, "Replacing strings in source code...");
-            }
-
-            for (const auto& pair : encryptedStrings) {
-                std::string pattern = "\"" + pair.first + "\"";
-                std::string replacement = "_obf_ns::_obf_string_decryptor::decrypt(\"" + pair.second + "\")";
-                sourceCode = std::regex_replace(sourceCode, std::regex(pattern), replacement);
-            }
+            auto replacer = std::make_shared<const LiteralReplacer>(replacements);
+            passes.push_back([replacer, &config](std::string_view text, TextSink& output) {
+                if (config.progressCallback) {
+                    config.progressCallback(75, "Applying XOR string encryption...");
+                }
+                replacer->replaceAll(text, output);
+            });
         } else if (!useAesEncryption && config.progressCallback) {
             // Only skip message if neither AES nor XOR was applied
             config.progressCallback(80, "Skipping string encryption...");
         }
 
-        // Update progress before writing
-        if (config.progressCallback) {
-            config.progressCallback(90, "Writing protected source code to file...");
+        // Run the passes; the protected code is written while the last one runs
+        bool result = runPasses(sourceCode, headers, passes, outputPath, config);
+        if (!result && config.cancelled()) {
+            // The key belongs to an output that was never written
+            if (!keyFilePath.isEmpty()) {
+                QFile::remove(keyFilePath);
+            }
+            return false;
         }
-
-        // Write the protected code to output file
-        bool result = writeFile(outputPath, sourceCode);
         
         // Final progress update
         if (config.progressCallback) {
@@ -420,14 +503,12 @@ namespace _obf_ns {
     }
 }
 
-std::string SourceProtection::obfuscateIdentifiers(const std::string& sourceCode, const ProgressCallback& callback) {
+void SourceProtection::obfuscateIdentifiers(std::string_view sourceCode, TextSink& output, const ProgressCallback& callback) {
     // Update progress at the start
     if (callback) {
         callback(25, "Starting identifier obfuscation...");
     }
     
-    std::string result = sourceCode;
-    
     // Set of C++ keywords and standard library identifiers that should not be obfuscated
     static const std::set<std::string> reservedKeywords = {
         "int", "char", "bool", "void", "float", "double", "long", "short",
@@ -487,41 +568,87 @@ namespace {
 }
 )";
 
-    // Pattern to match function declarations and definitions
-    std::regex functionPattern(R"((\b(?:void|int|bool|string|double|float|char|long|short|unsigned|signed|const|static|virtual|inline|explicit|friend|template|typename|class|struct|union|enum|typedef|using|namespace|operator|auto|decltype|std::\w+)\s+)([a-zA-Z_]\w*)\s*\([^)]*\)\s*(?:const\s*)?(?:override\s*)?(?:noexcept\s*)?(?:=\s*0\s*)?(?:;|\{))");
+    // Words which may directly precede a function name in a declaration or
+    // definition, e.g. "int foo(...) {" or "static bar(...);"; "std::xxx" too
+    static const std::unordered_set<std::string_view> declarationPrefixes = {
+        "void", "int", "bool", "string", "double", "float", "char", "long", "short",
+        "unsigned", "signed", "const", "static", "virtual", "inline", "explicit",
+        "friend", "template", "typename", "class", "struct", "union", "enum",
+        "typedef", "using", "namespace", "operator", "auto", "decltype"
+    };
+
+    using Kind = CppTokenizer::Kind;
+    const std::string_view source = sourceCode;
+    const std::vector<CppTokenizer::Token> tokens = CppTokenizer::tokenize(source);
+    auto text = [&](size_t i) { return CppTokenizer::text(source, tokens[i]); };
+    auto isPunct = [&](size_t i, std::string_view p) {
+        return i < tokens.size() && tokens[i].kind == Kind::Punctuation && text(i) == p;
+    };
+    auto isWord = [&](size_t i, std::string_view w) {
+        return i < tokens.size() && tokens[i].kind == Kind::Identifier && text(i) == w;
+    };
+    // Next token which is not whitespace or a comment
+    auto next = [&](size_t i) {
+        while (++i < tokens.size() && CppTokenizer::isTrivia(tokens[i])) {
+        }
+        return i;
+    };
+
+    // If a function name declared by the prefix word at i follows, return its index
+    auto declaredFunctionAt = [&](size_t i) -> size_t {
+        if (tokens[i].kind != Kind::Identifier) {
+            return 0;
+        }
+        const bool qualifiedStd = i >= 2 && isPunct(i - 1, "::") && isWord(i - 2, "std");
+        if (!qualifiedStd && declarationPrefixes.count(text(i)) == 0) {
+            return 0;
+        }
+        // prefix, whitespace, name
+        if (i + 2 >= tokens.size() || tokens[i + 1].kind != Kind::Whitespace ||
+            tokens[i + 2].kind != Kind::Identifier) {
+            return 0;
+        }
+        const size_t name = i + 2;
+        size_t j = name + 1;
+        if (j < tokens.size() && tokens[j].kind == Kind::Whitespace) {
+            ++j;
+        }
+        if (!isPunct(j, "(")) {
+            return 0;
+        }
+        // Parameter list up to the first ')'
+        while (++j < tokens.size() && !isPunct(j, ")")) {
+        }
+        j = next(j);
+        if (isWord(j, "const")) j = next(j);
+        if (isWord(j, "override")) j = next(j);
+        if (isWord(j, "noexcept")) j = next(j);
+        if (isPunct(j, "=") && next(j) < tokens.size() && text(next(j)) == "0") j = next(next(j));
+        return (isPunct(j, ";") || isPunct(j, "{")) ? name : 0;
+    };
 
-    // Collect function names and generate safe obfuscated names
-    std::map<std::string, std::string> identifierMap;
-    std::string::const_iterator searchStart(result.cbegin());
-    std::smatch match;
-    
     // First pass: collect function names only, no variables
-    while (std::regex_search(searchStart, result.cend(), match, functionPattern)) {
-        std::string functionName = match[2].str();
-        
+    std::unordered_map<std::string_view, std::string> identifierMap;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        const size_t name = declaredFunctionAt(i);
+        if (name == 0) {
+            continue;
+        }
+        const std::string_view functionName = text(name);
+
         // Skip if it's a reserved keyword, main function, or already obfuscated
-        if (reservedKeywords.find(functionName) != reservedKeywords.end() ||
+        if (reservedKeywords.count(std::string(functionName)) != 0 ||
             functionName == "main" ||  // Always preserve main
-            functionName.find("_obf_") == 0) {
-            searchStart = match.suffix().first;
+            functionName.substr(0, 5) == "_obf_") {
             continue;
         }
 
         // Generate new obfuscated name if not already mapped
         if (identifierMap.find(functionName) == identifierMap.end()) {
-            std::string newName = "_obf_func_" + generateRandomName(6);
-            identifierMap[functionName] = newName;
+            identifierMap.emplace(functionName, "_obf_func_" + generateRandomName(6));
         }
-        
-        searchStart = match.suffix().first;
     }
 
-    // Replace function names
-    for (const auto& pair : identifierMap) {
-        // Only replace complete identifiers (with word boundaries)
-        std::string pattern = "\\b" + pair.first + "\\b";
-        result = std::regex_replace(result, std::regex(pattern), pair.second);
-    }
     
     // List of safe junk code chunks that can be inserted without breaking functionality
     std::vector<std::string> junkCodeBlocks = {
@@ -542,18 +669,17 @@ namespace {
         "    { volatile int _obf_enc = _OBF_RANDOM ^ 0xFF; (void)_obf_enc; }\n"
     };
     
-    // Process the code line by line to add junk code and comments
-    std::stringstream finalCode;
-    finalCode << obfuscationHeader;
-    std::istringstream iss(result);
-    std::string line;
-    int lineCount = 0;
+    // Second pass: rename identifier tokens (strings and comments stay as
+    // they are) and add junk code line by line while streaming to the output
+    output.write(obfuscationHeader);
     int braceCount = 0;
     bool inFunction = false;
-    
-    while (std::getline(iss, line)) {
-        lineCount++;
-        
+    auto writeJunk = [&](int count) {
+        for (int i = 0; i < count; i++) {
+            output.write(junkCodeBlocks[randomBelow(int(junkCodeBlocks.size()))]);
+        }
+    };
+    auto processLine = [&](std::string_view line) {
         // Count braces to detect function bodies
         for (char c : line) {
             if (c == '{') braceCount++;
@@ -561,45 +687,66 @@ namespace {
         }
         
         // Detect function start
-        if (line.find('{') != std::string::npos && !inFunction && braceCount > 0) {
+        if (line.find('{') != std::string_view::npos && !inFunction && braceCount > 0) {
             inFunction = true;
-            finalCode << line << "\n";
+            output.write(line);
+            output.write("\n");
             
             // Insert junk code at function start (3-5 junk lines)
-            int junkLines = 3 + (rand() % 3);
-            for (int i = 0; i < junkLines; i++) {
-                finalCode << junkCodeBlocks[rand() % junkCodeBlocks.size()];
-            }
-            continue;
+            writeJunk(3 + randomBelow(3));
+            return;
         }
         
         // Detect function end
-        if (line.find('}') != std::string::npos && inFunction && braceCount <= 0) {
+        if (line.find('}') != std::string_view::npos && inFunction && braceCount <= 0) {
             inFunction = false;
             
             // Insert junk code before function end (1-2 junk lines)
-            int junkLines = 1 + (rand() % 2);
-            for (int i = 0; i < junkLines; i++) {
-                finalCode << junkCodeBlocks[rand() % junkCodeBlocks.size()];
-            }
-            finalCode << line << "\n";
-            continue;
+            writeJunk(1 + randomBelow(2));
+            output.write(line);
+            output.write("\n");
+            return;
         }
         
-        finalCode << line << "\n";
+        output.write(line);
+        output.write("\n");
         
         // Add junk code inside function body randomly (~10% chance per line)
-        if (inFunction && braceCount > 0 && (rand() % 10 == 0)) {
-            finalCode << junkCodeBlocks[rand() % junkCodeBlocks.size()];
+        if (inFunction && braceCount > 0 && randomBelow(10) == 0) {
+            writeJunk(1);
+        }
+    };
+
+    // Only the current line is buffered; tokens may span several lines
+    std::string line;
+    auto appendText = [&](std::string_view chunk) {
+        for (size_t newline; (newline = chunk.find('\n')) != std::string_view::npos;) {
+            line.append(chunk.data(), newline);
+            processLine(line);
+            line.clear();
+            chunk.remove_prefix(newline + 1);
         }
+        line.append(chunk.data(), chunk.size());
+    };
+    for (const CppTokenizer::Token& token : tokens) {
+        const std::string_view tokenText = CppTokenizer::text(source, token);
+        if (token.kind == Kind::Identifier && !identifierMap.empty()) {
+            auto it = identifierMap.find(tokenText);
+            if (it != identifierMap.end()) {
+                appendText(it->second);
+                continue;
+            }
+        }
+        appendText(tokenText);
+    }
+    if (!line.empty()) {
+        processLine(line);
     }
 
     // Update progress
     if (callback) {
         callback(50, "Code obfuscated successfully with advanced techniques");
     }
-
-    return finalCode.str();
 }
 
 std::string SourceProtection::addJunkCode(const std::string& sourceCode, int amount, const ProgressCallback& callback) {
@@ -626,17 +773,60 @@ std::string SourceProtection::generateRandomName(int length) {
     std::string result;
     result.reserve(length);
     
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> dis(0, sizeof(charset) - 2);
-    
     for (int i = 0; i < length; ++i) {
-        result += charset[dis(gen)];
+        result += charset[randomBelow(int(sizeof(charset) - 1))];
     }
     
     return result;
 }
 
+std::string SourceProtection::generateCompileTimeStringStub() {
+    return R"(
+#include <cstddef>
+
+namespace _obf_ns {
+    // Ciphertext is a constexpr byte array in the template arguments; the
+    // plaintext is decrypted into static storage on first use (thread-safe
+    // static initialization) and every later call returns the same buffer.
+    template <unsigned char Key, unsigned char... Cipher>
+    class _obf_static_string {
+        static constexpr unsigned char _cipher[sizeof...(Cipher)] = {Cipher...};
+        struct _plain {
+            char text[sizeof...(Cipher) + 1];
+            _plain() : text{} {
+                for (std::size_t i = 0; i < sizeof...(Cipher); ++i) {
+                    text[i] = static_cast<char>(_cipher[i] ^ static_cast<unsigned char>(Key + i));
+                }
+            }
+        };
+    public:
+        static const char* get() {
+            static const _plain plain;
+            return plain.text;
+        }
+    };
+}
+)";
+}
+
+std::string SourceProtection::compileTimeString(const std::string& encrypted) {
+    static const char digits[] = "0123456789abcdef";
+
+    std::string result = "_obf_ns::_obf_static_string<";
+    result.reserve(result.size() + encrypted.size() * 6 + 8);
+    for (size_t i = 0; i < encrypted.size(); ++i) {
+        const unsigned char c = static_cast<unsigned char>(encrypted[i]);
+        if (i > 0) {
+            result += ", ";
+        }
+        result += "0x";
+        result += digits[c >> 4];
+        result += digits[c & 0x0F];
+    }
+    result += ">::get()";
+    return result;
+}
+
 bool SourceProtection::protectSourceCode(const std::string& sourceCode, const std::string& outputPath, const ProtectionConfig& config) {
     try {
         std::string processedCode = sourceCode;
@@ -646,7 +836,10 @@ bool SourceProtection::protectSourceCode(const std::string& sourceCode, const st
             if (config.progressCallback) {
                 config.progressCallback(20, "Applying identifier obfuscation...");
             }
-            processedCode = obfuscateIdentifiers(processedCode, config.progressCallback);
+            std::string obfuscated;
+            StringSink sink(obfuscated);
+            obfuscateIdentifiers(processedCode, sink, config.progressCallback);
+            processedCode.swap(obfuscated);
         } else if (config.progressCallback) {
             config.progressCallback(50, "Skipping identifier obfuscation...");
         }
@@ -707,28 +900,36 @@ namespace _obf_ns {
     };
 }
 )";
-            processedCode = encryptionHeader + processedCode;
+            if (config.xorCompileTimeStrings) {
+                processedCode = generateCompileTimeStringStub() + processedCode;
+            } else {
+                processedCode = encryptionHeader + processedCode;
+            }
             if (config.progressCallback) {
                 config.progressCallback(70, "Generating encrypted strings...");
             }
-            // Create a map of original strings to their encrypted versions
+            // Create a map of original strings to their decrypting expressions
             std::map<std::string, std::string> encryptedStrings;
 
             // Process AES strings if enabled
             if (useAesEncryption) {
                 for (const auto& str : config.aesStringsToEncrypt) {
                     if (str.empty()) continue;
-                    unsigned char key = static_cast<unsigned char>(rand() % 256);
+                    unsigned char key = static_cast<unsigned char>(randomBelow(256));
                     std::string encrypted;
                     encrypted += static_cast<char>(key);
                     for (size_t i = 0; i < str.length(); ++i) {
                         encrypted += static_cast<char>(static_cast<unsigned char>(str[i]) ^ (key + i));
                     }
+                    if (config.xorCompileTimeStrings) {
+                        encryptedStrings[str] = compileTimeString(encrypted);
+                        continue;
+                    }
                     std::stringstream ss;
                     for (unsigned char c : encrypted) {
                         ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(c);
                     }
-                    encryptedStrings[str] = ss.str();
+                    encryptedStrings[str] = "_obf_ns::_obf_string_decryptor::decrypt(\"" + ss.str() + "\")";
                 }
             }
 
@@ -736,28 +937,32 @@ namespace _obf_ns {
             if (useXorEncryption) {
                 for (const auto& str : config.xorStringsToEncrypt) {
                     if (str.empty()) continue;
-                    unsigned char key = static_cast<unsigned char>(rand() % 256);
+                    unsigned char key = static_cast<unsigned char>(randomBelow(256));
                     std::string encrypted;
                     encrypted += static_cast<char>(key);
                     for (size_t i = 0; i < str.length(); ++i) {
                         encrypted += static_cast<char>(static_cast<unsigned char>(str[i]) ^ (key + i));
                     }
+                    if (config.xorCompileTimeStrings) {
+                        encryptedStrings[str] = compileTimeString(encrypted);
+                        continue;
+                    }
                     std::stringstream ss;
                     for (unsigned char c : encrypted) {
                         ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(c);
                     }
-                    encryptedStrings[str] = ss.str();
+                    encryptedStrings[str] = "_obf_ns::_obf_string_decryptor::decrypt(\"" + ss.str() + "\")";
                 }
             }
 
             if (config.progressCallback) {
                 config.progressCallback(80, "Replacing strings in source code...");
             }
+            std::map<std::string, std::string> replacements;
             for (const auto& pair : encryptedStrings) {
-                std::string pattern = "\"" + pair.first + "\"";
-                std::string replacement = "_obf_ns::_obf_string_decryptor::decrypt(\"" + pair.second + "\")";
-                processedCode = std::regex_replace(processedCode, std::regex(pattern), replacement);
+                replacements["\"" + pair.first + "\""] = pair.second;
             }
+            processedCode = LiteralReplacer(replacements).replaceAll(processedCode);
         } else if (config.progressCallback) {
             config.progressCallback(80, "Skipping string encryption...");
         }
@@ -11,11 +11,18 @@
 #include <random>
 #include <memory>
 #include <functional>
+#include <string_view>
+
+class TextSink;
 
 class SourceProtection {
 public:
     // Progress callback type
     using ProgressCallback = std::function<void(int progress, const std::string& status)>;
+    // Returns true once the caller wants the protection to stop
+    using CancelCallback = std::function<bool()>;
+    // A streaming pass: reads all of its input and writes the result to the sink
+    using TextPass = std::function<void(std::string_view input, TextSink& output)>;
 
     struct ProtectionConfig {
         bool obfuscateNames = true;        // Obfuscate names
@@ -28,11 +35,23 @@ public:
         // String encryption options
         bool xorEncryptStrings = false;       // Encrypt strings using XOR
         bool aesEncryptStrings = false;       // Encrypt strings using AES
+        bool xorCompileTimeStrings = false;   // Emit XOR strings as constexpr byte arrays decrypted once
 
         std::vector<std::string> xorStringsToEncrypt; // Strings selected for XOR encryption
         std::vector<std::string> aesStringsToEncrypt; // Strings selected for AES encryption
         
         ProgressCallback progressCallback;  // Progress callback function
+        CancelCallback cancelCallback;      // Polled between passes, may be empty
+
+        bool cancelled() const { return cancelCallback && cancelCallback(); }
+
+        // Options and selected strings the output depends on, for ResultCache
+        std::string cacheKey() const;
+        // Renaming and string encryption draw fresh random names and keys
+        bool isDeterministic() const {
+            return !obfuscateNames && !(xorEncryptStrings && !xorStringsToEncrypt.empty()) &&
+                   !(aesEncryptStrings && !aesStringsToEncrypt.empty());
+        }
     };
 
     static bool protect(const std::string& sourcePath, const std::string& outputPath, const ProtectionConfig& config);
@@ -41,7 +60,7 @@ public:
 
 private:
     // Name obfuscation
-    static std::string obfuscateIdentifiers(const std::string& sourceCode, const ProgressCallback& callback);
+    static void obfuscateIdentifiers(std::string_view sourceCode, TextSink& output, const ProgressCallback& callback);
     static std::string obfuscateLocalVariables(const std::string& sourceCode, const ProgressCallback& callback);
     
     // String encryption
@@ -65,8 +84,15 @@ private:
     static std::vector<uint8_t> encryptData(const std::vector<uint8_t>& data, const std::string& key);
     static std::string generateDecryptionStub(const std::string& key);
     static std::string generateStringEncryptionStub();
+    static std::string generateCompileTimeStringStub();
+    // Key byte followed by ciphertext -> "_obf_ns::_obf_static_string<...>::get()"
+    static std::string compileTimeString(const std::string& encrypted);
 
     // File operations
+    // Returns false without creating the output if cancelled before the last pass
+    static bool runPasses(std::string_view input, const std::string& headers,
+                          const std::vector<TextPass>& passes, const std::string& outputPath,
+                          const ProtectionConfig& config);
     static bool writeFile(const std::string& path, const std::string& content) {
         std::ofstream file(path);
         if (!file.is_open()) {
@@ -0,0 +1,31 @@
+#include "text_sink.h"
+
+namespace {
+constexpr size_t kFileBufferSize = 64 * 1024;
+}
+
+FileSink::FileSink(const std::string& path)
+    : file(path, std::ios::out | std::ios::trunc) {
+    buffer.reserve(kFileBufferSize);
+}
+
+void FileSink::write(std::string_view text) {
+    if (buffer.size() + text.size() > kFileBufferSize) {
+        file.write(buffer.data(), std::streamsize(buffer.size()));
+        buffer.clear();
+        if (text.size() >= kFileBufferSize) {
+            file.write(text.data(), std::streamsize(text.size()));
+            return;
+        }
+    }
+    buffer.append(text.data(), text.size());
+}
+
+bool FileSink::finish() {
+    if (!buffer.empty()) {
+        file.write(buffer.data(), std::streamsize(buffer.size()));
+        buffer.clear();
+    }
+    file.close();
+    return !file.fail();
+}
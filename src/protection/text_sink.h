@@ -0,0 +1,47 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <string_view>
+
+// Destination of a streaming pass. Passes write their output piece by piece
+// instead of returning a new string, so the last pass of a pipeline can write
+// straight to disk.
+class TextSink {
+public:
+    virtual ~TextSink() = default;
+
+    virtual void write(std::string_view text) = 0;
+
+    // Hint: about this many more bytes will be written
+    virtual void reserve(size_t) {}
+};
+
+class StringSink : public TextSink {
+public:
+    explicit StringSink(std::string& str) : target(str) {}
+
+    void write(std::string_view text) override { target.append(text.data(), text.size()); }
+    void reserve(size_t size) override { target.reserve(target.size() + size); }
+
+private:
+    std::string& target;
+};
+
+// Buffered file output. The file is written in text mode, so on Windows each
+// "\n" becomes "\r\n"; together with MappedFile::textView() the line endings
+// of a protected file follow the platform, as with plain std::fstream.
+class FileSink : public TextSink {
+public:
+    explicit FileSink(const std::string& path);
+
+    bool isOpen() const { return file.is_open(); }
+    void write(std::string_view text) override;
+
+    // Flush and close; false if any write failed
+    bool finish();
+
+private:
+    std::ofstream file;
+    std::string buffer;
+};
@@ -1,5 +1,6 @@
 #include "exeprotectionwidget.h"
 #include "../../core/settings.h"
+#include "../../core/resultcache.h"
 #include <QVBoxLayout>
 #include <QGroupBox>
 #include <QCheckBox>
@@ -21,9 +22,12 @@
 #include <QSlider>
 #include <QHBoxLayout>
 #include <QProgressBar>
-#include <QMetaObject>
 
 ExeProtectionWidget::ExeProtectionWidget(QWidget *parent) : QWidget(parent) {
+    jobQueue = new JobQueue(this);
+    connect(jobQueue, &JobQueue::jobProgress, this, &ExeProtectionWidget::onJobProgress);
+    connect(jobQueue, &JobQueue::jobFinished, this, &ExeProtectionWidget::onJobFinished);
+
     setupUI();
 }
 
@@ -46,6 +50,12 @@ void ExeProtectionWidget::setupUI() {
     connect(applyButton, &QPushButton::clicked, this, &ExeProtectionWidget::onApplyProtection);
     mainLayout->addWidget(applyButton);
 
+    // Cancel button for queued and running jobs
+    cancelButton = new QPushButton("Cancel", this);
+    cancelButton->setEnabled(false);
+    connect(cancelButton, &QPushButton::clicked, this, &ExeProtectionWidget::onCancelProtection);
+    mainLayout->addWidget(cancelButton);
+
     mainLayout->addStretch();
 }
 
@@ -114,26 +124,98 @@ void ExeProtectionWidget::onBrowseFile() {
     }
 }
 
-bool ExeProtectionWidget::applyExeProtection(const QString& inputFile, const QString& outputPath) {
+void ExeProtectionWidget::startExeProtection(const QString& inputFile, const QString& outputPath) {
     ExeProtection::ProtectionConfig config;
     
     // Only keep UPX option
     config.useUPX = packExeCheck->isChecked();
-    
-    // Set progress callback
-    config.progressCallback = [this](int progress, const std::string& status) {
-        // Use QMetaObject::invokeMethod to safely update UI from another thread
-        QMetaObject::invokeMethod(this, "updateProgress", 
-                                  Qt::QueuedConnection,
-                                  Q_ARG(int, progress), 
-                                  Q_ARG(QString, QString::fromStdString(status)));
-    };
-    
-    return ExeProtection::protect(
-        inputFile.toStdString(),
-        outputPath.toStdString(),
-        config
-    );
+
+    const std::string input = inputFile.toStdString();
+    const std::string output = outputPath.toStdString();
+
+    // Unchanged inputs reuse the cached result when the protection is
+    // deterministic, unless the cache is turned off in the settings
+    const bool cacheEnabled = Settings::instance().isCacheEnabled();
+    const QString cacheDir = Settings::instance().getCacheDirectory();
+    const qint64 cacheLimit = Settings::instance().getCacheSizeLimit();
+
+    // Runs on the job queue's thread pool; progress is reported through
+    // JobQueue::jobProgress
+    int jobId = jobQueue->submit(QFileInfo(inputFile).fileName(),
+        [config, input, output, cacheEnabled, cacheDir, cacheLimit](const JobQueue::ProgressCallback& progress,
+                                                                    const JobQueue::CancelCallback& isCancelled) mutable {
+            config.progressCallback = progress;
+            config.cancelCallback = isCancelled;
+            if (!cacheEnabled) {
+                return ExeProtection::protect(input, output, config);
+            }
+            ResultCache cache(cacheDir, cacheLimit);
+            return cache.run(input, output, config.cacheKey(), config.isDeterministic(), progress, [&] {
+                return ExeProtection::protect(input, output, config);
+            });
+        });
+
+    JobInfo info;
+    info.inputFile = inputFile;
+    info.outputPath = outputPath;
+    runningJobs.insert(jobId, info);
+    cancelButton->setEnabled(true);
+    updateOverallProgress(QString("Queued %1").arg(QFileInfo(inputFile).fileName()));
+}
+
+void ExeProtectionWidget::updateOverallProgress(const QString& status) {
+    if (runningJobs.isEmpty()) {
+        updateProgress(100, status);
+        return;
+    }
+
+    int total = 0;
+    for (const JobInfo& info : runningJobs) {
+        total += info.progress;
+    }
+    QString text = status;
+    if (runningJobs.size() > 1) {
+        text += QString(" (%1 jobs running)").arg(runningJobs.size());
+    }
+    updateProgress(total / runningJobs.size(), text);
+}
+
+void ExeProtectionWidget::onJobProgress(int jobId, int progress, const QString& status) {
+    auto it = runningJobs.find(jobId);
+    if (it == runningJobs.end()) {
+        return;
+    }
+    it->progress = progress;
+    updateOverallProgress(QFileInfo(it->inputFile).fileName() + ": " + status);
+}
+
+void ExeProtectionWidget::onJobFinished(int jobId, bool success, bool cancelled) {
+    auto it = runningJobs.find(jobId);
+    if (it == runningJobs.end()) {
+        return;
+    }
+    const JobInfo info = it.value();
+    runningJobs.erase(it);
+    cancelButton->setEnabled(!runningJobs.isEmpty());
+
+    const QString fileName = QFileInfo(info.inputFile).fileName();
+    if (cancelled) {
+        qDebug() << "Packing cancelled for file:" << info.inputFile;
+        updateOverallProgress(fileName + ": cancelled");
+    } else if (success) {
+        updateOverallProgress(fileName + ": done");
+        QMessageBox::information(this, "Success", 
+            QString("Packing applied successfully!\nPacked file saved to:\n%1").arg(info.outputPath));
+    } else {
+        updateOverallProgress(fileName + ": failed");
+        QString errorMsg = QString("Failed to apply packing to %1!\n").arg(fileName);
+        errorMsg += "\n\nCheck console output for more details.";
+        QMessageBox::critical(this, "Error", errorMsg);
+    }
+}
+
+void ExeProtectionWidget::onCancelProtection() {
+    jobQueue->cancelAll();
 }
 
 void ExeProtectionWidget::onApplyProtection() {
@@ -142,14 +224,11 @@ void ExeProtectionWidget::onApplyProtection() {
         return;
     }
 
-    // Reset progress bar
-    updateProgress(0, "Starting packing process...");
-    
     QString inputFile = exeFileEdit->text();
     QFileInfo fileInfo(inputFile);
     
     // Create output filename with timestamp
-    QString timestamp = QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss");
+    QString timestamp = QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss_zzz"); // unique for concurrent jobs
     QString outputFileName = fileInfo.baseName() + "_packed_" + timestamp + ".exe";
     
     // Get save path from settings
@@ -164,24 +243,6 @@ void ExeProtectionWidget::onApplyProtection() {
     qDebug() << "Packing options:"
              << "UPX:" << packExeCheck->isChecked();
     
-    // Apply packing - progress updates will be handled by the callback
-    bool success = applyExeProtection(inputFile, outputPath);
-
-    if (success) {
-        QMessageBox::information(this, "Success", 
-            QString("Packing applied successfully!\nPacked file saved to:\n%1").arg(outputPath));
-    } else {
-        // Check if UPX tools exist
-        QString errorMsg = "Failed to apply packing!\n";
-        
-        if (packExeCheck->isChecked()) {
-            QString upxPath = QDir::current().absoluteFilePath("tools/upx/upx.exe");
-            if (!QFileInfo::exists(upxPath)) {
-                errorMsg += "\nUPX executable not found at: " + upxPath;
-            }
-        }
-        
-        errorMsg += "\n\nCheck console output for more details.";
-        QMessageBox::critical(this, "Error", errorMsg);
-    }
+    // Apply packing in the background - results are reported by onJobFinished()
+    startExeProtection(inputFile, outputPath);
 } 
\ No newline at end of file
@@ -2,7 +2,9 @@
 
 #include <QWidget>
 #include <QVBoxLayout>
+#include <QHash>
 #include "../../protection/exe_protection.h"
+#include "../../core/jobqueue.h"
 
 class QLineEdit;
 class QCheckBox;
@@ -21,17 +23,22 @@ private slots:
     void onApplyProtection();
     void onBrowseFile();
     void updateProgress(int value, const QString& status);
+    void onCancelProtection();
+    void onJobProgress(int jobId, int progress, const QString& status);
+    void onJobFinished(int jobId, bool success, bool cancelled);
 
 private:
     void setupUI();
     void createFileSelection();
     void createOptionsGroup();
     void createProgressArea();
-    bool applyExeProtection(const QString& inputFile, const QString& outputPath);
+    void startExeProtection(const QString& inputFile, const QString& outputPath);
+    void updateOverallProgress(const QString& status);
 
     QVBoxLayout *mainLayout;
     QLineEdit *exeFileEdit;
     QPushButton *applyButton;
+    QPushButton *cancelButton;
     
     // Progress bar elements
     QProgressBar *progressBar;
@@ -39,4 +46,13 @@ private:
     
     // Only keep UPX option
     QCheckBox *packExeCheck;
+
+    // Background jobs
+    JobQueue *jobQueue;
+    struct JobInfo {
+        QString inputFile;
+        QString outputPath;
+        int progress = 0;
+    };
+    QHash<int, JobInfo> runningJobs;
 }; 
\ No newline at end of file
@@ -16,6 +16,7 @@ SettingsWidget::SettingsWidget(QWidget *parent)
     QString outputDir = settings.value("output_directory", QDir::homePath() + "/Documents/SpectreGuard").toString();
     outputDirEdit->setText(outputDir);
     updateSubDirs();
+    cacheEnabledCheck->setChecked(Settings::instance().isCacheEnabled());
 }
 
 void SettingsWidget::setupUI()
@@ -53,6 +54,10 @@ void SettingsWidget::setupUI()
     exeProtectionPathLayout->addWidget(exeProtectionPathEdit, 1);
     mainLayout->addLayout(exeProtectionPathLayout);
 
+    // Result cache; turning it off makes every run protect the file again
+    cacheEnabledCheck = new QCheckBox("Reuse cached results for unchanged files");
+    mainLayout->addWidget(cacheEnabledCheck);
+
     // Save changes button
     mainLayout->addSpacing(30);
     saveChangesButton = new QPushButton("Save changes");
@@ -91,5 +96,6 @@ void SettingsWidget::onSaveChanges()
 {
     QString outputDir = outputDirEdit->text();
     Settings::instance().setOutputDirectory(outputDir);
+    Settings::instance().setCacheEnabled(cacheEnabledCheck->isChecked());
     QMessageBox::information(this, "Settings Saved", "Settings saved successfully.");
 } 
\ No newline at end of file
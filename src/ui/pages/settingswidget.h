@@ -7,6 +7,7 @@
 #include <QHBoxLayout>
 #include <QPushButton>
 #include <QLineEdit>
+#include <QCheckBox>
 #include <QFileDialog>
 
 class SettingsWidget : public QWidget {
@@ -26,6 +27,7 @@ private:
     QLineEdit *outputDirEdit;
     QLineEdit *sourceProtectionPathEdit;
     QLineEdit *exeProtectionPathEdit;
+    QCheckBox *cacheEnabledCheck;
     QPushButton *saveChangesButton;
 };
 
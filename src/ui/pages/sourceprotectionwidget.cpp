@@ -1,5 +1,6 @@
 #include "sourceprotectionwidget.h"
 #include "../../core/settings.h"
+#include "../../core/resultcache.h"
 #include <QVBoxLayout>
 #include <QGroupBox>
 #include <QCheckBox>
@@ -18,6 +19,7 @@
 #include <QRegularExpression>
 #include <fstream>
 #include <sstream>
+#include "../../protection/mapped_file.h"
 #include "../../protection/source_protection.h"
 #include <QStandardPaths>
 #include <QFile>
@@ -25,6 +27,10 @@
 #include <QProcess>
 
 SourceProtectionWidget::SourceProtectionWidget(QWidget *parent) : QWidget(parent) {
+    jobQueue = new JobQueue(this);
+    connect(jobQueue, &JobQueue::jobProgress, this, &SourceProtectionWidget::onJobProgress);
+    connect(jobQueue, &JobQueue::jobFinished, this, &SourceProtectionWidget::onJobFinished);
+
     setupUI();
 }
 
@@ -49,10 +55,13 @@ void SourceProtectionWidget::setupUI() {
 
     obfuscateFunctionsCheck = new QCheckBox("Obfuscation", this);
     encryptStringsCheck = new QCheckBox("Obfuscation using XOR encryption", this);
+    compileTimeStringsCheck = new QCheckBox("Decrypt XOR strings once (compile-time stub)", this);
+    compileTimeStringsCheck->setEnabled(false);
     aesEncryptStringsCheck = new QCheckBox("String encryption using AES", this);
     
     optionsLayout->addWidget(obfuscateFunctionsCheck);
     optionsLayout->addWidget(encryptStringsCheck);
+    optionsLayout->addWidget(compileTimeStringsCheck);
     optionsLayout->addWidget(aesEncryptStringsCheck);
     optionsGroup->setLayout(optionsLayout);
     mainLayout->addWidget(optionsGroup);
@@ -62,6 +71,12 @@ void SourceProtectionWidget::setupUI() {
     connect(applyButton, &QPushButton::clicked, this, &SourceProtectionWidget::onApplyProtection);
     mainLayout->addWidget(applyButton);
 
+    // Cancel button for queued and running jobs
+    cancelButton = new QPushButton("Cancel", this);
+    cancelButton->setEnabled(false);
+    connect(cancelButton, &QPushButton::clicked, this, &SourceProtectionWidget::onCancelProtection);
+    mainLayout->addWidget(cancelButton);
+
     mainLayout->addStretch();
 
     // Initially hide string selection
@@ -74,6 +89,7 @@ void SourceProtectionWidget::setupUI() {
     
     // Connect encrypt strings checkbox
     connect(encryptStringsCheck, &QCheckBox::toggled, this, &SourceProtectionWidget::onToggleStringEncryption);
+    connect(encryptStringsCheck, &QCheckBox::toggled, compileTimeStringsCheck, &QCheckBox::setEnabled);
     connect(aesEncryptStringsCheck, &QCheckBox::toggled, this, &SourceProtectionWidget::onToggleAESStringEncryption);
     
     // Log initial message
@@ -161,19 +177,21 @@ void SourceProtectionWidget::createLogGroup() {
 }
 
 void SourceProtectionWidget::extractStringsFromFile(const QString& filePath) {
-    std::ifstream file(filePath.toStdString());
-    if (!file.is_open()) {
+    MappedFile file;
+    if (!file.open(filePath.toStdString())) {
         logMessage("Error: Could not open file for string extraction");
         return;
     }
 
     stringListWidget->clear();
     if (aesStringListWidget) aesStringListWidget->clear();
-    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::string text;
+    const std::string_view view = file.textView(text);
+    const QString content = QString::fromUtf8(view.data(), qsizetype(view.size()));
     
     // Regular expression to match string literals
     QRegularExpression stringRegex("\"([^\"]*)\"");
-    QRegularExpressionMatchIterator it = stringRegex.globalMatch(QString::fromStdString(content));
+    QRegularExpressionMatchIterator it = stringRegex.globalMatch(content);
     
     std::set<QString> uniqueStrings;
     while (it.hasNext()) {
@@ -254,26 +272,60 @@ void SourceProtectionWidget::onApplyProtection() {
         return;
     }
 
-    if (applySourceProtection(inputFile, outputPath)) {
+    // Results are reported by onJobFinished()
+    startSourceProtection(inputFile, outputPath);
+}
+
+void SourceProtectionWidget::onJobProgress(int jobId, int progress, const QString& status) {
+    auto it = runningJobs.find(jobId);
+    if (it == runningJobs.end()) {
+        return;
+    }
+    const QString fileName = QFileInfo(it->inputFile).fileName();
+    updateProgress(progress, status);
+    logMessage(QString("[%1] Progress: %2% - %3").arg(fileName).arg(progress).arg(status));
+}
+
+void SourceProtectionWidget::onJobFinished(int jobId, bool success, bool cancelled) {
+    auto it = runningJobs.find(jobId);
+    if (it == runningJobs.end()) {
+        return;
+    }
+    const JobInfo info = it.value();
+    runningJobs.erase(it);
+    cancelButton->setEnabled(!runningJobs.isEmpty());
+
+    const QString fileName = QFileInfo(info.inputFile).fileName();
+    logMessage(QString("[%1] Protection function returned: %2").arg(fileName)
+               .arg(cancelled ? "cancelled" : success ? "success" : "failure"));
+
+    if (cancelled) {
+        logMessage(QString("[%1] Obfuscation cancelled").arg(fileName));
+    } else if (success) {
         // Verify that the output file was created
-        if (QFile::exists(outputPath)) {
-            QFileInfo outputFileInfo(outputPath);
-            logMessage(QString("Obfuscation completed successfully. Output saved to: %1").arg(outputPath));
+        if (QFile::exists(info.outputPath)) {
+            QFileInfo outputFileInfo(info.outputPath);
+            logMessage(QString("Obfuscation completed successfully. Output saved to: %1").arg(info.outputPath));
             logMessage(QString("File size: %1 bytes").arg(outputFileInfo.size()));
             QMessageBox::information(this, "Success", 
                 QString("File has been successfully obfuscated!\n\nProtected file saved to:\n%1")
-                .arg(outputPath));
+                .arg(info.outputPath));
         } else {
             logMessage("Error: Output file was not created");
             QMessageBox::critical(this, "Error", "Output file was not created!");
         }
     } else {
-        logMessage("Failed to apply obfuscation");
+        logMessage(QString("[%1] Failed to apply obfuscation").arg(fileName));
         QMessageBox::critical(this, "Error", "Failed to obfuscate file!\n\nPlease check the log for details.");
     }
 }
 
-bool SourceProtectionWidget::applySourceProtection(const QString& inputFile, const QString& outputPath) {
+void SourceProtectionWidget::onCancelProtection() {
+    logMessage("Cancelling obfuscation jobs...");
+    jobQueue->cancelAll();
+}
+
+void SourceProtectionWidget::startSourceProtection(const QString& inputFile, const QString& outputPath) {
     logMessage("Starting obfuscation process...");
     
     SourceProtection::ProtectionConfig config;
@@ -283,11 +335,15 @@ bool SourceProtectionWidget::applySourceProtection(const QString& inputFile, con
 
     // Set encryption flags
     config.xorEncryptStrings = encryptStringsCheck->isChecked();
+    config.xorCompileTimeStrings = compileTimeStringsCheck->isChecked();
     config.aesEncryptStrings = aesEncryptStringsCheck->isChecked();
 
     logMessage(QString("Obfuscation options:"));
     logMessage(QString("- Identifier Obfuscation: %1").arg(config.obfuscateNames ? "enabled" : "disabled"));
     logMessage(QString("- XOR String Encryption: %1").arg(config.xorEncryptStrings ? "enabled" : "disabled"));
+    if (config.xorEncryptStrings) {
+        logMessage(QString("- XOR Decryption: %1").arg(config.xorCompileTimeStrings ? "once, compile-time stub" : "per call"));
+    }
     logMessage(QString("- AES String Encryption: %1").arg(config.aesEncryptStrings ? "enabled" : "disabled"));
     
     // Collect selected strings for XOR encryption
@@ -316,17 +372,37 @@ bool SourceProtectionWidget::applySourceProtection(const QString& inputFile, con
         logMessage(QString("Total AES strings to encrypt: %1").arg(config.aesStringsToEncrypt.size()));
     }
 
-    // Set progress callback
-    config.progressCallback = [this](int progress, const std::string& status) {
-        updateProgress(progress, QString::fromStdString(status));
-        logMessage(QString("Progress: %1% - %2").arg(progress).arg(QString::fromStdString(status)));
-    };
+    const std::string input = inputFile.toStdString();
+    const std::string output = outputPath.toStdString();
+
+    // Unchanged inputs reuse the cached result when the protection is
+    // deterministic, unless the cache is turned off in the settings
+    const bool cacheEnabled = Settings::instance().isCacheEnabled();
+    const QString cacheDir = Settings::instance().getCacheDirectory();
+    const qint64 cacheLimit = Settings::instance().getCacheSizeLimit();
 
+    // Runs on the job queue's thread pool; progress is reported through
+    // JobQueue::jobProgress
     logMessage("Calling protection function...");
-    bool result = SourceProtection::protect(inputFile.toStdString(), outputPath.toStdString(), config);
-    logMessage(QString("Protection function returned: %1").arg(result ? "success" : "failure"));
-    
-    return result;
+    int jobId = jobQueue->submit(QFileInfo(inputFile).fileName(),
+        [config, input, output, cacheEnabled, cacheDir, cacheLimit](const JobQueue::ProgressCallback& progress,
+                                                                    const JobQueue::CancelCallback& isCancelled) mutable {
+            config.progressCallback = progress;
+            config.cancelCallback = isCancelled;
+            if (!cacheEnabled) {
+                return SourceProtection::protect(input, output, config);
+            }
+            ResultCache cache(cacheDir, cacheLimit);
+            return cache.run(input, output, config.cacheKey(), config.isDeterministic(), progress, [&] {
+                return SourceProtection::protect(input, output, config);
+            });
+        });
+
+    JobInfo info;
+    info.inputFile = inputFile;
+    info.outputPath = outputPath;
+    runningJobs.insert(jobId, info);
+    cancelButton->setEnabled(true);
 }
 
 void SourceProtectionWidget::logMessage(const QString& message) {
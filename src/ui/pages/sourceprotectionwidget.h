@@ -5,7 +5,9 @@
 #include <QListWidget>
 #include <QTextEdit>
 #include <QProgressBar>
+#include <QHash>
 #include "../../protection/source_protection.h"
+#include "../../core/jobqueue.h"
 
 class QLineEdit;
 class QCheckBox;
@@ -29,6 +31,9 @@ private slots:
     void onToggleAESStringEncryption(bool checked);
     void onSelectAllStringsClicked();
     void onSelectAllAESStringsClicked();
+    void onCancelProtection();
+    void onJobProgress(int jobId, int progress, const QString& status);
+    void onJobFinished(int jobId, bool success, bool cancelled);
 
 private:
     void setupUI();
@@ -36,7 +41,7 @@ private:
     void createStringSelectionGroup();
     void createAESStringSelectionGroup();
     void createLogGroup();
-    bool applySourceProtection(const QString& inputFile, const QString& outputPath);
+    void startSourceProtection(const QString& inputFile, const QString& outputPath);
     void extractStringsFromFile(const QString& filePath);
     void logMessage(const QString& message);
     void updateProgress(int value, const QString& status);
@@ -45,8 +50,10 @@ private:
     QLineEdit *sourceFileEdit;
     QCheckBox *obfuscateFunctionsCheck;
     QCheckBox *encryptStringsCheck;
+    QCheckBox *compileTimeStringsCheck;
     QCheckBox *aesEncryptStringsCheck;
     QPushButton *applyButton;
+    QPushButton *cancelButton;
     QPushButton *extractStringsButton;
     QPushButton *selectAllStringsButton;
     QPushButton *selectAllAESStringsButton;
@@ -60,4 +67,12 @@ private:
     // Log and progress elements
     QTextEdit *logTextEdit;
     QProgressBar *progressBar;
+
+    // Background jobs
+    JobQueue *jobQueue;
+    struct JobInfo {
+        QString inputFile;
+        QString outputPath;
+    };
+    QHash<int, JobInfo> runningJobs;
 }; 
\ No newline at end of file
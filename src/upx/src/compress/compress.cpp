@@ -36,26 +36,36 @@ unsigned upx_adler32(const void *buf, unsigned len, unsigned adler) {
     if (len == 0)
         return adler;
     assert(buf != nullptr);
-#if 1
-    return upx_ucl_adler32(buf, len, adler);
-#else
-    return upx_zlib_adler32(buf, len, adler);
-#endif
+    return upx_simd_adler32(buf, len, adler);
+}
+
+// Combine adler1 == adler32(A) and adler2 == adler32(B) into adler32(A || B),
+// where len2 is the length of B and adler2 was started with the default
+// value 1. Same algorithm as adler32_combine() in zlib.
+unsigned upx_adler32_combine(unsigned adler1, unsigned adler2, unsigned len2) {
+    const unsigned BASE = 65521; // largest prime smaller than 65536
+    const unsigned rem = len2 % BASE;
+    unsigned sum1 = adler1 & 0xffff;
+    unsigned sum2 = (unsigned) (((upx_uint64_t) rem * sum1) % BASE);
+    sum1 += (adler2 & 0xffff) + BASE - 1;
+    sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + BASE - rem;
+    if (sum1 >= BASE)
+        sum1 -= BASE;
+    if (sum1 >= BASE)
+        sum1 -= BASE;
+    if (sum2 >= 2 * BASE)
+        sum2 -= 2 * BASE;
+    if (sum2 >= BASE)
+        sum2 -= BASE;
+    return sum1 | (sum2 << 16);
 }
 
-#if 0 // UNUSED
-unsigned upx_crc32(const void *buf, unsigned len, unsigned crc)
-{
+unsigned upx_crc32(const void *buf, unsigned len, unsigned crc) {
     if (len == 0)
         return crc;
     assert(buf != nullptr);
-#if 1
-    return upx_ucl_crc32(buf, len, crc);
-#else
-    return upx_zlib_crc32(buf, len, crc);
-#endif
+    return upx_simd_crc32(buf, len, crc);
 }
-#endif // UNUSED
 
 /*************************************************************************
 //
@@ -70,6 +80,11 @@ int upx_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, unsigned
     assert(method > 0);
     assert(level > 0);
 
+    // the compressors are C code, so a cancel request can only be honoured
+    // between two calls; see options_t::cancelled
+    if (opt->cancelled && opt->cancelled(opt->cancelled_user))
+        throwCancelled();
+
 #if 1
     // set available bytes in dst
     if (*dst_len == 0)
@@ -205,4 +220,25 @@ int upx_test_overlap(const upx_bytep buf, const upx_bytep tbuf, unsigned src_off
     return r;
 }
 
+/*************************************************************************
+//
+**************************************************************************/
+
+TEST_CASE("upx_adler32_combine") {
+    upx_byte buf[1024];
+    for (unsigned i = 0; i < 1024; i++)
+        buf[i] = (upx_byte) (i * 7 + (i >> 3));
+    const unsigned splits[] = {0, 1, 100, 555, 1023, 1024};
+    for (unsigned split : splits) {
+        unsigned a = upx_adler32(buf, split);
+        unsigned b = upx_adler32(buf + split, 1024 - split);
+        CHECK(upx_adler32_combine(a, b, 1024 - split) == upx_adler32(buf, 1024));
+        // chained from a previous checksum
+        a = upx_adler32(buf, split, 0x12345678 % 65521);
+        CHECK(upx_adler32_combine(a, b, 1024 - split) ==
+              upx_adler32(buf + split, 1024 - split, a));
+    }
+    CHECK(upx_adler32_combine(0x12345678, 1, 0) == 0x12345678);
+}
+
 /* vim:set ts=4 sw=4 et: */
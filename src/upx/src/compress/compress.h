@@ -168,6 +168,11 @@ int upx_zstd_test_overlap  ( const upx_bytep buf,
 #endif
 
 
+// compress_checksum.cpp - runtime-dispatched SIMD kernels with a portable fallback
+unsigned upx_simd_adler32(const void *buf, unsigned len, unsigned adler);
+unsigned upx_simd_crc32  (const void *buf, unsigned len, unsigned crc);
+
+
 #endif /* already included */
 
 /* vim:set ts=4 sw=4 et: */
@@ -0,0 +1,417 @@
+/* compress_checksum.cpp --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2023 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+// SIMD adler32 and crc32 kernels. The best kernel for the running CPU is
+// selected once, on first use; upx_adler32() and upx_crc32() call through it.
+
+#include "../conf.h"
+#include "compress.h"
+
+#if (ACC_ARCH_AMD64 || ACC_ARCH_I386) && (defined(__GNUC__) || defined(_MSC_VER))
+#define WITH_CHECKSUM_SIMD 1
+#else
+#define WITH_CHECKSUM_SIMD 0
+#endif
+
+#if (WITH_CHECKSUM_SIMD)
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define SIMD_TARGET(x) /*empty*/
+#else
+#include <cpuid.h>
+#define SIMD_TARGET(x) __attribute__((__target__(x)))
+#endif
+#endif
+
+/*************************************************************************
+// portable fallback
+**************************************************************************/
+
+static unsigned adler32_portable(const void *buf, unsigned len, unsigned adler) {
+    return upx_ucl_adler32(buf, len, adler);
+}
+
+static unsigned crc32_portable(const void *buf, unsigned len, unsigned crc) {
+    return upx_ucl_crc32(buf, len, crc);
+}
+
+#if (WITH_CHECKSUM_SIMD)
+
+/*************************************************************************
+// cpu features
+**************************************************************************/
+
+namespace {
+struct CpuFeatures {
+    bool ssse3;
+    bool pclmul;
+    bool avx2;
+};
+} // namespace
+
+static void cpuid(unsigned leaf, unsigned subleaf, unsigned r[4]) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuidex(info, (int) leaf, (int) subleaf);
+    for (int i = 0; i < 4; i++)
+        r[i] = (unsigned) info[i];
+#else
+    r[0] = r[1] = r[2] = r[3] = 0;
+    __cpuid_count(leaf, subleaf, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+static upx_uint64_t xgetbv0() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _xgetbv(0);
+#else
+    unsigned lo, hi;
+    __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return lo | ((upx_uint64_t) hi << 32);
+#endif
+}
+
+static CpuFeatures detect_cpu_features() {
+    CpuFeatures f = {};
+    unsigned r[4];
+    cpuid(0, 0, r);
+    const unsigned max_leaf = r[0];
+    if (max_leaf < 1)
+        return f;
+    cpuid(1, 0, r);
+    const unsigned ecx = r[2];
+    const bool sse2 = (r[3] >> 26) & 1;
+    f.ssse3 = sse2 && ((ecx >> 9) & 1);
+    f.pclmul = sse2 && ((ecx >> 1) & 1);
+    // AVX2 also needs the OS to save the ymm registers
+    const bool osxsave = (ecx >> 27) & 1;
+    const bool avx = (ecx >> 28) & 1;
+    if (max_leaf >= 7 && osxsave && avx && (xgetbv0() & 6) == 6) {
+        cpuid(7, 0, r);
+        f.avx2 = (r[1] >> 5) & 1;
+    }
+    return f;
+}
+
+/*************************************************************************
+// adler32 - SSSE3 and AVX2
+//
+// Each 32-byte block adds sum(b[i]) to s1 and sum((32 - i) * b[i]) to s2,
+// plus 32 * s1 from before the block. The per-block s1 values are
+// accumulated in v_ps and folded into s2 once per NMAX chunk.
+**************************************************************************/
+
+#define ADLER_BASE 65521u // largest prime smaller than 65536
+#define ADLER_NMAX 5552u  // largest n such that 255n(n+1)/2 + (n+1)(BASE-1) <= 2^32-1
+
+static forceinline unsigned adler32_tail(const upx_byte *p, unsigned len, unsigned s1,
+                                         unsigned s2) {
+    // len < 32, so this cannot overflow
+    while (len--) {
+        s1 += *p++;
+        s2 += s1;
+    }
+    return (s1 % ADLER_BASE) | ((s2 % ADLER_BASE) << 16);
+}
+
+SIMD_TARGET("sse2")
+static forceinline unsigned hsum_epi32(__m128i x) {
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    return (unsigned) _mm_cvtsi128_si32(x);
+}
+
+SIMD_TARGET("ssse3")
+static unsigned adler32_ssse3(const void *buf, unsigned len, unsigned adler) {
+    const upx_byte *p = (const upx_byte *) buf;
+    unsigned s1 = adler & 0xffff;
+    unsigned s2 = adler >> 16;
+    unsigned blocks = len / 32;
+    len %= 32;
+
+    const __m128i tap1 =
+        _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+    const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+
+    while (blocks != 0) {
+        unsigned n = blocks < ADLER_NMAX / 32 ? blocks : ADLER_NMAX / 32;
+        blocks -= n;
+        __m128i v_ps = _mm_set_epi32(0, 0, 0, (int) (s1 * n));
+        __m128i v_s2 = _mm_set_epi32(0, 0, 0, (int) s2);
+        __m128i v_s1 = zero;
+        do {
+            const __m128i b1 = _mm_loadu_si128((const __m128i *) (const void *) p);
+            const __m128i b2 = _mm_loadu_si128((const __m128i *) (const void *) (p + 16));
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b1, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(b1, tap1), ones));
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b2, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(b2, tap2), ones));
+            p += 32;
+        } while (--n != 0);
+        v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+        s1 = (s1 + hsum_epi32(v_s1)) % ADLER_BASE;
+        s2 = hsum_epi32(v_s2) % ADLER_BASE;
+    }
+    return adler32_tail(p, len, s1, s2);
+}
+
+SIMD_TARGET("avx2")
+static unsigned adler32_avx2(const void *buf, unsigned len, unsigned adler) {
+    const upx_byte *p = (const upx_byte *) buf;
+    unsigned s1 = adler & 0xffff;
+    unsigned s2 = adler >> 16;
+    unsigned blocks = len / 32;
+    len %= 32;
+
+    const __m256i tap = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19,
+                                         18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3,
+                                         2, 1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+
+    while (blocks != 0) {
+        unsigned n = blocks < ADLER_NMAX / 32 ? blocks : ADLER_NMAX / 32;
+        blocks -= n;
+        __m256i v_ps = _mm256_set_epi32(0, 0, 0, 0, 0, 0, 0, (int) (s1 * n));
+        __m256i v_s2 = _mm256_set_epi32(0, 0, 0, 0, 0, 0, 0, (int) s2);
+        __m256i v_s1 = zero;
+        do {
+            const __m256i b = _mm256_loadu_si256((const __m256i *) (const void *) p);
+            v_ps = _mm256_add_epi32(v_ps, v_s1);
+            v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(b, zero));
+            v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(b, tap), ones));
+            p += 32;
+        } while (--n != 0);
+        v_s2 = _mm256_add_epi32(v_s2, _mm256_slli_epi32(v_ps, 5));
+        const __m128i x1 =
+            _mm_add_epi32(_mm256_castsi256_si128(v_s1), _mm256_extracti128_si256(v_s1, 1));
+        const __m128i x2 =
+            _mm_add_epi32(_mm256_castsi256_si128(v_s2), _mm256_extracti128_si256(v_s2, 1));
+        s1 = (s1 + hsum_epi32(x1)) % ADLER_BASE;
+        s2 = hsum_epi32(x2) % ADLER_BASE;
+    }
+    return adler32_tail(p, len, s1, s2);
+}
+
+/*************************************************************************
+// crc32 - PCLMULQDQ folding
+//
+// Folds 64 bytes per iteration into four 128-bit accumulators, then
+// reduces to 32 bits with a Barrett reduction; see Intel's "Fast CRC
+// Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+// The constants are for the reflected zlib polynomial 0xedb88320.
+// NOTE: the SSE4.2 crc32 instruction computes CRC-32C, which is a
+// different polynomial, so it cannot be used here.
+**************************************************************************/
+
+#define CRC32_FOLD_MIN 64
+
+// buf must hold len >= 64 bytes, len must be a multiple of 16;
+// crc is the raw (pre-inverted) register value
+SIMD_TARGET("pclmul,sse2")
+static unsigned crc32_fold_pclmul(const upx_byte *p, unsigned len, unsigned crc) {
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+
+#define LOAD(off) _mm_loadu_si128((const __m128i *) (const void *) (p + (off)))
+#define FOLD(x, k, y)                                                                              \
+    _mm_xor_si128(                                                                                 \
+        _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), y)
+
+    __m128i x1 = _mm_xor_si128(LOAD(0x00), _mm_cvtsi32_si128((int) crc));
+    __m128i x2 = LOAD(0x10);
+    __m128i x3 = LOAD(0x20);
+    __m128i x4 = LOAD(0x30);
+    p += 64;
+    len -= 64;
+
+    // fold 64 bytes at a time
+    while (len >= 64) {
+        x1 = FOLD(x1, k1k2, LOAD(0x00));
+        x2 = FOLD(x2, k1k2, LOAD(0x10));
+        x3 = FOLD(x3, k1k2, LOAD(0x20));
+        x4 = FOLD(x4, k1k2, LOAD(0x30));
+        p += 64;
+        len -= 64;
+    }
+
+    // fold into a single 128-bit value
+    x1 = FOLD(x1, k3k4, x2);
+    x1 = FOLD(x1, k3k4, x3);
+    x1 = FOLD(x1, k3k4, x4);
+
+    // fold the remaining 16-byte blocks
+    while (len >= 16) {
+        x1 = FOLD(x1, k3k4, LOAD(0x00));
+        p += 16;
+        len -= 16;
+    }
+#undef FOLD
+#undef LOAD
+
+    // fold 128 bits to 64 bits
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x0 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x0);
+    x0 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x0);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_and_si128(x1, mask32);
+    x0 = _mm_clmulepi64_si128(x0, poly, 0x10);
+    x0 = _mm_and_si128(x0, mask32);
+    x0 = _mm_clmulepi64_si128(x0, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x0);
+
+    return (unsigned) _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+static unsigned crc32_pclmul(const void *buf, unsigned len, unsigned crc) {
+    const upx_byte *p = (const upx_byte *) buf;
+    if (len >= CRC32_FOLD_MIN) {
+        const unsigned n = len & ~15u;
+        crc = ~crc32_fold_pclmul(p, n, ~crc);
+        p += n;
+        len -= n;
+    }
+    return len ? crc32_portable(p, len, crc) : crc;
+}
+
+#endif // WITH_CHECKSUM_SIMD
+
+/*************************************************************************
+// kernel selection
+**************************************************************************/
+
+namespace {
+struct ChecksumKernels {
+    unsigned (*adler32)(const void *, unsigned, unsigned);
+    unsigned (*crc32)(const void *, unsigned, unsigned);
+};
+} // namespace
+
+static ChecksumKernels select_kernels() {
+    ChecksumKernels k = {adler32_portable, crc32_portable};
+#if (WITH_CHECKSUM_SIMD)
+    const CpuFeatures f = detect_cpu_features();
+    if (f.avx2)
+        k.adler32 = adler32_avx2;
+    else if (f.ssse3)
+        k.adler32 = adler32_ssse3;
+    if (f.pclmul)
+        k.crc32 = crc32_pclmul;
+#endif
+    return k;
+}
+
+static const ChecksumKernels &checksum_kernels() {
+    static const ChecksumKernels kernels = select_kernels();
+    return kernels;
+}
+
+unsigned upx_simd_adler32(const void *buf, unsigned len, unsigned adler) {
+    return checksum_kernels().adler32(buf, len, adler);
+}
+
+unsigned upx_simd_crc32(const void *buf, unsigned len, unsigned crc) {
+    return checksum_kernels().crc32(buf, len, crc);
+}
+
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+#if DEBUG && !defined(DOCTEST_CONFIG_DISABLE) && 1
+
+#include "../util/membuffer.h"
+
+#if (WITH_ZLIB)
+
+// cross-check every kernel this CPU supports against zlib, for lengths
+// around the block and chunk sizes and at several misalignments
+TEST_CASE("upx_simd_adler32 upx_simd_crc32") {
+    // random bytes, followed by a run of 0xff longer than NMAX (the worst case for overflow)
+    const unsigned half = 8192;
+    MemBuffer mb(2 * half + 16);
+    upx_uint32_t seed = 0x12345678;
+    for (unsigned i = 0; i < 2 * half + 16; i++) {
+        seed = seed * 1103515245 + 12345;
+        mb[i] = (upx_byte) (i < half ? seed >> 24 : 0xff);
+    }
+    const unsigned lengths[] = {0,   1,   15,   16,   31,   32,   33,   63,   64,  65,
+                                127, 128, 129,  1000, 5551, 5552, 5553, 5568, 5600, 8191,
+                                half};
+
+    typedef unsigned (*Kernel)(const void *, unsigned, unsigned);
+    Kernel adler_kernels[3] = {adler32_portable, nullptr, nullptr};
+    Kernel crc_kernels[2] = {crc32_portable, nullptr};
+#if (WITH_CHECKSUM_SIMD)
+    const CpuFeatures f = detect_cpu_features();
+    if (f.ssse3)
+        adler_kernels[1] = adler32_ssse3;
+    if (f.avx2)
+        adler_kernels[2] = adler32_avx2;
+    if (f.pclmul)
+        crc_kernels[1] = crc32_pclmul;
+#endif
+
+    const unsigned offsets[] = {0, 5, 10, 15, half, half + 5, half + 10, half + 15};
+    for (unsigned off : offsets) {
+        const upx_byte *p = mb + off;
+        for (unsigned len : lengths) {
+            const unsigned adler_start[2] = {1, 0xfff0fff0};
+            for (unsigned a0 : adler_start) {
+                const unsigned expected = upx_zlib_adler32(p, len, a0);
+                for (Kernel k : adler_kernels)
+                    if (k != nullptr)
+                        CHECK(k(p, len, a0) == expected);
+                CHECK(upx_adler32(p, len, a0) == expected);
+            }
+            const unsigned crc_start[2] = {0, 0xdeadbeef};
+            for (unsigned c0 : crc_start) {
+                const unsigned expected = upx_zlib_crc32(p, len, c0);
+                for (Kernel k : crc_kernels)
+                    if (k != nullptr)
+                        CHECK(k(p, len, c0) == expected);
+                CHECK(upx_crc32(p, len, c0) == expected);
+            }
+        }
+    }
+}
+
+#endif // WITH_ZLIB
+
+#endif // DEBUG
+
+/* vim:set ts=4 sw=4 et: */
@@ -0,0 +1,488 @@
+/* compress_overlap.cpp --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2023 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+#include "../conf.h"
+#include "compress.h"
+#include "../util/membuffer.h"
+#include <vector>
+
+/*************************************************************************
+// upx_find_overlap() - single-pass overlap analysis
+//
+// For in-place decompression the compressed data is stored at the end of
+// the buffer, at src_off = dst_len + overlap_overhead - src_len, and the
+// output is written from the start. This works as long as no write
+// clobbers compressed data that has not been read yet, i.e. as long as
+// "olen <= src_off + ilen" holds after every literal and every match.
+//
+// upx_test_overlap() checks this for one given overlap_overhead, so
+// Packer::findOverlapOverhead() used to decompress once per probe of a
+// binary search. Here we decompress once, record the maximum of
+// "olen - ilen" and return the smallest overlap_overhead directly.
+//
+// The decoders below are plain re-implementations of the UCL and LZMA
+// decompressors with the same input granularity, extended by the
+// bookkeeping; the result is cross-checked against the expected output.
+**************************************************************************/
+
+namespace {
+
+struct OverlapState {
+    const upx_byte *src;
+    unsigned src_len;
+    unsigned ilen;
+    upx_byte *dst;
+    unsigned dst_len;
+    unsigned olen;
+    unsigned max_ahead; // max(olen - ilen) after each write
+
+    OverlapState(const upx_byte *s, unsigned s_len, upx_byte *d, unsigned d_len)
+        : src(s), src_len(s_len), ilen(0), dst(d), dst_len(d_len), olen(0), max_ahead(0) {}
+
+    forceinline unsigned byte() {
+        if very_unlikely (ilen >= src_len)
+            throwCompressedDataViolation();
+        return src[ilen++];
+    }
+    forceinline void wrote() {
+        if (olen > ilen && olen - ilen > max_ahead)
+            max_ahead = olen - ilen;
+    }
+    forceinline void literal(unsigned c) {
+        if very_unlikely (olen >= dst_len)
+            throwCompressedDataViolation();
+        dst[olen++] = (upx_byte) c;
+        wrote();
+    }
+    forceinline void match(unsigned m_off, unsigned m_len) {
+        if very_unlikely (m_off == 0 || m_off > olen || m_len > dst_len - olen)
+            throwCompressedDataViolation();
+        const upx_byte *m_pos = dst + olen - m_off;
+        upx_byte *d = dst + olen;
+        olen += m_len;
+        do
+            *d++ = *m_pos++;
+        while (--m_len > 0);
+        wrote();
+    }
+};
+
+/*************************************************************************
+// NRV2B, NRV2D and NRV2E, see <ucl/ucl.h>
+**************************************************************************/
+
+template <unsigned BB> // bit buffer size: 8, 16 or 32 bits
+class NrvOverlap final {
+public:
+    explicit NrvOverlap(OverlapState &state) : s(state) {}
+
+    void decompress(int method) {
+        unsigned last_m_off = 1;
+        for (;;) {
+            while (getbit())
+                s.literal(s.byte());
+
+            unsigned m_off = 1;
+            unsigned m_len;
+            if (M_IS_NRV2B(method)) {
+                do {
+                    m_off = m_off * 2 + getbit();
+                    check_m_off(m_off);
+                } while (!getbit());
+            } else {
+                for (;;) {
+                    m_off = m_off * 2 + getbit();
+                    check_m_off(m_off);
+                    if (getbit())
+                        break;
+                    m_off = (m_off - 1) * 2 + getbit();
+                }
+            }
+            if (m_off == 2) {
+                m_off = last_m_off;
+                m_len = getbit();
+            } else {
+                m_off = (m_off - 3) * 256 + s.byte();
+                if (m_off == 0xffffffff)
+                    break;
+                if (M_IS_NRV2B(method))
+                    m_len = getbit();
+                else {
+                    m_len = (m_off ^ 0xffffffff) & 1;
+                    m_off >>= 1;
+                }
+                last_m_off = ++m_off;
+            }
+
+            if (M_IS_NRV2E(method)) {
+                if (m_len)
+                    m_len = 1 + getbit();
+                else if (getbit())
+                    m_len = 3 + getbit();
+                else {
+                    m_len = get_gamma(1) + 3;
+                }
+                m_len += (m_off > 0x500);
+            } else {
+                m_len = m_len * 2 + getbit();
+                if (m_len == 0)
+                    m_len = get_gamma(1) + 2;
+                m_len += (m_off > (M_IS_NRV2B(method) ? 0xd00u : 0x500u));
+            }
+            s.match(m_off, m_len + 1);
+        }
+        if (s.ilen != s.src_len || s.olen != s.dst_len)
+            throwCompressedDataViolation();
+    }
+
+private:
+    OverlapState &s;
+    unsigned bb = 0;
+    unsigned bc = 0;
+
+    forceinline unsigned getbit() {
+        if (BB == 8) {
+            bb = (bb & 0x7f) ? bb * 2 : s.byte() * 2 + 1;
+            return (bb >> 8) & 1;
+        } else if (BB == 16) {
+            bb *= 2;
+            if (bb & 0xffff)
+                return (bb >> 16) & 1;
+            unsigned v = s.byte();
+            v += s.byte() * 256;
+            bb = v * 2 + 1;
+            return (bb >> 16) & 1;
+        } else {
+            if (bc > 0)
+                return (bb >> --bc) & 1;
+            if very_unlikely (s.src_len - s.ilen < 4 || s.ilen > s.src_len)
+                throwCompressedDataViolation();
+            bb = get_le32(s.src + s.ilen);
+            s.ilen += 4;
+            bc = 31;
+            return bb >> 31;
+        }
+    }
+
+    unsigned get_gamma(unsigned v) {
+        do {
+            v = v * 2 + getbit();
+            if very_unlikely (v > 0x10000000)
+                throwCompressedDataViolation();
+        } while (!getbit());
+        return v;
+    }
+
+    static forceinline void check_m_off(unsigned m_off) {
+        if very_unlikely (m_off > 0xffffff + 3)
+            throwCompressedDataViolation();
+    }
+};
+
+template <unsigned BB>
+static void nrv_overlap(OverlapState &s, int method) {
+    NrvOverlap<BB> d(s);
+    d.decompress(method);
+}
+
+/*************************************************************************
+// LZMA, see LzmaDecode.c of the LZMA SDK 4.43
+//
+// The range decoder normalizes before each bit, exactly like LzmaDecode(),
+// so ilen at every write matches the input consumed by upx_lzma_decompress().
+**************************************************************************/
+
+class LzmaOverlap final {
+public:
+    explicit LzmaOverlap(OverlapState &state) : s(state) {}
+
+    void decompress() {
+        // UPX-style properties (2 bytes), see upx_lzma_decompress()
+        const unsigned b0 = s.byte();
+        const unsigned b1 = s.byte();
+        const unsigned pb = b0 & 7, lp = b1 >> 4, lc = b1 & 15;
+        if (pb >= 5 || lp >= 5 || lc >= 9 || (b0 >> 3) != lc + lp)
+            throwCompressedDataViolation();
+        literal_probs.assign(size_t(0x300) << (lc + lp), PROB_INIT);
+        COMPILE_TIME_ASSERT(sizeof(Model) % sizeof(Prob) == 0)
+        Prob *const probs = &model.is_match[0][0];
+        for (size_t i = 0; i < sizeof(Model) / sizeof(Prob); i++)
+            probs[i] = PROB_INIT;
+
+        code = 0;
+        range = 0xffffffff;
+        for (int i = 0; i < 5; i++)
+            code = (code << 8) | s.byte();
+
+        const unsigned pb_mask = (1u << pb) - 1, lp_mask = (1u << lp) - 1;
+        unsigned state = 0, rep0 = 1, rep1 = 1, rep2 = 1, rep3 = 1;
+        unsigned prev_byte = 0;
+        while (s.olen < s.dst_len) {
+            const unsigned pos_state = s.olen & pb_mask;
+            if (bit(model.is_match[state][pos_state]) == 0) {
+                Prob *p = &literal_probs[size_t(0x300) *
+                                         (((s.olen & lp_mask) << lc) + (prev_byte >> (8 - lc)))];
+                unsigned symbol = 1;
+                if (state >= 7) {
+                    unsigned match_byte = s.dst[s.olen - rep0];
+                    do {
+                        const unsigned match_bit = (match_byte >> 7) & 1;
+                        match_byte <<= 1;
+                        const unsigned b = bit(p[0x100 + (match_bit << 8) + symbol]);
+                        symbol = (symbol << 1) | b;
+                        if (match_bit != b)
+                            break;
+                    } while (symbol < 0x100);
+                }
+                while (symbol < 0x100)
+                    symbol = (symbol << 1) | bit(p[symbol]);
+                prev_byte = symbol & 0xff;
+                s.literal(prev_byte);
+                state = state < 4 ? 0 : (state < 10 ? state - 3 : state - 6);
+                continue;
+            }
+
+            unsigned len;
+            if (bit(model.is_rep[state]) != 0) {
+                if (bit(model.is_rep_g0[state]) == 0) {
+                    if (bit(model.is_rep0_long[state][pos_state]) == 0) {
+                        state = state < 7 ? 9 : 11;
+                        s.match(rep0, 1);
+                        prev_byte = s.dst[s.olen - 1];
+                        continue;
+                    }
+                } else {
+                    unsigned distance;
+                    if (bit(model.is_rep_g1[state]) == 0)
+                        distance = rep1;
+                    else {
+                        if (bit(model.is_rep_g2[state]) == 0)
+                            distance = rep2;
+                        else {
+                            distance = rep3;
+                            rep3 = rep2;
+                        }
+                        rep2 = rep1;
+                    }
+                    rep1 = rep0;
+                    rep0 = distance;
+                }
+                len = decode_len(model.rep_len, pos_state);
+                state = state < 7 ? 8 : 11;
+            } else {
+                rep3 = rep2;
+                rep2 = rep1;
+                rep1 = rep0;
+                state = state < 7 ? 7 : 10;
+                len = decode_len(model.match_len, pos_state);
+                const unsigned pos_slot = bittree(model.pos_slots[len < 4 ? len : 3], 6);
+                if (pos_slot >= 4) {
+                    const unsigned direct_bits = (pos_slot >> 1) - 1;
+                    rep0 = 2 | (pos_slot & 1);
+                    if (pos_slot < 14) {
+                        rep0 <<= direct_bits;
+                        rep0 += reverse_bittree(model.spec_pos + rep0 - pos_slot - 1, direct_bits);
+                    } else {
+                        for (unsigned i = direct_bits - 4; i > 0; i--) {
+                            normalize();
+                            range >>= 1;
+                            rep0 <<= 1;
+                            if (code >= range) {
+                                code -= range;
+                                rep0 |= 1;
+                            }
+                        }
+                        rep0 <<= 4;
+                        rep0 += reverse_bittree(model.align, 4);
+                    }
+                } else
+                    rep0 = pos_slot;
+                if (++rep0 == 0)
+                    break; // end marker
+            }
+            s.match(rep0, len + 2);
+            prev_byte = s.dst[s.olen - 1];
+        }
+        normalize();
+        if (s.ilen != s.src_len || s.olen != s.dst_len)
+            throwCompressedDataViolation();
+    }
+
+private:
+    typedef upx_uint16_t Prob;
+    enum { PROB_INIT = 1024, TOP = 1 << 24 };
+    struct LenProbs {
+        Prob choice, choice2;
+        Prob low[16][8], mid[16][8], high[256];
+    };
+
+    OverlapState &s;
+    unsigned code = 0, range = 0;
+    std::vector<Prob> literal_probs;
+    struct Model {
+        Prob is_match[12][16], is_rep[12], is_rep_g0[12], is_rep_g1[12], is_rep_g2[12];
+        Prob is_rep0_long[12][16], pos_slots[4][64], spec_pos[128 - 14], align[16];
+        LenProbs match_len, rep_len;
+    };
+    Model model;
+
+    forceinline void normalize() {
+        if (range < TOP) {
+            range <<= 8;
+            code = (code << 8) | s.byte();
+        }
+    }
+    forceinline unsigned bit(Prob &p) {
+        normalize();
+        const unsigned bound = (range >> 11) * p;
+        if (code < bound) {
+            range = bound;
+            p = Prob(p + ((2048 - p) >> 5));
+            return 0;
+        }
+        range -= bound;
+        code -= bound;
+        p = Prob(p - (p >> 5));
+        return 1;
+    }
+    unsigned bittree(Prob *p, unsigned num_bits) {
+        unsigned m = 1;
+        for (unsigned i = 0; i < num_bits; i++)
+            m = (m << 1) | bit(p[m]);
+        return m - (1u << num_bits);
+    }
+    unsigned reverse_bittree(Prob *p, unsigned num_bits) {
+        unsigned m = 1, symbol = 0;
+        for (unsigned i = 0; i < num_bits; i++) {
+            const unsigned b = bit(p[m]);
+            m = (m << 1) | b;
+            symbol |= b << i;
+        }
+        return symbol;
+    }
+    unsigned decode_len(LenProbs &lp, unsigned pos_state) {
+        if (bit(lp.choice) == 0)
+            return bittree(lp.low[pos_state], 3);
+        if (bit(lp.choice2) == 0)
+            return 8 + bittree(lp.mid[pos_state], 3);
+        return 16 + bittree(lp.high, 8);
+    }
+};
+
+} // namespace
+
+/*************************************************************************
+// Compute the smallest overlap_overhead (src_off + src_len - dst_len) for
+// which in-place decompression does not clobber unread compressed data.
+// The decompressed data is compared against tbuf if tbuf is not NULL.
+// Returns UPX_E_ERROR for methods without a single-pass analysis.
+**************************************************************************/
+
+int upx_find_overlap(const upx_bytep src, unsigned src_len, const upx_bytep tbuf, unsigned dst_len,
+                     unsigned *overlap_overhead, int method) {
+    assert(src_len > 0 && dst_len > 0);
+    *overlap_overhead = 0;
+    MemBuffer d_buf(dst_len);
+    OverlapState s(src, src_len, d_buf, dst_len);
+    try {
+        switch (method) {
+        case M_NRV2B_8:
+        case M_NRV2D_8:
+        case M_NRV2E_8:
+            nrv_overlap<8>(s, method);
+            break;
+        case M_NRV2B_LE16:
+        case M_NRV2D_LE16:
+        case M_NRV2E_LE16:
+            nrv_overlap<16>(s, method);
+            break;
+        case M_NRV2B_LE32:
+        case M_NRV2D_LE32:
+        case M_NRV2E_LE32:
+            nrv_overlap<32>(s, method);
+            break;
+        default:
+            if (!M_IS_LZMA(method))
+                return UPX_E_ERROR;
+            LzmaOverlap(s).decompress();
+            break;
+        }
+    } catch (const Exception &) {
+        return UPX_E_ERROR;
+    }
+    if (tbuf != nullptr && memcmp(tbuf, d_buf, dst_len) != 0)
+        return UPX_E_ERROR;
+    // src_off >= max_ahead
+    upx_int64_t overhead = (upx_int64_t) s.max_ahead + src_len - dst_len;
+    *overlap_overhead = overhead > 0 ? ACC_ICONV(unsigned, overhead) : 1;
+    return UPX_E_OK;
+}
+
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+TEST_CASE("upx_find_overlap") {
+    typedef const upx_byte C;
+    C *c_data;
+    upx_byte d_buf[16];
+    unsigned overhead;
+
+    // see TEST_CASE("upx_lzma_decompress")
+    c_data = (C *) "\x1a\x03\x00\x7f\xed\x3c\x00\x00\x00";
+    memset(d_buf, 0xff, 16);
+    CHECK(upx_find_overlap(c_data, 9, d_buf, 16, &overhead, M_LZMA) == UPX_E_OK);
+    CHECK(overhead == 1);
+    CHECK(upx_find_overlap(c_data, 9, nullptr, 16, &overhead, M_LZMA) == UPX_E_OK);
+    CHECK(upx_find_overlap(c_data, 8, d_buf, 16, &overhead, M_LZMA) == UPX_E_ERROR);
+    CHECK(upx_find_overlap(c_data, 9, d_buf, 15, &overhead, M_LZMA) == UPX_E_ERROR);
+    d_buf[15] ^= 1;
+    CHECK(upx_find_overlap(c_data, 9, d_buf, 16, &overhead, M_LZMA) == UPX_E_ERROR);
+
+    // 102 bytes of text with a few matches, compressed as NRV2B_LE32 and NRV2E_8
+    static const char text[] = "in-place decompression: abcdabcdabcdabcdabcdabcdabcdabcdabcdabcd"
+                               "abcdabcd012345678901234567890123456789";
+    C *const t_data = (C *) text;
+    c_data = (C *) "\xf6\xff\xff\xff\x69\x6e\x2d\x70\x6c\x61\x63\x65\x20\x64\x65\x63\x6f\x6d"
+                   "\x70\x72\x65\x73\x73\x69\x6f\x6e\x3a\x20\x61\x62\x63\x64\x03\x00\xfb\x7f"
+                   "\x10\x30\x31\x32\x33\x34\x35\x36\x37\x38\x39\x09\x00\x00\x00\xc0\x00\x20"
+                   "\x01\x00\xff";
+    CHECK(upx_find_overlap(c_data, 57, t_data, 102, &overhead, M_NRV2B_LE32) == UPX_E_OK);
+    CHECK(overhead == 5);
+    CHECK(upx_find_overlap(c_data, 57, t_data, 102, &overhead, M_NRV2D_LE32) == UPX_E_ERROR);
+    CHECK(upx_find_overlap(c_data, 56, t_data, 102, &overhead, M_NRV2B_LE32) == UPX_E_ERROR);
+    c_data = (C *) "\xff\x69\x6e\x2d\x70\x6c\x61\x63\x65\xff\x20\x64\x65\x63\x6f\x6d\x70\x72"
+                   "\xff\x65\x73\x73\x69\x6f\x6e\x3a\x20\xf6\x61\x62\x63\x64\x07\x20\x7f\x30"
+                   "\x31\x32\x33\x34\x35\xf6\x36\x37\x38\x39\x13\x01\x09\x24\x92\x49\x2a\xff";
+    CHECK(upx_find_overlap(c_data, 54, t_data, 102, &overhead, M_NRV2E_8) == UPX_E_OK);
+    CHECK(overhead == 6);
+    CHECK(upx_find_overlap(c_data, 54, t_data, 101, &overhead, M_NRV2E_8) == UPX_E_ERROR);
+
+    // no single-pass analysis for the other methods
+    CHECK(upx_find_overlap(c_data, 9, nullptr, 16, &overhead, M_DEFLATE) == UPX_E_ERROR);
+}
+
+/* vim:set ts=4 sw=4 et: */
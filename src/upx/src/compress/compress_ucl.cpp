@@ -260,11 +260,9 @@ unsigned upx_ucl_adler32(const void *buf, unsigned len, unsigned adler) {
     return ucl_adler32(adler, (const ucl_bytep) buf, len);
 }
 
-#if 0 // UNUSED
 unsigned upx_ucl_crc32(const void *buf, unsigned len, unsigned crc) {
     return ucl_crc32(crc, (const ucl_bytep) buf, len);
 }
-#endif
 
 /*************************************************************************
 // doctest checks
@@ -306,9 +304,26 @@ static bool check_ucl(const int method, const unsigned expected_c_len) {
     if (r == 0)
         return false;
 
-    // TODO: rewrite Packer::findOverlapOverhead() so that we can test it here
-    // unsigned x_len = d_len;
-    // r = upx_ucl_test_overlap(c_buf, u_buf, c_extra, c_len, &x_len, method, nullptr);
+    // the single-pass analysis used by Packer::findOverlapOverhead() must
+    // return exactly the smallest overhead accepted by upx_ucl_test_overlap()
+    unsigned overhead = 0;
+    r = upx_find_overlap(raw_index_bytes(c_buf, c_extra, c_len), c_len, raw_bytes(u_buf, u_len),
+                         u_len, &overhead, method);
+    if (r != 0 || overhead == 0)
+        return false;
+    // like Packer::testOverlappingDecompression(), the compressed data is
+    // placed at src_off in a buffer of u_len + overlap_overhead bytes
+    MemBuffer o_buf;
+    o_buf.alloc(u_len + overhead);
+    for (unsigned oo = overhead; oo + 1 >= overhead && oo > 0; oo--) {
+        const unsigned src_off = u_len + oo - c_len;
+        memcpy(raw_index_bytes(o_buf, src_off, c_len), raw_index_bytes(c_buf, c_extra, c_len), c_len);
+        unsigned x_len = u_len;
+        r = upx_ucl_test_overlap(raw_bytes(o_buf, src_off + c_len), nullptr, src_off, c_len, &x_len,
+                                 method, nullptr);
+        if ((r == 0) != (oo == overhead))
+            return false;
+    }
     return true;
 }
 
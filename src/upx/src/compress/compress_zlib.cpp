@@ -223,17 +223,14 @@ int upx_zlib_init(void) {
 
 const char *upx_zlib_version_string(void) { return zlibVersion(); }
 
-#if 0 // UNUSED
+// used to cross-check the SIMD kernels in compress_checksum.cpp
 unsigned upx_zlib_adler32(const void *buf, unsigned len, unsigned adler) {
     return adler32(adler, (const Bytef *) buf, len);
 }
-#endif
 
-#if 0 // UNUSED
 unsigned upx_zlib_crc32(const void *buf, unsigned len, unsigned crc) {
     return crc32(crc, (const Bytef *) buf, len);
 }
-#endif
 
 /*************************************************************************
 // doctest checks
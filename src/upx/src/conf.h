@@ -120,8 +120,15 @@ ACC_COMPILE_TIME_ASSERT_HEADER((char)(-1) == 255) // -funsigned-char
 #include <new>
 #include <type_traits>
 #include <typeinfo>
-#if __STDC_NO_ATOMICS__ || 1
-// UPX currently does not use multithreading
+#ifndef WITH_THREADS
+#  if (ACC_OS_DOS16 || ACC_OS_DOS32) || __STDC_NO_ATOMICS__
+#    define WITH_THREADS 0
+#  else
+#    define WITH_THREADS 1
+#  endif
+#endif
+#if !(WITH_THREADS)
+// single-threaded build
 #define upx_std_atomic(Type)    Type
 //#define upx_std_atomic(Type)    typename std::add_volatile<Type>::type
 #else
@@ -869,6 +876,7 @@ void show_version(bool one_line=false);
 
 // compress/compress.cpp
 unsigned upx_adler32(const void *buf, unsigned len, unsigned adler=1);
+unsigned upx_adler32_combine(unsigned adler1, unsigned adler2, unsigned len2);
 unsigned upx_crc32  (const void *buf, unsigned len, unsigned crc=0);
 
 int upx_compress           ( const upx_bytep src, unsigned  src_len,
@@ -888,6 +896,12 @@ int upx_test_overlap       ( const upx_bytep buf,
                                    int method,
                              const upx_compress_result_t *cresult );
 
+// compress/compress_overlap.cpp
+int upx_find_overlap       ( const upx_bytep src, unsigned  src_len,
+                             const upx_bytep tbuf, unsigned  dst_len,
+                                   unsigned* overlap_overhead,
+                                   int method );
+
 
 #if (ACC_OS_CYGWIN || ACC_OS_DOS16 || ACC_OS_DOS32 || ACC_OS_EMX || ACC_OS_OS2 || ACC_OS_OS216 || ACC_OS_WIN16 || ACC_OS_WIN32 || ACC_OS_WIN64)
 #  if defined(INVALID_HANDLE_VALUE) || defined(MAKEWORD) || defined(RT_CURSOR)
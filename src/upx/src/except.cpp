@@ -117,6 +117,8 @@ void throwChecksumError() { throw Exception("checksum error"); }
 
 void throwCompressedDataViolation() { throw Exception("compressed data violation"); }
 
+void throwCancelled() { throw CancelledException("cancelled"); }
+
 /*************************************************************************
 // other
 **************************************************************************/
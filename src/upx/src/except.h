@@ -176,6 +176,13 @@ public:
     NotPackedException(const char *m = nullptr) noexcept : super(m, true) {}
 };
 
+class CancelledException : public Exception {
+    typedef Exception super;
+
+public:
+    CancelledException(const char *m = nullptr) noexcept : super(m, 0) {}
+};
+
 /*************************************************************************
 // errors
 **************************************************************************/
@@ -210,6 +217,7 @@ NORET void throwFilterException();
 NORET void throwBadLoader();
 NORET void throwChecksumError();
 NORET void throwCompressedDataViolation();
+NORET void throwCancelled();
 NORET void throwInternalError(const char *msg);
 NORET void throwOutOfMemoryException(const char *msg = nullptr);
 NORET void throwIOException(const char *msg = nullptr, int e = 0);
@@ -100,10 +100,12 @@ bool FileBase::do_sopen() {
 
 bool FileBase::close() {
     bool ok = true;
-    if (isOpen() && _fd != STDIN_FILENO && _fd != STDOUT_FILENO && _fd != STDERR_FILENO)
+    if (_fd >= 0 && _fd != STDIN_FILENO && _fd != STDOUT_FILENO && _fd != STDERR_FILENO)
         if (::close(_fd) == -1)
             ok = false;
     _fd = -1;
+    _is_mem = false;
+    _mem_pos = 0;
     _flags = 0;
     _mode = 0;
     _name = nullptr;
@@ -134,16 +136,24 @@ upx_off_t FileBase::seek(upx_off_t off, int whence) {
         whence = SEEK_SET;
     }
     // SEEK_CUR falls through to here
-    upx_off_t rv = ::lseek(_fd, off, whence);
-    if (rv < 0)
-        throwIOException("seek error", errno);
+    upx_off_t rv;
+    if (_is_mem) {
+        rv = (whence == SEEK_CUR) ? _mem_pos + off : off;
+        if (rv < 0)
+            throwIOException("seek error", EINVAL);
+        _mem_pos = rv;
+    } else {
+        rv = ::lseek(_fd, off, whence);
+        if (rv < 0)
+            throwIOException("seek error", errno);
+    }
     return rv - _offset;
 }
 
 upx_off_t FileBase::tell() const {
     if (!isOpen())
         throwIOException("bad tell");
-    upx_off_t l = ::lseek(_fd, 0, SEEK_CUR);
+    upx_off_t l = _is_mem ? _mem_pos : ::lseek(_fd, 0, SEEK_CUR);
     if (l < 0)
         throwIOException("tell error", errno);
     return l - _offset;
@@ -181,10 +191,38 @@ void InputFile::sopen(const char *name, int flags, int shflags) {
     _length_orig = _length;
 }
 
+void InputFile::openMemory(const char *name, const void *buf, upx_off_t len) {
+    close();
+    if (buf == nullptr || len < 0)
+        throwIOException("bad openMemory");
+    _name = name;
+    _flags = O_RDONLY | O_BINARY;
+    _shflags = -1;
+    _mode = 0;
+    _offset = 0;
+    _length = len;
+    _length_orig = len;
+    _mem_buf = (const upx_byte *) buf;
+    _is_mem = true;
+    memset(&st, 0, sizeof(st));
+    st.st_size = len;
+    st.st_mode = S_IFREG | 0700; // rwx------
+}
+
 int InputFile::read(SPAN_P(void) buf, int len) {
     if (!isOpen() || len < 0)
         throwIOException("bad read");
     mem_size_assert(1, len); // sanity check
+    if (_is_mem) {
+        // _length_orig is the size of _mem_buf[]
+        long l = 0;
+        if (_mem_pos < _length_orig)
+            l = (long) UPX_MIN((upx_off_t) len, _length_orig - _mem_pos);
+        if (l > 0)
+            memcpy(raw_bytes(buf, l), _mem_buf + _mem_pos, l);
+        _mem_pos += l;
+        return (int) l;
+    }
     errno = 0;
     long l = acc_safe_hread(_fd, raw_bytes(buf, len), len);
     if (errno)
@@ -236,6 +274,22 @@ void OutputFile::sopen(const char *name, int flags, int shflags, int mode) {
     }
 }
 
+void OutputFile::openMemory(const char *name, std::vector<upx_byte> *buf) {
+    close();
+    if (buf == nullptr)
+        throwIOException("bad openMemory");
+    _name = name;
+    _flags = O_WRONLY | O_BINARY;
+    _shflags = -1;
+    _mode = 0;
+    _offset = 0;
+    _length = 0;
+    bytes_written = 0;
+    buf->clear();
+    _mem_buf = buf;
+    _is_mem = true;
+}
+
 bool OutputFile::openStdout(int flags, bool force) {
     close();
     int fd = STDOUT_FILENO;
@@ -260,6 +314,17 @@ void OutputFile::write(SPAN_0(const void) buf, int len) {
     if (len == 0)
         return;
     mem_size_assert(1, len); // sanity check
+    if (_is_mem) {
+        const size_t end = (size_t) _mem_pos + len;
+        if (_mem_buf->capacity() < end) // grow geometrically
+            _mem_buf->reserve(UPX_MAX(end, 2 * _mem_buf->capacity()));
+        if (_mem_buf->size() < end) // like a file: zero-fill after a seek past the end
+            _mem_buf->resize(end);
+        memcpy(_mem_buf->data() + _mem_pos, raw_bytes(buf, len), len);
+        _mem_pos = end;
+        bytes_written += len;
+        return;
+    }
     errno = 0;
 #if 0
     fprintf(stderr, "write %p %zd (%p) %d\n", buf.raw_ptr(), buf.raw_size_in_bytes(),
@@ -275,6 +340,8 @@ upx_off_t OutputFile::st_size() const {
     if (opt->to_stdout) {     // might be a pipe ==> .st_size is invalid
         return bytes_written; // too big if seek()+write() instead of rewrite()
     }
+    if (_is_mem)
+        return _mem_buf->size();
     struct stat my_st;
     my_st.st_size = 0;
     if (::fstat(_fd, &my_st) != 0)
@@ -320,6 +387,10 @@ void OutputFile::set_extent(upx_off_t offset, upx_off_t length) {
     super::set_extent(offset, length);
     bytes_written = 0;
     if (0 == offset && (upx_off_t) ~0u == length) {
+        if (_is_mem) {
+            _length = _mem_buf->size();
+            return;
+        }
         if (::fstat(_fd, &st) != 0)
             throwIOException(_name, errno);
         _length = st.st_size - offset;
@@ -327,9 +398,11 @@ void OutputFile::set_extent(upx_off_t offset, upx_off_t length) {
 }
 
 upx_off_t OutputFile::unset_extent() {
-    upx_off_t l = ::lseek(_fd, 0, SEEK_END);
+    upx_off_t l = _is_mem ? (upx_off_t) _mem_buf->size() : ::lseek(_fd, 0, SEEK_END);
     if (l < 0)
         throwIOException("lseek error", errno);
+    if (_is_mem)
+        _mem_pos = l;
     _offset = 0;
     _length = l;
     bytes_written = _length;
@@ -346,4 +419,44 @@ void OutputFile::dump(const char *name, SPAN_P(const void) buf, int len, int fla
     f.closex();
 }
 
+/*************************************************************************
+//
+**************************************************************************/
+
+TEST_CASE("InputFile/OutputFile openMemory") {
+    static const upx_byte data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    upx_byte buf[8];
+    InputFile fi;
+    fi.openMemory("<memory>", data, 8);
+    CHECK(fi.isOpen());
+    CHECK(fi.st_size() == 8);
+    CHECK(fi.read(buf, 3) == 3);
+    CHECK(buf[2] == 3);
+    CHECK(fi.seek(-2, SEEK_END) == 6);
+    CHECK(fi.read(buf, 8) == 2);
+    CHECK(buf[1] == 8);
+    CHECK(fi.read(buf, 8) == 0);
+    CHECK_THROWS(fi.readx(buf, 1));
+    fi.set_extent(4, 4);
+    CHECK(fi.seek(0, SEEK_SET) == 0);
+    CHECK(fi.readx(buf, 4) == 4);
+    CHECK(buf[0] == 5);
+    fi.closex();
+    CHECK(!fi.isOpen());
+
+    std::vector<upx_byte> out;
+    OutputFile fo;
+    fo.openMemory("<memory>", &out);
+    fo.write(data, 4);
+    fo.seek(6, SEEK_SET);
+    fo.write(data + 6, 2);
+    CHECK(fo.st_size() == 8);
+    fo.seek(4, SEEK_SET);
+    fo.rewrite(data + 4, 2);
+    CHECK(fo.getBytesWritten() == 8);
+    fo.closex();
+    CHECK(out.size() == 8);
+    CHECK(memcmp(out.data(), data, 8) == 0);
+}
+
 /* vim:set ts=4 sw=4 et: */
@@ -29,6 +29,8 @@
 #ifndef UPX_FILE_H__
 #define UPX_FILE_H__ 1
 
+#include <vector>
+
 /*************************************************************************
 //
 **************************************************************************/
@@ -41,7 +43,7 @@ protected:
 public:
     bool close();
     void closex();
-    bool isOpen() const { return _fd >= 0; }
+    bool isOpen() const { return _fd >= 0 || _is_mem; }
     int getFd() const { return _fd; }
     const char *getName() const { return _name; }
 
@@ -65,6 +67,9 @@ protected:
     const char *_name = nullptr;
     upx_off_t _offset = 0;
     upx_off_t _length = 0;
+    // memory-backed file without _fd; see InputFile::openMemory()
+    bool _is_mem = false;
+    upx_off_t _mem_pos = 0;
 
 public:
     struct stat st = {};
@@ -83,6 +88,8 @@ public:
 
     void sopen(const char *name, int flags, int shflags);
     void open(const char *name, int flags) { sopen(name, flags, -1); }
+    // read from buf[0..len) instead of a file; buf must outlive this object
+    void openMemory(const char *name, const void *buf, upx_off_t len);
 
     int read(SPAN_P(void) buf, int len);
     int readx(SPAN_P(void) buf, int len);
@@ -92,6 +99,7 @@ public:
 
 protected:
     upx_off_t _length_orig = 0;
+    const upx_byte *_mem_buf = nullptr;
 };
 
 /*************************************************************************
@@ -108,6 +116,8 @@ public:
     void sopen(const char *name, int flags, int shflags, int mode);
     void open(const char *name, int flags, int mode) { sopen(name, flags, -1, mode); }
     bool openStdout(int flags = 0, bool force = false);
+    // write to *buf instead of a file; buf must outlive this object
+    void openMemory(const char *name, std::vector<upx_byte> *buf);
 
     // info: allow nullptr if len == 0
     void write(SPAN_0(const void) buf, int len);
@@ -127,6 +137,7 @@ public:
 
 protected:
     upx_off_t bytes_written = 0;
+    std::vector<upx_byte> *_mem_buf = nullptr;
 };
 
 #endif
@@ -206,4 +206,56 @@ bool Filter::scan(const upx_byte *buf_, unsigned buf_len_) {
     return false;
 }
 
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+#if DEBUG && !defined(DOCTEST_CONFIG_DISABLE) && 1
+
+#include "util/membuffer.h"
+
+// the cto filters must give the same results with and without a shared scan_cache
+TEST_CASE("Filter scan_cache") {
+    const unsigned len = 20000;
+    MemBuffer orig(len), a(len), b(len);
+    upx_uint32_t seed = 0x31415926;
+    for (unsigned i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        const unsigned r = (seed >> 16) % 100;
+        orig[i] = (upx_byte) (i < 8 ? 0x90 : r < 8 ? 0xe8 : r < 14 ? 0xe9 : r < 18 ? 0x0f
+                              : r < 24 ? 0x80 + (seed >> 8) % 16 : seed >> 24);
+    }
+    // plausible calls into the buffer
+    for (unsigned i = 8; i + 5 < len; i++)
+        if ((orig[i] == 0xe8 || orig[i] == 0xe9) && (i % 3) != 0)
+            set_le32(orig + i + 1, (i * 7919) % len - i - 5);
+    memcpy(a, orig, len);
+    memcpy(b, orig, len);
+
+    FilterScanCache scan_cache;
+    const int ids[] = {0x24, 0x25, 0x26, 0x36, 0x46, 0x49, 0x26, 0x49};
+    for (int id : ids) {
+        Filter fa(9), fb(9);
+        fa.init(id, 0x1000);
+        fb.init(id, 0x1000);
+        fb.scan_cache = &scan_cache;
+        const bool ra = fa.filter(a, len);
+        const bool rb = fb.filter(b, len);
+        CHECK(ra == rb);
+        CHECK(fa.cto == fb.cto);
+        CHECK(fa.calls == fb.calls);
+        CHECK(fa.noncalls == fb.noncalls);
+        CHECK(fa.lastcall == fb.lastcall);
+        CHECK(memcmp(a, b, len) == 0);
+        if (ra)
+            fa.unfilter(a, len, true);
+        if (rb)
+            fb.unfilter(b, len, true);
+        CHECK(memcmp(a, orig, len) == 0);
+        CHECK(memcmp(b, orig, len) == 0);
+    }
+}
+
+#endif // DEBUG
+
 /* vim:set ts=4 sw=4 et: */
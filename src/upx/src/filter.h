@@ -29,6 +29,10 @@
 #ifndef UPX_FILTER_H__
 #define UPX_FILTER_H__ 1
 
+#if (WITH_THREADS)
+#include <mutex>
+#endif
+
 /*************************************************************************
 // A filter is a reversible operation that modifies a given
 // block of memory.
@@ -46,6 +50,8 @@
 // to absolute addresses so that the buffer compresses better.
 **************************************************************************/
 
+class FilterScanCache;
+
 class Filter {
 public:
     Filter(int level) {
@@ -75,6 +81,9 @@ public:
     // Input parameters used by various filters.
     unsigned addvalue;
     const int *preferred_ctos = nullptr;
+    // Optional, not cleared by init(): the caller guarantees that the
+    // buffer does not change while the filters get tried on it.
+    FilterScanCache *scan_cache = nullptr;
 
     // Input/output parameters used by various filters
     unsigned char cto; // call trick offset
@@ -94,6 +103,48 @@ private:
     int clevel; // compression level
 };
 
+/*************************************************************************
+// The first pass of the cto calltrick filters (the search for a free
+// call trick offset) only depends on the buffer and on the opcodes the
+// filter looks at, so compressWithFilters() shares its results between
+// all filter ids and methods that get tried on the same buffer.
+//
+// The entries are private to the filters, see filter/ctoscan.h.
+// The owner must reset() the cache when the buffer changes.
+**************************************************************************/
+
+class FilterScanCache final {
+public:
+    FilterScanCache() noexcept { reset(); }
+    void reset() noexcept {
+        bound = false;
+        for (auto &e : entries)
+            e.valid = false;
+    }
+
+    struct Entry {
+        bool valid;
+        bool overflow;              // a call target inside the buffer needs more than 24 bits
+        unsigned char outside[256]; // hi bytes of the calls that leave the buffer
+    };
+    // the buffer the entries belong to
+    bool bound;
+    unsigned buf_len;
+    unsigned addvalue;
+    unsigned adler;
+    Entry entries[3]; // one per opcode class
+#if (WITH_THREADS)
+    std::mutex mutex;
+#endif
+
+private:
+    // disable copy and move
+    FilterScanCache(const FilterScanCache &) DELETED_FUNCTION;
+    FilterScanCache &operator=(const FilterScanCache &) DELETED_FUNCTION;
+    FilterScanCache(FilterScanCache &&) DELETED_FUNCTION;
+    FilterScanCache &operator=(FilterScanCache &&) DELETED_FUNCTION;
+};
+
 /*************************************************************************
 // We don't want a full OO interface here because of
 // certain implementation speed reasons.
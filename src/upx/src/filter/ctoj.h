@@ -52,33 +52,15 @@ static int F(Filter *f)
     unsigned lastnoncall = size, lastcall = 0;
 
     // find a 16 MiB large empty address space
-    {
-        unsigned char buf[256];
-        memset(buf,0,256);
-
-        for (ic = 0; ic < size - 5; ic++)
-        {
-            if (!COND(b,ic,lastcall))
-                continue;
-            jc = get_le32(b+ic+1)+ic+1;
-            if (jc < size)
-            {
-                if (jc + addvalue >= (1u << 24)) // hi 8 bits won't be cto8
-                    return -1;
-            }
-            else
-                buf[b[ic+1]] |= 1;
-        }
-
-        if (getcto(f, buf) < 0)
-            return -1;
-    }
+    if (getcto_classes(f, CTO_CLASSES(f->id)) < 0)
+        return -1;
     const unsigned char cto8 = f->cto;
 #ifdef U
     const unsigned cto = (unsigned)f->cto << 24;
 #endif
 
-    for (ic = 0; ic < size - 5; ic++)
+    OpcodeScanner sc(b, size, CTO_CLASSES(f->id));
+    for (ic = sc.next(0, size - 5); ic < size - 5; ic = sc.next(ic + 1, size - 5))
     {
         if (!COND(b,ic,lastcall))
             continue;
@@ -147,7 +129,8 @@ static int U(Filter *f)
 //    unsigned lastcall = 0;    // lastcall is not used in COND macro
     unsigned ic, jc;
 
-    for (ic = 0; ic < size5; ic++)
+    OpcodeScanner sc(b, f->buf_len, CTO_CLASSES(f->id));
+    for (ic = sc.next(0, size5); ic < size5; ic = sc.next(ic + 1, size5))
         if (COND(b,ic,lastcall))
         {
             jc = get_be32(b+ic+1);
@@ -0,0 +1,253 @@
+/* ctoscan.h -- calltrick opcode scanning
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2023 Markus Franz Xaver Johannes Oberhumer
+   Copyright (C) 1996-2023 Laszlo Molnar
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer              Laszlo Molnar
+   <markus@oberhumer.com>               <ezerotven+github@gmail.com>
+ */
+
+
+#if (ACC_ARCH_AMD64) || (ACC_ARCH_I386 && (defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#include <emmintrin.h>
+#define WITH_CTO_SSE2 1
+#else
+#define WITH_CTO_SSE2 0
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+
+/*************************************************************************
+// opcode classes of the cto filters; see CTO_CLASSES in filter_impl.cpp
+**************************************************************************/
+
+#define CTO_E8      1       // call
+#define CTO_E9      2       // jmp
+#define CTO_JCC     4       // 0f 80..8f
+
+static forceinline unsigned cto_ctz32(upx_uint32_t x)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long r;
+    _BitScanForward(&r, x);
+    return (unsigned) r;
+#else
+    return (unsigned) __builtin_ctz(x);
+#endif
+}
+
+
+/*************************************************************************
+// OpcodeScanner - find the candidate positions for COND()
+//
+// A byte is a candidate if ((b & m1) == v1 || (b & m2) == v2); this is a
+// superset of COND(), which the caller still has to check. The candidates
+// are found with compare-and-movemask over 32-byte blocks.
+//
+// The filters may only modify the 4 bytes after the position returned by
+// the last next(), and then must continue at least 5 bytes later (or
+// restore the original bytes): the mask of the current block is computed
+// before the block is modified.
+**************************************************************************/
+
+class OpcodeScanner
+{
+public:
+    OpcodeScanner(const upx_byte *b_, unsigned limit_, unsigned classes) :
+        b(b_), limit(limit_), base(0), mask(0)
+    {
+        // classes -> two masked compares
+        if ((classes & (CTO_E8 | CTO_E9)) == (CTO_E8 | CTO_E9))
+            m1 = 0xfe, v1 = 0xe8;
+        else if (classes & CTO_E8)
+            m1 = 0xff, v1 = 0xe8;
+        else if (classes & CTO_E9)
+            m1 = 0xff, v1 = 0xe9;
+        else
+            m1 = 0xf0, v1 = 0x80;
+        if ((classes & CTO_JCC) && (classes & (CTO_E8 | CTO_E9)))
+            m2 = 0xf0, v2 = 0x80;
+        else
+            m2 = m1, v2 = v1;
+        mask = blockMask(0);
+    }
+
+    // return the first candidate position >= ic, or some position >= end
+    forceinline unsigned next(unsigned ic, unsigned end)
+    {
+        while (ic < end)
+        {
+            if (ic - base >= 32)
+            {
+                base = ic;
+                mask = blockMask(base);
+            }
+            const upx_uint32_t m = mask >> (ic - base);
+            if (m != 0)
+                return ic + cto_ctz32(m);
+            ic = base + 32;
+        }
+        return ic;
+    }
+
+private:
+    upx_uint32_t blockMask(unsigned pos) const
+    {
+        upx_uint32_t r = 0;
+#if (WITH_CTO_SSE2)
+        if (limit >= 32 && pos <= limit - 32)
+        {
+            const __m128i vm1 = _mm_set1_epi8((char) m1);
+            const __m128i vv1 = _mm_set1_epi8((char) v1);
+            const __m128i vm2 = _mm_set1_epi8((char) m2);
+            const __m128i vv2 = _mm_set1_epi8((char) v2);
+            const __m128i x0 = _mm_loadu_si128((const __m128i *) (const void *) (b + pos));
+            const __m128i x1 = _mm_loadu_si128((const __m128i *) (const void *) (b + pos + 16));
+            const __m128i c0 = _mm_or_si128(_mm_cmpeq_epi8(_mm_and_si128(x0, vm1), vv1),
+                                            _mm_cmpeq_epi8(_mm_and_si128(x0, vm2), vv2));
+            const __m128i c1 = _mm_or_si128(_mm_cmpeq_epi8(_mm_and_si128(x1, vm1), vv1),
+                                            _mm_cmpeq_epi8(_mm_and_si128(x1, vm2), vv2));
+            r = (upx_uint32_t) _mm_movemask_epi8(c0) |
+                ((upx_uint32_t) _mm_movemask_epi8(c1) << 16);
+            return r;
+        }
+#endif
+        const unsigned n = umin(32, limit - pos);
+        for (unsigned i = 0; i < n; i++)
+        {
+            const unsigned x = b[pos + i];
+            if ((x & m1) == v1 || (x & m2) == v2)
+                r |= (upx_uint32_t) 1 << i;
+        }
+        return r;
+    }
+
+    const upx_byte *const b;
+    const unsigned limit;           // readable bytes
+    unsigned m1, v1, m2, v2;
+    unsigned base;                  // position of the current block
+    upx_uint32_t mask;              // candidates in [base, base+32)
+};
+
+
+/*************************************************************************
+// first pass of the cto filters: find a 16 MiB large empty address space
+**************************************************************************/
+
+// A call to a destination that is inside the buffer
+// will be rewritten and marked with cto8 as first byte.
+// So, a call to a destination that is outside the buffer
+// must not conflict with the mark.
+// Note that unsigned comparison checks both edges of buffer.
+static void scan_cto(FilterScanCache::Entry *e, const upx_byte *b, unsigned size,
+                     unsigned addvalue, unsigned classes)
+{
+    memset(e->outside, 0, 256);
+    e->overflow = false;
+
+    OpcodeScanner sc(b, size, classes);
+    for (unsigned ic = sc.next(0, size - 5); ic < size - 5; ic = sc.next(ic + 1, size - 5))
+    {
+        const unsigned op = b[ic];
+        if (op == 0xe8 ? !(classes & CTO_E8) : op == 0xe9 ? !(classes & CTO_E9) :
+            !(classes & CTO_JCC) || ic == 0 || b[ic-1] != 0x0f)
+            continue;
+        const unsigned jc = get_le32(b+ic+1)+ic+1;
+        if (jc < size)
+        {
+            if (jc + addvalue >= (1u << 24)) // hi 8 bits won't be cto8
+            {
+                e->overflow = true;
+                return;
+            }
+        }
+        else
+            e->outside[b[ic+1]] = 1;
+    }
+}
+
+// Returns the shared entry for a single opcode class, or nullptr
+// if the filter has no scan_cache for this buffer.
+static const FilterScanCache::Entry *get_cached_cto(const Filter *f, unsigned cls)
+{
+    FilterScanCache *const c = f->scan_cache;
+    if (c == nullptr)
+        return nullptr;
+    const unsigned k = cls == CTO_E8 ? 0 : cls == CTO_E9 ? 1 : 2;
+#if (WITH_THREADS)
+    std::lock_guard<std::mutex> lock(c->mutex);
+#endif
+    if (!c->bound)
+    {
+        c->bound = true;
+        c->buf_len = f->buf_len;
+        c->addvalue = f->addvalue;
+        c->adler = f->adler;
+    }
+    if (c->buf_len != f->buf_len || c->addvalue != f->addvalue || c->adler != f->adler)
+        return nullptr;
+    FilterScanCache::Entry *e = &c->entries[k];
+    if (!e->valid)
+    {
+        scan_cto(e, f->buf, f->buf_len, f->addvalue, cls);
+        e->valid = true;
+    }
+    return e;
+}
+
+// The first pass of a cto filter that looks at the given opcode
+// classes, followed by getcto().
+static int getcto_classes(Filter *f, unsigned classes)
+{
+    unsigned char buf[256];
+    FilterScanCache::Entry local;
+
+    if (f->scan_cache == nullptr)
+    {
+        // single pass for all classes
+        scan_cto(&local, f->buf, f->buf_len, f->addvalue, classes);
+        if (local.overflow)
+            return -1;
+        return getcto(f, local.outside);
+    }
+
+    memset(buf, 0, 256);
+    for (unsigned cls = 1; cls <= CTO_JCC; cls <<= 1)
+    {
+        if (!(classes & cls))
+            continue;
+        const FilterScanCache::Entry *e = get_cached_cto(f, cls);
+        if (e == nullptr)
+        {
+            scan_cto(&local, f->buf, f->buf_len, f->addvalue, cls);
+            e = &local;
+        }
+        if (e->overflow)
+            return -1;
+        for (unsigned i = 0; i < 256; i++)
+            buf[i] |= e->outside[i];
+    }
+    return getcto(f, buf);
+}
+
+/* vim:set ts=4 sw=4 et: */
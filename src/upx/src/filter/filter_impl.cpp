@@ -46,6 +46,7 @@ umin(unsigned const a, unsigned const b)
 **************************************************************************/
 
 #include "getcto.h"
+#include "ctoscan.h"
 
 
 /*************************************************************************
@@ -66,27 +67,33 @@ umin(unsigned const a, unsigned const b)
 **************************************************************************/
 
 #define COND(b,x)               (b[x] == 0xe8)
+#define CTO_CLASSES(id)         (CTO_E8)
 #define F                       f_cto32_e8_bswap_le
 #define U                       u_cto32_e8_bswap_le
 #include "cto.h"
 #define F                       s_cto32_e8_bswap_le
 #include "cto.h"
+#undef CTO_CLASSES
 #undef COND
 
 #define COND(b,x)               (b[x] == 0xe9)
+#define CTO_CLASSES(id)         (CTO_E9)
 #define F                       f_cto32_e9_bswap_le
 #define U                       u_cto32_e9_bswap_le
 #include "cto.h"
 #define F                       s_cto32_e9_bswap_le
 #include "cto.h"
+#undef CTO_CLASSES
 #undef COND
 
 #define COND(b,x)               (b[x] == 0xe8 || b[x] == 0xe9)
+#define CTO_CLASSES(id)         (CTO_E8 | CTO_E9)
 #define F                       f_cto32_e8e9_bswap_le
 #define U                       u_cto32_e8e9_bswap_le
 #include "cto.h"
 #define F                       s_cto32_e8e9_bswap_le
 #include "cto.h"
+#undef CTO_CLASSES
 #undef COND
 
 
@@ -95,11 +102,13 @@ umin(unsigned const a, unsigned const b)
 **************************************************************************/
 
 #define COND(b,x,lastcall) (b[x] == 0xe8 || b[x] == 0xe9)
+#define CTO_CLASSES(id)    (CTO_E8 | CTO_E9)
 #define F                       f_ctoj32_e8e9_bswap_le
 #define U                       u_ctoj32_e8e9_bswap_le
 #include "ctoj.h"
 #define F                       s_ctoj32_e8e9_bswap_le
 #include "ctoj.h"
+#undef CTO_CLASSES
 #undef COND
 
 
@@ -110,11 +119,13 @@ umin(unsigned const a, unsigned const b)
 #define COND1(b,x)     (b[x] == 0xe8 || b[x] == 0xe9)
 #define COND2(b,x,lc)  (lc!=(x) && 0xf==b[(x)-1] && 0x80<=b[x] && b[x]<=0x8f)
 #define COND(b,x,lc,id) (COND1(b,x) || ((9<=(0xf&(id))) && COND2(b,x,lc)))
+#define CTO_CLASSES(id) (CTO_E8 | CTO_E9 | ((9<=(0xf&(id))) ? CTO_JCC : 0))
 #define F                       f_ctok32_e8e9_bswap_le
 #define U                       u_ctok32_e8e9_bswap_le
 #include "ctok.h"
 #define F                       s_ctok32_e8e9_bswap_le
 #include "ctok.h"
+#undef CTO_CLASSES
 #undef COND
 #undef COND2
 #undef COND1
@@ -218,6 +218,7 @@ void show_help(int verbose)
                     "  --lzma              try LZMA [slower but tighter than NRV]\n"
                     "  --brute             try all available compression methods & filters [slow]\n"
                     "  --ultra-brute       try even more compression variants [very slow]\n"
+                    "  --threads=N         use N threads to try compression variants [0 = all CPUs]\n"
                     "\n");
         fg = con_fg(f,FG_YELLOW);
         con_fprintf(f,"Backup options:\n");
@@ -0,0 +1,158 @@
+/* libupx.cpp -- in-process interface to the UPX engine
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2023 Markus Franz Xaver Johannes Oberhumer
+   Copyright (C) 1996-2023 Laszlo Molnar
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer              Laszlo Molnar
+   <markus@oberhumer.com>               <ezerotven+github@gmail.com>
+ */
+
+
+#include "conf.h"
+#include "compress/compress.h" // upx_ucl_init()
+#include "file.h"
+#include "packmast.h"
+#include "util/membuffer.h"
+#include "libupx.h"
+#if (WITH_THREADS)
+#include <mutex>
+#endif
+
+/*************************************************************************
+// one-time initialization; see upx_main()
+**************************************************************************/
+
+static void lib_init(void) {
+    static bool done = false;
+    if (done)
+        return;
+    upx_compiler_sanity_check();
+    if (!progname[0])
+        progname = "upx";
+    if (con_term == nullptr)
+        con_term = stderr;
+#if (WITH_BZIP2)
+    if (upx_bzip2_init() != 0)
+        throwInternalError("upx_bzip2_init failed");
+#endif
+    if (upx_lzma_init() != 0)
+        throwInternalError("upx_lzma_init failed");
+#if (WITH_NRV)
+    if (upx_nrv_init() != 0)
+        throwInternalError("upx_nrv_init failed");
+#endif
+    if (upx_ucl_init() != 0)
+        throwInternalError("upx_ucl_init failed");
+    if (upx_zlib_init() != 0)
+        throwInternalError("upx_zlib_init failed");
+#if (WITH_ZSTD)
+    if (upx_zstd_init() != 0)
+        throwInternalError("upx_zstd_init failed");
+#endif
+    done = true;
+}
+
+/*************************************************************************
+// pack a memory buffer; see do_one_file()
+**************************************************************************/
+
+bool upx_lib_pack(const void *in_buf, size_t in_len, std::vector<unsigned char> *out,
+                  const upx_lib_options_t &opts, std::string *errmsg) {
+#if (WITH_THREADS)
+    static std::mutex lib_mutex; // the global "opt" and the packers are not reentrant
+    std::lock_guard<std::mutex> lock(lib_mutex);
+#endif
+    // buffers are recycled within one pack only; this also covers
+    // the buffers of PackMaster, which is destroyed first
+    struct PoolRelease {
+        ~PoolRelease() noexcept { MemBuffer::releasePool(); }
+    } pool_release;
+    // PackMaster "restores" the global opt to the options it was given,
+    // which are local to this function; put back the caller's opt instead
+    struct OptRestore {
+        options_t *const saved = opt;
+        ~OptRestore() noexcept { opt = saved; }
+    } opt_restore;
+    const char *const iname = opts.name ? opts.name : "<memory>";
+    if (errmsg)
+        errmsg->clear();
+    if (out == nullptr) {
+        if (errmsg)
+            *errmsg = "no output buffer";
+        return false;
+    }
+    out->clear();
+    try {
+        lib_init();
+        if (in_buf == nullptr || in_len == 0)
+            throwIOException("empty file -- skipped");
+        if (in_len < 512)
+            throwIOException("file is too small -- skipped");
+        if (!mem_size_valid_bytes(in_len))
+            throwIOException("file is too large -- skipped");
+        if (opts.level < 1 || opts.level > 10)
+            throwInternalError("invalid compression level");
+
+        options_t o;
+        o.reset();
+        o.cmd = CMD_COMPRESS;
+        o.level = opts.level;
+        o.threads = opts.threads;
+        o.force = opts.force;
+        o.verbose = -1; // quiet
+        o.no_progress = true;
+        o.console = CON_FILE;
+        o.cancelled = opts.cancelled;
+        o.cancelled_user = opts.cancelled_user;
+
+        InputFile fi;
+        fi.openMemory(iname, in_buf, (upx_off_t) in_len);
+        OutputFile fo;
+        out->reserve(in_len); // packed files are smaller in almost all cases
+        fo.openMemory(iname, out);
+        PackMaster pm(&fi, &o);
+        pm.pack(&fo);
+        fo.closex();
+        fi.closex();
+        return true;
+    } catch (const CancelledException &) {
+        if (errmsg)
+            *errmsg = "cancelled";
+    } catch (const Throwable &e) {
+        if (errmsg) {
+            *errmsg = prettyName(typeid(e).name());
+            if (e.getMsg())
+                *errmsg += std::string(": ") + e.getMsg();
+            if (e.getErrno())
+                *errmsg += std::string(": ") + strerror(e.getErrno());
+        }
+    } catch (const std::bad_alloc &) {
+        if (errmsg)
+            *errmsg = "out of memory";
+    } catch (const std::exception &e) {
+        if (errmsg)
+            *errmsg = std::string(prettyName(typeid(e).name())) + ": " + e.what();
+    }
+    out->clear();
+    return false;
+}
+
+/* vim:set ts=4 sw=4 et: */
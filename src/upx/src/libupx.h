@@ -0,0 +1,68 @@
+/* libupx.h --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2023 Markus Franz Xaver Johannes Oberhumer
+   Copyright (C) 1996-2023 Laszlo Molnar
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer              Laszlo Molnar
+   <markus@oberhumer.com>               <ezerotven+github@gmail.com>
+ */
+
+
+// In-process interface to the UPX engine for applications which link
+// the UPX sources as a library (build with WITH_GUI=1 so that there is
+// no main()). This header does not need conf.h.
+
+#pragma once
+#ifndef UPX_LIBUPX_H__
+#define UPX_LIBUPX_H__ 1
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+struct upx_lib_options_t {
+    int level = 10;             // compression level 1..10; 10 == "--best"
+    int threads = 0;            // see "--threads=N"; 0 == use all CPUs
+    int force = 0;              // see "--force"
+    const char *name = nullptr; // name of the input file, only used in messages
+    // optional; polled from the compression threads, so it must be thread-safe
+    bool (*cancelled)(void *user) = nullptr;
+    void *cancelled_user = nullptr;
+};
+
+/*************************************************************************
+// upx_lib_pack - compress the executable in_buf[0..in_len) exactly like
+// "upx" compresses a file, and store the packed file in *out.
+//
+// Returns false and sets *errmsg if the file cannot be packed; in this
+// case *out is empty. If opts.cancelled returns true the pack stops at
+// the next compression call and *errmsg is "cancelled".
+// No console output, no temporary files.
+// The UPX engine uses global state, so concurrent calls are serialized;
+// use opts.threads to make a single call faster.
+**************************************************************************/
+
+bool upx_lib_pack(const void *in_buf, size_t in_len, std::vector<unsigned char> *out,
+                  const upx_lib_options_t &opts, std::string *errmsg = nullptr);
+
+#endif /* already included */
+
+/* vim:set ts=4 sw=4 et: */
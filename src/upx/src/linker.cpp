@@ -27,6 +27,10 @@
 
 #include "conf.h"
 #include "linker.h"
+#include <memory>
+#if (WITH_THREADS)
+#include <mutex>
+#endif
 
 static unsigned hex(unsigned char c) { return (c & 0xf) + (c > '9' ? 9 : 0); }
 
@@ -96,55 +100,81 @@ ElfLinker::Relocation::Relocation(const Section *s, unsigned o, const char *t, c
 }
 
 /*************************************************************************
-// ElfLinker
+// Image - a stub loader parsed once per process
+//
+// The objdump-style text of a stub is decompressed and parsed the first
+// time it is passed to init(). The records are kept until the process
+// exits and shared read-only by all ElfLinker instances, so building the
+// loader for every method/filter candidate only copies them.
+// Images are keyed by address: the stubs are static arrays.
 **************************************************************************/
 
-ElfLinker::ElfLinker()
-    : bele(&N_BELE_RTP::le_policy), input(nullptr), output(nullptr), head(nullptr), tail(nullptr),
-      sections(nullptr), symbols(nullptr), relocations(nullptr), nsections(0),
-      nsections_capacity(0), nsymbols(0), nsymbols_capacity(0), nrelocations(0),
-      nrelocations_capacity(0), reloc_done(false) {}
-
-ElfLinker::~ElfLinker() {
-    delete[] input;
-    delete[] output;
-
-    unsigned ic;
-    for (ic = 0; ic < nsections; ic++)
-        delete sections[ic];
-    free(sections);
-    for (ic = 0; ic < nsymbols; ic++)
-        delete symbols[ic];
-    free(symbols);
-    for (ic = 0; ic < nrelocations; ic++)
-        delete relocations[ic];
-    free(relocations);
-}
-
-void ElfLinker::init(const void *pdata_v, int plen, unsigned pxtra) {
-    const upx_byte *pdata = (const upx_byte *) pdata_v;
-    if (plen >= 16 && memcmp(pdata, "UPX#", 4) == 0) {
+struct ElfLinker::Image : private noncopyable {
+    struct SectionRecord {
+        const char *name;
+        const upx_byte *data; // nullptr for *ABS* and *UND*
+        unsigned size;
+        unsigned p2align;
+    };
+    struct SymbolRecord {
+        const char *name;
+        unsigned section;
+        upx_uint64_t offset;
+    };
+    struct RelocationRecord {
+        unsigned section;
+        unsigned offset;
+        const char *type;
+        unsigned symbol;
+        upx_uint64_t add;
+    };
+
+    const void *pdata = nullptr;
+    int plen = 0;
+    upx_byte *input = nullptr; // NUL terminated records; names point into it
+    int inputlen = 0;
+    bool has_tables = false;
+    std::vector<SectionRecord> sections;
+    std::vector<SymbolRecord> symbols;
+    std::vector<RelocationRecord> relocations;
+    std::unordered_map<std::string_view, unsigned> section_index;
+    std::unordered_map<std::string_view, unsigned> symbol_index;
+
+    Image(const void *pdata, int plen);
+    ~Image() noexcept { delete[] input; }
+
+    void preprocessSections(char *start, char const *end);
+    void preprocessSymbols(char *start, char const *end);
+    void preprocessRelocations(char *start, char const *end);
+    void addSection(const char *name, const upx_byte *data, unsigned size, unsigned p2align);
+    unsigned findSection(const char *name) const;
+    unsigned findSymbol(const char *name) const;
+};
+
+ElfLinker::Image::Image(const void *pdata_v, int plen_) : pdata(pdata_v), plen(plen_) {
+    const upx_byte *p = (const upx_byte *) pdata_v;
+    if (plen >= 16 && memcmp(p, "UPX#", 4) == 0) {
         // decompress pre-compressed stub-loader
         int method;
         unsigned u_len, c_len;
-        if (pdata[4]) {
-            method = pdata[4];
-            u_len = get_le16(pdata + 5);
-            c_len = get_le16(pdata + 7);
-            pdata += 9;
+        if (p[4]) {
+            method = p[4];
+            u_len = get_le16(p + 5);
+            c_len = get_le16(p + 7);
+            p += 9;
             assert(9 + c_len == (unsigned) plen);
         } else {
-            method = pdata[5];
-            u_len = get_le32(pdata + 6);
-            c_len = get_le32(pdata + 10);
-            pdata += 14;
+            method = p[5];
+            u_len = get_le32(p + 6);
+            c_len = get_le32(p + 10);
+            p += 14;
             assert(14 + c_len == (unsigned) plen);
         }
         assert((unsigned) plen < u_len);
         inputlen = u_len;
         input = new upx_byte[inputlen + 1];
         unsigned new_len = u_len;
-        int r = upx_decompress(pdata, c_len, input, &new_len, method, nullptr);
+        int r = upx_decompress(p, c_len, input, &new_len, method, nullptr);
         if (r == UPX_E_OUT_OF_MEMORY)
             throwOutOfMemoryException();
         if (r != UPX_E_OK || new_len != u_len)
@@ -153,16 +183,10 @@ void ElfLinker::init(const void *pdata_v, int plen, unsigned pxtra) {
         inputlen = plen;
         input = new upx_byte[inputlen + 1];
         if (inputlen)
-            memcpy(input, pdata, inputlen);
+            memcpy(input, p, inputlen);
     }
     input[inputlen] = 0; // NUL terminate
 
-    output_capacity = (inputlen ? (inputlen + pxtra) : 0x4000);
-    assert(output_capacity <= (1 << 16)); // LE16 l_info.l_size
-    output = new upx_byte[output_capacity];
-    outputlen = 0;
-    NO_printf("\nElfLinker::init %d @%p\n", output_capacity, output);
-
     // FIXME: bad compare when either symbols or relocs are absent
     if ((int) strlen("Sections:\n"
                      "SYMBOL TABLE:\n"
@@ -183,13 +207,13 @@ void ElfLinker::init(const void *pdata_v, int plen, unsigned pxtra) {
             preprocessSymbols(psymbols, (prelocs ? prelocs : eof));
         if (prelocs)
             preprocessRelocations(prelocs, eof);
-        addLoader("*UND*");
+        has_tables = true;
     }
 }
 
-void ElfLinker::preprocessSections(char *start, char const *end) {
+void ElfLinker::Image::preprocessSections(char *start, char const *end) {
     char *nextl;
-    for (nsections = 0; start < end; start = 1 + nextl) {
+    for (; start < end; start = 1 + nextl) {
         nextl = strchr(start, '\n');
         assert(nextl != nullptr);
         *nextl = '\0'; // a record is a line
@@ -208,9 +232,9 @@ void ElfLinker::preprocessSections(char *start, char const *end) {
     addSection("*UND*", nullptr, 0, 0);
 }
 
-void ElfLinker::preprocessSymbols(char *start, char const *end) {
+void ElfLinker::Image::preprocessSymbols(char *start, char const *end) {
     char *nextl;
-    for (nsymbols = 0; start < end; start = 1 + nextl) {
+    for (; start < end; start = 1 + nextl) {
         nextl = strchr(start, '\n');
         assert(nextl != nullptr);
         *nextl = '\0'; // a record is a line
@@ -219,11 +243,15 @@ void ElfLinker::preprocessSymbols(char *start, char const *end) {
         char section[1024];
         char symbol[1024];
 
+        const char *s = nullptr;
+        unsigned isection = 0;
         if (sscanf(start, "%x g *ABS* %x %1023s", &value, &offset, symbol) == 3) {
-            char *s = strstr(start, symbol);
-            s[strlen(symbol)] = 0;
-            addSymbol(s, "*ABS*", value);
+            char *t = strstr(start, symbol);
+            t[strlen(symbol)] = 0;
+            s = t;
+            isection = findSection("*ABS*");
             assert(offset == 0);
+            offset = value;
         }
 #if 0
         else if (sscanf(start, "%x%*8c %1023s %*x %1023s", &offset, section, symbol) == 3)
@@ -234,28 +262,40 @@ void ElfLinker::preprocessSymbols(char *start, char const *end) {
                         symbol) == 3)
 #endif
         {
-            char *s = strstr(start, symbol);
-            s[strlen(symbol)] = 0;
+            char *t = strstr(start, symbol);
+            t[strlen(symbol)] = 0;
+            s = t;
             if (strcmp(section, "*UND*") == 0)
                 offset = 0xdeaddead;
             assert(strcmp(section, "*ABS*") != 0);
-            addSymbol(s, section, offset);
+            isection = findSection(section);
+        }
+        if (s != nullptr) {
+            assert(s[0]);
+            assert(s[strlen(s) - 1] != ':');
+            bool inserted = symbol_index.emplace(s, (unsigned) symbols.size()).second;
+            assert(inserted);
+            UNUSED(inserted);
+            symbols.push_back(SymbolRecord{s, isection, offset});
         }
     }
 }
 
-void ElfLinker::preprocessRelocations(char *start, char const *end) {
-    Section *section = nullptr;
+void ElfLinker::Image::preprocessRelocations(char *start, char const *end) {
+    bool have_section = false;
+    unsigned isection = 0;
     char *nextl;
-    for (nrelocations = 0; start < end; start = 1 + nextl) {
+    for (; start < end; start = 1 + nextl) {
         nextl = strchr(start, '\n');
         assert(nextl != nullptr);
         *nextl = '\0'; // a record is a line
 
         {
             char sect[1024];
-            if (sscanf(start, "RELOCATION RECORDS FOR [%[^]]", sect) == 1)
-                section = findSection(sect);
+            if (sscanf(start, "RELOCATION RECORDS FOR [%[^]]", sect) == 1) {
+                isection = findSection(sect);
+                have_section = true;
+            }
         }
 
         unsigned offset;
@@ -290,28 +330,123 @@ void ElfLinker::preprocessRelocations(char *start, char const *end) {
                     add = 0 - add;
             }
 
-            if (section) {
-                addRelocation(section->name, offset, t, symbol, add);
-                NO_printf("relocation %s %s %x %llu preprocessed\n", section->name, symbol, offset,
-                          (unsigned long long) add);
+            if (have_section) {
+                relocations.push_back(
+                    RelocationRecord{isection, offset, t, findSymbol(symbol), add});
+                NO_printf("relocation %s %s %x %llu preprocessed\n", sections[isection].name,
+                          symbol, offset, (unsigned long long) add);
             }
         }
     }
 }
 
+void ElfLinker::Image::addSection(const char *name, const upx_byte *data, unsigned size,
+                                  unsigned p2align) {
+    assert(name[0]);
+    assert(name[strlen(name) - 1] != ':');
+    bool inserted = section_index.emplace(name, (unsigned) sections.size()).second;
+    assert(inserted);
+    UNUSED(inserted);
+    sections.push_back(SectionRecord{name, data, size, p2align});
+}
+
+unsigned ElfLinker::Image::findSection(const char *name) const {
+    auto it = section_index.find(name);
+    if (it == section_index.end())
+        internal_error("unknown section %s\n", name);
+    return it->second;
+}
+
+unsigned ElfLinker::Image::findSymbol(const char *name) const {
+    auto it = symbol_index.find(name);
+    if (it == symbol_index.end())
+        internal_error("unknown symbol %s\n", name);
+    return it->second;
+}
+
+/*static*/ const ElfLinker::Image *ElfLinker::getImage(const void *pdata, int plen) {
+#if (WITH_THREADS)
+    static std::mutex images_mutex;
+    std::lock_guard<std::mutex> lock(images_mutex);
+#endif
+    // kept until exit: Relocation types of live linkers point into them
+    static std::vector<std::unique_ptr<Image> > images;
+    for (const auto &image : images)
+        if (image->pdata == pdata && image->plen == plen)
+            return image.get();
+    images.emplace_back(new Image(pdata, plen));
+    return images.back().get();
+}
+
+/*************************************************************************
+// ElfLinker
+**************************************************************************/
+
+ElfLinker::ElfLinker()
+    : bele(&N_BELE_RTP::le_policy), output(nullptr), head(nullptr), tail(nullptr),
+      sections(nullptr), symbols(nullptr), relocations(nullptr), nsections(0),
+      nsections_capacity(0), nsymbols(0), nsymbols_capacity(0), nrelocations(0),
+      nrelocations_capacity(0), reloc_done(false) {}
+
+ElfLinker::~ElfLinker() {
+    delete[] output;
+
+    unsigned ic;
+    for (ic = 0; ic < nsections; ic++)
+        delete sections[ic];
+    free(sections);
+    for (ic = 0; ic < nsymbols; ic++)
+        delete symbols[ic];
+    free(symbols);
+    for (ic = 0; ic < nrelocations; ic++)
+        delete relocations[ic];
+    free(relocations);
+}
+
+void ElfLinker::init(const void *pdata, int plen, unsigned pxtra) {
+    const Image *image = getImage(pdata, plen);
+    inputlen = image->inputlen;
+
+    output_capacity = (inputlen ? (inputlen + pxtra) : 0x4000);
+    assert(output_capacity <= (1 << 16)); // LE16 l_info.l_size
+    output = new upx_byte[output_capacity];
+    outputlen = 0;
+    NO_printf("\nElfLinker::init %d @%p\n", output_capacity, output);
+
+    if (!image->has_tables)
+        return;
+
+    // copy the pre-parsed records; the indices of the image are those of
+    // sections[] and symbols[] here as nothing has been added before
+    assert(nsections == 0 && nsymbols == 0 && nrelocations == 0);
+    section_index.reserve(image->sections.size() + 8);
+    for (const Image::SectionRecord &s : image->sections)
+        addSection(s.name, s.data, s.size, s.p2align);
+    symbol_index.reserve(image->symbols.size() + 8);
+    for (const Image::SymbolRecord &s : image->symbols)
+        addSymbol(s.name, sections[s.section], s.offset);
+    nrelocations_capacity = (unsigned) image->relocations.size() + 1;
+    relocations = static_cast<Relocation **>(malloc(nrelocations_capacity * sizeof(Relocation *)));
+    assert(relocations != nullptr);
+    for (const Image::RelocationRecord &r : image->relocations)
+        relocations[nrelocations++] =
+            new Relocation(sections[r.section], r.offset, r.type, symbols[r.symbol], r.add);
+    addLoader("*UND*");
+}
+
 ElfLinker::Section *ElfLinker::findSection(const char *name, bool fatal) const {
-    for (unsigned ic = 0; ic < nsections; ic++)
-        if (strcmp(sections[ic]->name, name) == 0)
-            return sections[ic];
+    auto it = section_index.find(name);
+    if (it != section_index.end())
+        return it->second;
     if (fatal)
         internal_error("unknown section %s\n", name);
     return nullptr;
 }
 
 ElfLinker::Symbol *ElfLinker::findSymbol(const char *name, bool fatal) const {
-    for (unsigned ic = 0; ic < nsymbols; ic++)
-        if (strcmp(symbols[ic]->name, name) == 0)
-            return symbols[ic];
+    auto it = symbol_index.find(name);
+    if (it != symbol_index.end())
+        return it->second;
     if (fatal)
         internal_error("unknown symbol %s\n", name);
     return nullptr;
@@ -332,12 +467,17 @@ ElfLinker::Section *ElfLinker::addSection(const char *sname, const void *sdata,
     assert(findSection(sname, false) == nullptr);
     Section *sec = new Section(sname, sdata, slen, p2align);
     sections[nsections++] = sec;
+    section_index.emplace(sec->name, sec);
     return sec;
 }
 
 ElfLinker::Symbol *ElfLinker::addSymbol(const char *name, const char *section,
                                         upx_uint64_t offset) {
-    NO_printf("addSymbol: %s %s 0x%llx\n", name, section, offset);
+    return addSymbol(name, findSection(section), offset);
+}
+
+ElfLinker::Symbol *ElfLinker::addSymbol(const char *name, Section *section, upx_uint64_t offset) {
+    NO_printf("addSymbol: %s %s 0x%llx\n", name, section->name, offset);
     if (update_capacity(nsymbols, &nsymbols_capacity))
         symbols = static_cast<Symbol **>(realloc(symbols, nsymbols_capacity * sizeof(Symbol *)));
     assert(symbols != nullptr);
@@ -345,18 +485,25 @@ ElfLinker::Symbol *ElfLinker::addSymbol(const char *name, const char *section,
     assert(name[0]);
     assert(name[strlen(name) - 1] != ':');
     assert(findSymbol(name, false) == nullptr);
-    Symbol *sym = new Symbol(name, findSection(section), offset);
+    Symbol *sym = new Symbol(name, section, offset);
     symbols[nsymbols++] = sym;
+    symbol_index.emplace(sym->name, sym);
     return sym;
 }
 
 ElfLinker::Relocation *ElfLinker::addRelocation(const char *section, unsigned off, const char *type,
                                                 const char *symbol, upx_uint64_t add) {
+    return addRelocation(findSection(section), off, type, findSymbol(symbol), add);
+}
+
+ElfLinker::Relocation *ElfLinker::addRelocation(const Section *section, unsigned off,
+                                                const char *type, const Symbol *symbol,
+                                                upx_uint64_t add) {
     if (update_capacity(nrelocations, &nrelocations_capacity))
         relocations = static_cast<Relocation **>(
             realloc(relocations, (nrelocations_capacity) * sizeof(Relocation *)));
     assert(relocations != nullptr);
-    Relocation *rel = new Relocation(findSection(section), off, type, findSymbol(symbol), add);
+    Relocation *rel = new Relocation(section, off, type, symbol, add);
     relocations[nrelocations++] = rel;
     return rel;
 }
@@ -913,4 +1060,61 @@ void ElfLinkerX86::relocate1(const Relocation *rel, upx_byte *location, upx_uint
         super::relocate1(rel, location, value, type);
 }
 
+/*************************************************************************
+//
+**************************************************************************/
+
+namespace {
+struct TestElfLinker final : public ElfLinker {
+    using ElfLinker::getImage;
+    using ElfLinker::relocate;
+    virtual void relocate1(const Relocation *, upx_byte *location, upx_uint64_t value,
+                           const char *type) override {
+        assert(strcmp(type, "R_TEST_32") == 0);
+        set_le32(location, get_le32(location) + value);
+    }
+};
+} // namespace
+
+TEST_CASE("ElfLinker pre-parsed image") {
+    static const char stub[] = "ABCDEFGHabcd"
+                               "\nSections:\n"
+                               "Idx Name Size VMA LMA File off Algn\n"
+                               "  0 SECT1 00000008 00000000 00000000 00000000 2**0\n"
+                               "  1 SECT2 00000004 00000000 00000000 00000008 2**0\n"
+                               "SYMBOL TABLE:\n"
+                               "00000000 l    d  SECT1\t00000000 SECT1\n"
+                               "00000000 l    d  SECT2\t00000000 SECT2\n"
+                               "00000002 g       SECT2\t00000000 sym2\n"
+                               "00001234 g       *ABS*\t00000000 abs1\n"
+                               "\n"
+                               "RELOCATION RECORDS FOR [SECT1]:\n"
+                               "OFFSET   TYPE              VALUE\n"
+                               "00000004 R_TEST_32         sym2\n";
+    for (int pass = 0; pass < 2; pass++) {
+        TestElfLinker linker;
+        linker.init(stub, (int) sizeof(stub) - 1);
+        CHECK(TestElfLinker::getImage(stub, (int) sizeof(stub) - 1) ==
+              TestElfLinker::getImage(stub, (int) sizeof(stub) - 1));
+        linker.addLoader("SECT1,SECT2");
+        int len = 0;
+        CHECK(linker.getSection("SECT1", &len) == 0);
+        CHECK(len == 8);
+        CHECK(linker.getSection("SECT2", &len) == 8);
+        CHECK(len == 4);
+        CHECK(linker.getSymbolOffset("sym2") == 10);
+        linker.relocate();
+        int llen = 0;
+        const upx_byte *loader = linker.getLoader(&llen);
+        CHECK(llen == 12);
+        CHECK(memcmp(loader, "ABCD", 4) == 0);
+        CHECK(get_le32(loader + 4) == get_le32("EFGH") + 10);
+        CHECK(memcmp(loader + 8, "abcd", 4) == 0);
+        // sections added by packers are found through the index as well
+        linker.addSection("EXTRA", "xy", 2, 0);
+        CHECK(linker.getSectionSize("EXTRA") == 2);
+        CHECK_THROWS(linker.getSectionSize("MISSING"));
+    }
+}
+
 /* vim:set ts=4 sw=4 et: */
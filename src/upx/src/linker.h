@@ -28,6 +28,10 @@
 #ifndef __UPX_LINKER_H
 #define __UPX_LINKER_H 1
 
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
 /*************************************************************************
 // ElfLinker
 **************************************************************************/
@@ -41,8 +45,8 @@ protected:
     struct Section;
     struct Symbol;
     struct Relocation;
+    struct Image;
 
-    upx_byte *input = nullptr;
     int inputlen = 0;
     upx_byte *output = nullptr;
     int outputlen = 0;
@@ -64,16 +68,21 @@ protected:
 
     bool reloc_done = false;
 
+    // name -> Section/Symbol; keys point to the names owned by the values
+    std::unordered_map<std::string_view, Section *> section_index;
+    std::unordered_map<std::string_view, Symbol *> symbol_index;
+
 protected:
-    void preprocessSections(char *start, char const *end);
-    void preprocessSymbols(char *start, char const *end);
-    void preprocessRelocations(char *start, char const *end);
+    static const Image *getImage(const void *pdata, int plen);
     Section *findSection(const char *name, bool fatal = true) const;
     Symbol *findSymbol(const char *name, bool fatal = true) const;
 
     Symbol *addSymbol(const char *name, const char *section, upx_uint64_t offset);
+    Symbol *addSymbol(const char *name, Section *section, upx_uint64_t offset);
     Relocation *addRelocation(const char *section, unsigned off, const char *type,
                               const char *symbol, upx_uint64_t add);
+    Relocation *addRelocation(const Section *section, unsigned off, const char *type,
+                              const Symbol *symbol, upx_uint64_t add);
 
 public:
     ElfLinker();
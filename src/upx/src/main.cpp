@@ -575,6 +575,9 @@ static int do_option(int optc, const char *arg) {
     case 525: // --exact
         opt->exact = true;
         break;
+    case 530: // --threads=
+        getoptvar(&opt->threads, 0, 256, arg);
+        break;
     // CRP - Compression Runtime Parameters (undocumented and subject to change)
     case 801:
         getoptvar(&opt->crp.crp_ucl.c_flags, 0, 3, arg);
@@ -872,6 +875,7 @@ int main_get_options(int argc, char **argv) {
         {"filter", 0x31, N, 521}, // --filter=
         {"no-filter", 0x10, N, 522},
         {"small", 0x10, N, 520},
+        {"threads", 0x31, N, 530}, // --threads=
         // CRP - Compression Runtime Parameters (undocumented and subject to change)
         {"crp-nrv-cf", 0x31, N, 801},
         {"crp-nrv-sl", 0x31, N, 802},
@@ -1035,6 +1039,7 @@ void main_get_envoptions() {
 
         // compression settings
         {"exact", 0x10, N, 525}, // user requires byte-identical decompression
+        {"threads", 0x31, N, 530}, // --threads=
 
         // compression method
         {"nrv2b", 0x10, N, 702},   // --nrv2b
@@ -43,6 +43,7 @@ void options_t::reset() {
     o->method = M_NONE;
     o->level = -1;
     o->filter = FT_NONE;
+    o->threads = 1;
 
     o->backup = -1;
     o->overlay = -1;
@@ -148,6 +149,12 @@ TEST_CASE("getopt") {
         CHECK(opt->all_methods_use_lzma == -1);
         CHECK(opt->method == -1);
     }
+    SUBCASE("threads") {
+        const char *a[] = {a0, "--threads=4", nullptr};
+        CHECK(opt->threads == 1);
+        test_options(a);
+        CHECK(opt->threads == 4);
+    }
 
     opt = saved_opt;
 }
@@ -64,6 +64,7 @@ struct options_t final {
     bool no_filter;   // force no filter
     bool prefer_ucl;  // prefer UCL
     bool exact;       // user requires byte-identical decompression
+    int threads;      // worker threads for compression; 0 == number of CPUs
 
     // other options
     int backup;
@@ -81,6 +82,10 @@ struct options_t final {
     int small;
     int verbose;
     bool to_stdout;
+    // in-process packing (libupx.h): polled before each compression,
+    // the pack is abandoned with a CancelledException when it returns true
+    bool (*cancelled)(void *user);
+    void *cancelled_user;
 
     // debug options
     struct {
@@ -56,11 +56,12 @@ const int *PackTmt::getFilters() const {
     return filters;
 }
 
-unsigned PackTmt::findOverlapOverhead(const upx_bytep buf, const upx_bytep tbuf, unsigned range,
+unsigned PackTmt::findOverlapOverhead(const PackHeader &ph_, const upx_bytep buf,
+                                      const upx_bytep tbuf, unsigned range,
                                       unsigned upper_limit) const {
     // make sure the decompressor will be paragraph aligned
-    unsigned o = super::findOverlapOverhead(buf, tbuf, range, upper_limit);
-    o = ((o + 0x20) & ~0xf) - (ph.u_len & 0xf);
+    unsigned o = super::findOverlapOverhead(ph_, buf, tbuf, range, upper_limit);
+    o = ((o + 0x20) & ~0xf) - (ph_.u_len & 0xf);
     return o;
 }
 
@@ -56,8 +56,8 @@ public:
 protected:
     int readFileHeader();
 
-    virtual unsigned findOverlapOverhead(const upx_bytep buf, const upx_bytep tbuf,
-                                         unsigned range = 0,
+    virtual unsigned findOverlapOverhead(const PackHeader &ph_, const upx_bytep buf,
+                                         const upx_bytep tbuf, unsigned range = 0,
                                          unsigned upper_limit = ~0u) const override;
     virtual void buildLoader(const Filter *ft) override;
     virtual Linker *newLinker() const override;
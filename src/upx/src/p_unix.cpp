@@ -37,6 +37,8 @@
 #include "packer.h"
 #include "p_unix.h"
 #include "p_elf.h"
+#include "ui.h"
+#include "util/threads.h"
 
 // do not change
 #define BLOCKSIZE       (512*1024)
@@ -336,9 +338,122 @@ void PackUnix::packExtent(
         (void)l;
     }
     fi->seek(x.offset, SEEK_SET);
+#if (WITH_THREADS)
+    // Pipelined mode for --threads=N: this thread reads the blocks ahead,
+    // a pool of worker threads filters and compresses them, and this thread
+    // then merges the results and writes the blocks in order (see the
+    // "precomputed" parameter of compressWithFilters()).
+    // The output is identical to the serial mode.
+    struct Block {
+        int l = 0;
+        int filter_strategy = 0;
+        bool precomputed = false;
+        upx_bytep data = nullptr; // input; restored by the filters
+        upx_bytep out = nullptr;  // compressed data of all candidates
+        FilterCandidates xs;      // if (!ft): result of compress() in xs.v[0]
+        FilterScanCache scan_cache;
+        std::future<void> done;
+    };
+    unsigned const nthreads = upx_get_threads();
+    unsigned nslots = 0;
+    unsigned max_candidates = 1;
+    unsigned const o_size = MemBuffer::getSizeForCompression(blocksize);
+    unsigned slot_size = 0;
+    if (nthreads > 1 && x.size > (off_t)blocksize
+    &&  !(is_forced_method(ph.method) && opt->all_methods)) { // else methods change per block
+        if (ft) {
+            FilterCandidates tmp;
+            prepareFilterCandidates(tmp, ph, *ft, getStrategy(*ft), blocksize, 0, blocksize);
+            max_candidates = (unsigned) tmp.v.size();
+        }
+        slot_size = mem_size(o_size, max_candidates, blocksize);
+        nslots = nthreads + 2; // keep the workers busy while this thread writes
+        while (nslots > 1 && !mem_size_valid(slot_size, nslots))
+            nslots--;
+        if (nslots <= 1)
+            nslots = 0;
+    }
+    MemBuffer pipe_buf;
+    std::vector<Block> blocks(nslots);
+    if (nslots) {
+        pipe_buf.alloc(mem_size(slot_size, nslots));
+        for (unsigned i = 0; i < nslots; i++) {
+            blocks[i].data = pipe_buf + mem_size(slot_size, i);
+            blocks[i].out = blocks[i].data + blocksize;
+        }
+        (void) Filter::isValidFilter(0); // init the static filter_map in this thread
+    }
+    ThreadPool pool(nslots ? nthreads : 0); // must get destroyed before blocks[]
+    unsigned n_read = 0;
+    unsigned n_written = 0;
+    off_t read_rest = x.size;
+    bool read_eof = false;
+    auto readAhead = [&]() {
+        while (n_read - n_written < nslots && read_rest != 0 && !read_eof) {
+            Block &b = blocks[n_read % nslots];
+            b.filter_strategy = ft ? getStrategy(*ft) : 0;
+            b.l = fi->readx(b.data, UPX_MIN(read_rest, (off_t)blocksize));
+            if (b.l == 0) {
+                read_eof = true;
+                break;
+            }
+            read_rest -= b.l;
+            n_read++;
+            b.precomputed = false;
+            if (ft) {
+                b.scan_cache.reset();
+                Filter bft = *ft;
+                bft.scan_cache = &b.scan_cache;
+                prepareFilterCandidates(b.xs, ph, bft, b.filter_strategy, b.l, 0, b.l);
+                if (b.xs.v.size() > max_candidates)
+                    continue; // does not fit - compress in this thread when writing
+            }
+            else {
+                b.xs.v.clear();
+                b.xs.v.emplace_back(ph, Filter(ph.level));
+            }
+            b.precomputed = true;
+            b.done = pool.submit([this, &b, ft, o_size]() {
+                if (ft) {
+                    for (unsigned i = 0; i < b.xs.v.size(); i++)
+                        compressFilterCandidate(b.xs.v[i], b.xs, b.data, b.out + o_size * i,
+                                                OVERHEAD, NULL_cconf);
+                }
+                else {
+                    FilterCandidate &c = b.xs.v[0];
+                    c.ph.u_adler = c.ph.c_adler = upx_adler32(nullptr, 0); // block-local
+                    c.c_ptr = b.out;
+                    c.compressed = compress(c.ph, b.data, b.l, b.out, NULL_cconf, nullptr);
+                }
+            });
+        }
+    };
+#endif
     for (off_t rest = x.size; 0 != rest; ) {
-        int const filter_strategy = ft ? getStrategy(*ft) : 0;
-        int l = fi->readx(ibuf, UPX_MIN(rest, (off_t)blocksize));
+        int filter_strategy;
+        int l;
+        FilterCandidates *precomputed = nullptr;
+#if (WITH_THREADS)
+        if (nslots) {
+            readAhead();
+            if (n_written == n_read) {
+                break;
+            }
+            Block &b = blocks[n_written++ % nslots];
+            if (b.precomputed) {
+                b.done.get(); // rethrows any exception of the worker
+                precomputed = &b.xs;
+            }
+            filter_strategy = b.filter_strategy;
+            l = b.l;
+            memcpy(ibuf, b.data, l);
+        }
+        else
+#endif
+        {
+            filter_strategy = ft ? getStrategy(*ft) : 0;
+            l = fi->readx(ibuf, UPX_MIN(rest, (off_t)blocksize));
+        }
         if (l == 0) {
             break;
         }
@@ -365,7 +480,18 @@ void PackUnix::packExtent(
             ft->cto = 0;
 
             compressWithFilters(ft, OVERHEAD, NULL_cconf, filter_strategy,
-                                0, 0, 0, hdr_ibuf, hdr_u_len, inhibit_compression_check);
+                                0, 0, 0, hdr_ibuf, hdr_u_len, inhibit_compression_check,
+                                precomputed);
+        }
+        else if (precomputed && precomputed->v[0].ph.method == ph.method
+             &&  precomputed->v[0].ph.level == ph.level) {
+            // compressed by a worker thread; same as compress() below
+            const FilterCandidate &c = precomputed->v[0];
+            ph_mergeCompressResult(ph, c.ph, c.compressed);
+            if (ph.c_len < ph.u_len)
+                memcpy(obuf, c.c_ptr, ph.c_len);
+            if (uip->ui_pass >= 0)
+                uip->ui_pass++;
         }
         else {
             (void) compress(ibuf, ph.u_len, obuf);    // ignore return value
@@ -462,6 +588,22 @@ unsigned PackUnix::unpackExtent(unsigned wanted, OutputFile *fo,
     int is_rewrite // 0(false): write; 1(true): rewrite; -1: no write
 )
 {
+#if (WITH_THREADS)
+    // Extents of several blocks get indexed first and then decompressed in
+    // parallel. Anything unusual (peeking, rewriting, a chain that does not
+    // add up to 'wanted') takes the serial loop below, which also reports
+    // any errors exactly as before.
+    if (!is_rewrite && wanted > blocksize && upx_get_threads() > 1) {
+        upx_off_t const pos = fi->tell();
+        BlockIndex index;
+        if (indexExtent(index, wanted, first_PF_X, szb_info) && index.size() > 1) {
+            unpackIndexedExtent(index, fo, c_adler, u_adler);
+            return 0;
+        }
+        fi->seek(pos, SEEK_SET);
+    }
+#endif
+
     b_info hdr; memset(&hdr, 0, sizeof(hdr));
     unsigned inlen = 0; // output index (if-and-only-if peeking)
     while (wanted) {
@@ -539,6 +681,136 @@ unsigned PackUnix::unpackExtent(unsigned wanted, OutputFile *fo,
     return inlen;
 }
 
+// Walks the b_info chain of an extent of 'wanted' bytes, starting at the
+// current position of 'fi', and seeks past it. Returns false if the chain
+// does not describe exactly 'wanted' bytes; does not throw on corrupt
+// headers, so that unpackExtent() can report them in order.
+bool PackUnix::indexExtent(BlockIndex &index, unsigned wanted,
+    bool first_PF_X, unsigned szb_info)
+{
+    index.clear();
+    b_info hdr; memset(&hdr, 0, sizeof(hdr));
+    upx_off_t pos = fi->tell();
+    upx_off_t const end = fi->st_size();
+    while (wanted) {
+        if (end - pos < (upx_off_t)szb_info)
+            return false;
+        fi->readx(&hdr, szb_info);
+        pos += szb_info;
+        int const sz_unc = get_te32(&hdr.sz_unc);
+        int const sz_cpr = get_te32(&hdr.sz_cpr);
+        if (sz_unc <= 0 || sz_cpr <= 0 || sz_cpr > sz_unc || sz_unc > (int)blocksize
+        ||  (unsigned)sz_unc > wanted || end - pos < sz_cpr)
+            return false;
+
+        BlockIndexEntry e;
+        e.c_offset = pos;
+        e.sz_unc = sz_unc;
+        e.sz_cpr = sz_cpr;
+        e.ftid = 0;
+        e.b_cto8 = hdr.b_cto8;
+        if (sz_cpr < sz_unc) { // same filter choice as unpackExtent()
+            if (12==szb_info)
+                e.ftid = hdr.b_ftid;
+            else if (first_PF_X)
+                first_PF_X = false;
+            else
+                e.ftid = ph.filter;
+        }
+        index.push_back(e);
+
+        fi->seek(sz_cpr, SEEK_CUR);
+        pos += sz_cpr;
+        wanted -= sz_unc;
+    }
+    return true;
+}
+
+void PackUnix::unpackIndexedExtent(BlockIndex const &index, OutputFile *fo,
+    unsigned &c_adler, unsigned &u_adler)
+{
+#if (WITH_THREADS)
+    // Same pipeline as packExtent(): this thread reads ahead into a ring of
+    // slots, the pool decompresses, unfilters and checksums each block, and
+    // this thread then combines the checksums and writes in order.
+    struct Slot {
+        unsigned c_adler = 0;
+        unsigned u_adler = 0;
+        std::future<void> done;
+    };
+    unsigned const n = (unsigned) index.size();
+    unsigned const nthreads = upx_get_threads();
+    unsigned const slot_size = blocksize + OVERHEAD;
+    unsigned nslots = UPX_MIN(n, nthreads + 2); // keep the workers busy while writing
+    while (nslots > 1 && !mem_size_valid(slot_size, nslots))
+        nslots--;
+    MemBuffer pipe_buf(mem_size(slot_size, nslots));
+    std::vector<Slot> slots(nslots);
+    PackHeader const orig_ph = ph;
+    (void) Filter::isValidFilter(0); // init the static filter_map in this thread
+    ThreadPool pool(nthreads); // must get destroyed before slots[]
+
+    unsigned n_read = 0;
+    unsigned n_written = 0;
+    auto readAhead = [&]() {
+        while (n_read < n && n_read - n_written < nslots) {
+            BlockIndexEntry const &e = index[n_read];
+            Slot &s = slots[n_read % nslots];
+            upx_bytep const buf = pipe_buf + mem_size(slot_size, n_read % nslots);
+            // place the input for overlapping de-compression
+            upx_bytep const cbuf = buf + (slot_size - e.sz_cpr);
+            fi->seek(e.c_offset, SEEK_SET);
+            fi->readx(cbuf, e.sz_cpr);
+            n_read++;
+            s.done = pool.submit([&e, &s, &orig_ph, buf, cbuf]() {
+                s.c_adler = upx_adler32(cbuf, e.sz_cpr);
+                if (e.sz_cpr < e.sz_unc) { // block was compressed
+                    PackHeader bph = orig_ph;
+                    bph.u_len = e.sz_unc;
+                    bph.c_len = e.sz_cpr;
+                    bph.filter_cto = e.b_cto8;
+                    ph_decompress(bph, cbuf, buf, false, nullptr);
+                    if (e.ftid) {
+                        Filter ft(bph.level);
+                        ft.init(e.ftid, 0);
+                        ft.cto = e.b_cto8;
+                        ft.unfilter(buf, e.sz_unc);
+                    }
+                }
+                else { // slide literal (non-compressible) block
+                    memmove(buf, cbuf, e.sz_unc);
+                }
+                s.u_adler = upx_adler32(buf, e.sz_unc);
+            });
+        }
+    };
+    while (n_written < n) {
+        readAhead();
+        BlockIndexEntry const &e = index[n_written];
+        Slot &s = slots[n_written % nslots];
+        s.done.get(); // rethrows any exception of the worker
+        c_adler = upx_adler32_combine(c_adler, s.c_adler, e.sz_cpr);
+        u_adler = upx_adler32_combine(u_adler, s.u_adler, e.sz_unc);
+        total_in += e.sz_cpr;
+        if (fo) {
+            fo->write(pipe_buf + mem_size(slot_size, n_written % nslots), e.sz_unc);
+            total_out += e.sz_unc;
+        }
+        n_written++;
+    }
+
+    // leave ph and fi as the serial loop does
+    BlockIndexEntry const &last = index.back();
+    ph.u_len = last.sz_unc;
+    ph.c_len = last.sz_cpr;
+    ph.filter_cto = last.b_cto8;
+    fi->seek(last.c_offset + last.sz_cpr, SEEK_SET);
+#else
+    UNUSED(index); UNUSED(fo); UNUSED(c_adler); UNUSED(u_adler);
+    throwInternalError("unpackIndexedExtent");
+#endif
+}
+
 /*************************************************************************
 // Generic Unix canUnpack().
 **************************************************************************/
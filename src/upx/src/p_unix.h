@@ -85,6 +85,21 @@ protected:
         bool first_PF_X, unsigned szb_info,
         int is_rewrite = false  // 0(false): write; 1(true): rewrite; -1: no write
         );
+    // Index of the b_info chain of an extent: only the headers get read, so
+    // unpack and test can see the whole extent before decompressing it.
+    struct BlockIndexEntry {
+        upx_off_t c_offset;  // file offset of the compressed data
+        unsigned sz_unc;
+        unsigned sz_cpr;
+        int ftid;  // filter to undo after decompression, or 0
+        unsigned char b_cto8;
+    };
+    typedef std::vector<BlockIndexEntry> BlockIndex;
+    virtual bool indexExtent(BlockIndex &index, unsigned wanted,
+        bool first_PF_X, unsigned szb_info);
+    // decompress, unfilter and checksum in parallel; write in order
+    virtual void unpackIndexedExtent(BlockIndex const &index, OutputFile *fo,
+        unsigned &c_adler, unsigned &u_adler);
     unsigned total_in, total_out;  // unpack
 
     int exetype;
@@ -31,6 +31,7 @@
 #include "filter.h"
 #include "linker.h"
 #include "ui.h"
+#include "util/threads.h"
 
 /*************************************************************************
 //
@@ -181,19 +182,25 @@ int forced_method(int method) // extract the forced method
 
 bool Packer::compress(SPAN_P(upx_byte) i_ptr, unsigned i_len, SPAN_P(upx_byte) o_ptr,
                       const upx_compress_config_t *cconf_parm) {
-    ph.u_len = i_len;
-    ph.c_len = 0;
-    assert(ph.level >= 1);
-    assert(ph.level <= 10);
+    return compress(ph, i_ptr, i_len, o_ptr, cconf_parm, uip);
+}
+
+bool Packer::compress(PackHeader &ph_, SPAN_P(upx_byte) i_ptr, unsigned i_len,
+                      SPAN_P(upx_byte) o_ptr, const upx_compress_config_t *cconf_parm,
+                      UiPacker *ui) const {
+    ph_.u_len = i_len;
+    ph_.c_len = 0;
+    assert(ph_.level >= 1);
+    assert(ph_.level <= 10);
 
     // Avoid too many progress bar updates. 64 is s->bar_len in ui.cpp.
-    unsigned step = (ph.u_len < 64 * 1024) ? 0 : ph.u_len / 64;
+    unsigned step = (ph_.u_len < 64 * 1024) ? 0 : ph_.u_len / 64;
 
     // save current checksums
-    ph.saved_u_adler = ph.u_adler;
-    ph.saved_c_adler = ph.c_adler;
+    ph_.saved_u_adler = ph_.u_adler;
+    ph_.saved_c_adler = ph_.c_adler;
     // update checksum of uncompressed data
-    ph.u_adler = upx_adler32(raw_bytes(i_ptr, ph.u_len), ph.u_len, ph.u_adler);
+    ph_.u_adler = upx_adler32(raw_bytes(i_ptr, ph_.u_len), ph_.u_len, ph_.u_adler);
 
     // set compression parameters
     upx_compress_config_t cconf;
@@ -201,7 +208,7 @@ bool Packer::compress(SPAN_P(upx_byte) i_ptr, unsigned i_len, SPAN_P(upx_byte) o
     if (cconf_parm)
         cconf = *cconf_parm;
     // cconf options
-    int method = forced_method(ph.method);
+    int method = forced_method(ph_.method);
     if (M_IS_NRV2B(method) || M_IS_NRV2D(method) || M_IS_NRV2E(method)) {
         if (opt->crp.crp_ucl.c_flags != -1)
             cconf.conf_ucl.c_flags = opt->crp.crp_ucl.c_flags;
@@ -216,7 +223,7 @@ bool Packer::compress(SPAN_P(upx_byte) i_ptr, unsigned i_len, SPAN_P(upx_byte) o
             opt->crp.crp_ucl.max_match < cconf.conf_ucl.max_match)
             cconf.conf_ucl.max_match = opt->crp.crp_ucl.max_match;
 #if (WITH_NRV)
-        if (ph.level >= 7 || (ph.level >= 4 && ph.u_len >= 512 * 1024))
+        if (ph_.level >= 7 || (ph_.level >= 4 && ph_.u_len >= 512 * 1024))
             step = 0;
 #endif
     }
@@ -232,19 +239,23 @@ bool Packer::compress(SPAN_P(upx_byte) i_ptr, unsigned i_len, SPAN_P(upx_byte) o
         oassign(cconf.conf_zlib.window_bits, opt->crp.crp_zlib.window_bits);
         oassign(cconf.conf_zlib.strategy, opt->crp.crp_zlib.strategy);
     }
-    if (uip->ui_pass >= 0)
-        uip->ui_pass++;
-    uip->startCallback(ph.u_len, step, uip->ui_pass, uip->ui_total_passes);
-    uip->firstCallback();
+    if (ui) {
+        if (ui->ui_pass >= 0)
+            ui->ui_pass++;
+        ui->startCallback(ph_.u_len, step, ui->ui_pass, ui->ui_total_passes);
+        ui->firstCallback();
+    }
 
-    // OutputFile::dump("data.raw", in, ph.u_len);
+    // OutputFile::dump("data.raw", in, ph_.u_len);
 
     // compress
-    int r = upx_compress(raw_bytes(i_ptr, ph.u_len), ph.u_len, raw_bytes(o_ptr, 0), &ph.c_len,
-                         uip->getCallback(), method, ph.level, &cconf, &ph.compress_result);
+    int r = upx_compress(raw_bytes(i_ptr, ph_.u_len), ph_.u_len, raw_bytes(o_ptr, 0), &ph_.c_len,
+                         ui ? ui->getCallback() : nullptr, method, ph_.level, &cconf,
+                         &ph_.compress_result);
 
-    // uip->finalCallback(ph.u_len, ph.c_len);
-    uip->endCallback();
+    // ui->finalCallback(ph_.u_len, ph_.c_len);
+    if (ui)
+        ui->endCallback();
 
     if (r == UPX_E_OUT_OF_MEMORY)
         throwOutOfMemoryException();
@@ -252,52 +263,77 @@ bool Packer::compress(SPAN_P(upx_byte) i_ptr, unsigned i_len, SPAN_P(upx_byte) o
         throwInternalError("compression failed");
 
     if (M_IS_NRV2B(method) || M_IS_NRV2D(method) || M_IS_NRV2E(method)) {
-        const ucl_uint *res = ph.compress_result.result_ucl.result;
-        // ph.min_offset_found = res[0];
-        ph.max_offset_found = res[1];
-        // ph.min_match_found = res[2];
-        ph.max_match_found = res[3];
-        // ph.min_run_found = res[4];
-        ph.max_run_found = res[5];
-        ph.first_offset_found = res[6];
-        // ph.same_match_offsets_found = res[7];
+        const ucl_uint *res = ph_.compress_result.result_ucl.result;
+        // ph_.min_offset_found = res[0];
+        ph_.max_offset_found = res[1];
+        // ph_.min_match_found = res[2];
+        ph_.max_match_found = res[3];
+        // ph_.min_run_found = res[4];
+        ph_.max_run_found = res[5];
+        ph_.first_offset_found = res[6];
+        // ph_.same_match_offsets_found = res[7];
         if (cconf_parm) {
             assert(cconf.conf_ucl.max_offset == 0 ||
-                   cconf.conf_ucl.max_offset >= ph.max_offset_found);
-            assert(cconf.conf_ucl.max_match == 0 || cconf.conf_ucl.max_match >= ph.max_match_found);
+                   cconf.conf_ucl.max_offset >= ph_.max_offset_found);
+            assert(cconf.conf_ucl.max_match == 0 ||
+                   cconf.conf_ucl.max_match >= ph_.max_match_found);
         }
     }
 
-    // printf("\nPacker::compress: %d/%d: %7d -> %7d\n", method, ph.level, ph.u_len, ph.c_len);
-    if (!checkCompressionRatio(ph.u_len, ph.c_len))
+    // printf("\nPacker::compress: %d/%d: %7d -> %7d\n", method, ph_.level, ph_.u_len,
+    //        ph_.c_len);
+    if (!checkCompressionRatio(ph_.u_len, ph_.c_len))
         return false;
     // return in any case if not compressible
-    if (ph.c_len >= ph.u_len)
+    if (ph_.c_len >= ph_.u_len)
         return false;
 
     // update checksum of compressed data
-    ph.c_adler = upx_adler32(raw_bytes(o_ptr, ph.c_len), ph.c_len, ph.c_adler);
+    ph_.c_adler = upx_adler32(raw_bytes(o_ptr, ph_.c_len), ph_.c_len, ph_.c_adler);
     // Decompress and verify. Skip this when using the fastest level.
-    if (!ph_skipVerify(ph)) {
+    if (!ph_skipVerify(ph_)) {
         // decompress
-        unsigned new_len = ph.u_len;
-        r = upx_decompress(raw_bytes(o_ptr, ph.c_len), ph.c_len, raw_bytes(i_ptr, ph.u_len),
-                           &new_len, method, &ph.compress_result);
+        unsigned new_len = ph_.u_len;
+        r = upx_decompress(raw_bytes(o_ptr, ph_.c_len), ph_.c_len, raw_bytes(i_ptr, ph_.u_len),
+                           &new_len, method, &ph_.compress_result);
         if (r == UPX_E_OUT_OF_MEMORY)
             throwOutOfMemoryException();
-        // printf("%d %d: %d %d %d\n", method, r, ph.c_len, ph.u_len, new_len);
+        // printf("%d %d: %d %d %d\n", method, r, ph_.c_len, ph_.u_len, new_len);
         if (r != UPX_E_OK)
             throwInternalError("decompression failed");
-        if (new_len != ph.u_len)
+        if (new_len != ph_.u_len)
             throwInternalError("decompression failed (size error)");
 
         // verify decompression
-        if (ph.u_adler != upx_adler32(raw_bytes(i_ptr, ph.u_len), ph.u_len, ph.saved_u_adler))
+        if (ph_.u_adler !=
+            upx_adler32(raw_bytes(i_ptr, ph_.u_len), ph_.u_len, ph_.saved_u_adler))
             throwInternalError("decompression failed (checksum error)");
     }
     return true;
 }
 
+// Merge the result of compress() which was called with a copy x of the
+// PackHeader, but with block-local checksums (i.e. x.u_adler and x.c_adler
+// started at 1), so that compress() can run ahead in a worker thread.
+void ph_mergeCompressResult(PackHeader &ph, const PackHeader &x, bool compressed) {
+    assert(x.method == ph.method);
+    ph.u_len = x.u_len;
+    ph.c_len = x.c_len;
+    ph.saved_u_adler = ph.u_adler;
+    ph.saved_c_adler = ph.c_adler;
+    ph.u_adler = upx_adler32_combine(ph.u_adler, x.u_adler, x.u_len);
+    if (compressed) // see compress() above
+        ph.c_adler = upx_adler32_combine(ph.c_adler, x.c_adler, x.c_len);
+    ph.compress_result = x.compress_result;
+    const int method = forced_method(ph.method);
+    if (M_IS_NRV2B(method) || M_IS_NRV2D(method) || M_IS_NRV2E(method)) {
+        ph.max_offset_found = x.max_offset_found;
+        ph.max_match_found = x.max_match_found;
+        ph.max_run_found = x.max_run_found;
+        ph.first_offset_found = x.first_offset_found;
+    }
+}
+
 #if 0
 bool Packer::compress(upx_bytep in, upx_bytep out,
                       const upx_compress_config_t *cconf)
@@ -454,6 +490,23 @@ void Packer::verifyOverlappingDecompression(upx_bytep o_ptr, unsigned o_size, Fi
     decompress(o_ptr + offset, o_ptr, true, ft);
 }
 
+// Single-pass variant of the search below: decompress once and compute
+// the smallest overhead directly. Return 0 if the method is not supported.
+static unsigned ph_findOverlapOverhead(const PackHeader &ph, const upx_bytep buf,
+                                       const upx_bytep tbuf) {
+    if (ph.c_len >= ph.u_len)
+        return 0;
+    unsigned overhead = 0;
+    int r = upx_find_overlap(buf, ph.c_len, tbuf, ph.u_len, &overhead, forced_method(ph.method));
+    if (r != UPX_E_OK)
+        return 0;
+    // see the adjustments in ph_testOverlappingDecompression()
+    unsigned extra = 0;
+    if (M_IS_NRV2B(ph.method) || M_IS_NRV2D(ph.method) || M_IS_NRV2E(ph.method))
+        extra = 3;
+    return UPX_MAX(overhead, 5u) + extra;
+}
+
 /*************************************************************************
 // Find overhead for in-place decompression in a heuristic way
 // (using a binary search). Return 0 on error.
@@ -462,27 +515,43 @@ void Packer::verifyOverlappingDecompression(upx_bytep o_ptr, unsigned o_size, Fi
 //   - you can pass the range of an acceptable interval (so that
 //     we can succeed early)
 //   - you can enforce an upper_limit (so that we can fail early)
+//
+// For NRV and LZMA the exact value is computed by decompressing once
+// and confirmed by testing it and the value below it; the search is
+// only a fallback.
 **************************************************************************/
 
-unsigned Packer::findOverlapOverhead(const upx_bytep buf, const upx_bytep tbuf, unsigned range,
+unsigned Packer::findOverlapOverhead(const PackHeader &ph_, const upx_bytep buf,
+                                     const upx_bytep tbuf, unsigned range,
                                      unsigned upper_limit) const {
     assert((int) range >= 0);
 
     // prepare to deal with very pessimistic values
     unsigned low = 1;
-    unsigned high = UPX_MIN(ph.u_len + 512, upper_limit);
+    unsigned high = UPX_MIN(ph_.u_len + 512, upper_limit);
     // but be optimistic for first try (speedup)
     unsigned m = UPX_MIN(16u, high);
     //
     unsigned overhead = 0;
     unsigned nr = 0; // statistics
 
+    // "exact" is used only if upx_test_overlap() agrees that it is the
+    // smallest working value; otherwise the analysis is out of sync with
+    // the decompressor and we do the full search
+    const unsigned exact = ph_findOverlapOverhead(ph_, buf, tbuf);
+    if (exact > low && exact <= high) {
+        nr += 2;
+        if (ph_testOverlappingDecompression(ph_, buf, tbuf, exact) &&
+            !ph_testOverlappingDecompression(ph_, buf, tbuf, exact - 1))
+            return exact;
+    }
+
     while (high >= low) {
         assert(m >= low);
         assert(m <= high);
         assert(m < overhead || overhead == 0);
         nr++;
-        bool success = testOverlappingDecompression(buf, tbuf, m);
+        bool success = ph_testOverlappingDecompression(ph_, buf, tbuf, m);
         // printf("testOverlapOverhead(%d): %d %d: %d -> %d\n", nr, low, high, m, (int)success);
         if (success) {
             overhead = m;
@@ -836,7 +905,7 @@ unsigned Packer::optimizeReloc(SPAN_P(upx_byte) in, unsigned relocnum, SPAN_P(up
     *big = 0;
     if (relocnum == 0)
         return 0;
-    qsort(raw_bytes(in, 4 * relocnum), relocnum, 4, le32_compare);
+    sort_le32(raw_bytes(in, 4 * relocnum), relocnum);
 
     unsigned jc, pc, oc;
     SPAN_P_VAR(upx_byte, fix, out);
@@ -1232,6 +1301,110 @@ done:
     return nfilters;
 }
 
+/*************************************************************************
+// parallel support for compressWithFilters()
+**************************************************************************/
+
+void Packer::prepareFilterCandidates(FilterCandidates &xs, const PackHeader &ph_,
+                                     const Filter &ft_, int filter_strategy, unsigned i_len,
+                                     unsigned f_off, unsigned f_len) const {
+    xs.nmethods = prepareMethods(xs.methods, ph_.method, getCompressionMethods(M_ALL, ph_.level));
+    assert(xs.nmethods > 0);
+    assert(xs.nmethods < 256);
+    xs.nfilters = prepareFilters(xs.filters, filter_strategy, getFilters());
+    assert(xs.nfilters > 0);
+    assert(xs.nfilters < 256);
+    xs.filter_strategy = filter_strategy;
+    xs.addvalue = ft_.addvalue;
+    xs.i_len = i_len;
+    xs.f_off = f_off;
+    xs.f_len = f_len;
+    // same order as the serial loop in compressWithFilters()
+    xs.v.clear();
+    for (int mm = 0; mm < xs.nmethods; mm++) {
+        for (int ff = 0; ff < xs.nfilters; ff++) {
+            xs.v.emplace_back(ph_, ft_);
+            FilterCandidate &x = xs.v.back();
+            x.mm = mm;
+            x.ff_first = ff;
+            x.ff_last = ff + 1;
+            if (filter_strategy < 0) {
+                // one candidate per method: the first working filter
+                x.ff_last = xs.nfilters;
+                break;
+            }
+        }
+    }
+}
+
+// NOTE: this must be thread-safe; the results get merged by compressWithFilters()
+void Packer::compressFilterCandidate(FilterCandidate &x, const FilterCandidates &xs,
+                                     upx_bytep i_ptr, upx_bytep o_ptr, unsigned overlap_range,
+                                     upx_compress_config_t const *cconf) const {
+    const PackHeader orig_ph = x.ph;
+    const Filter orig_ft = x.ft;
+    upx_bytep const f_ptr = i_ptr + xs.f_off;
+    for (int ff = x.ff_first; ff < x.ff_last; ff++) {
+        assert(isValidFilter(xs.filters[ff]));
+        // get fresh packheader with block-local checksums
+        x.ph = orig_ph;
+        x.ph.method = xs.methods[x.mm];
+        x.ph.filter = xs.filters[ff];
+        x.ph.overlap_overhead = 0;
+        x.ph.u_adler = x.ph.c_adler = upx_adler32(nullptr, 0);
+        // get fresh filter
+        x.ft = orig_ft;
+        x.ft.init(x.ph.filter, xs.addvalue);
+        // filter
+        optimizeFilter(&x.ft, f_ptr, xs.f_len);
+        bool success = x.ft.filter(f_ptr, xs.f_len);
+        if (x.ft.id != 0 && x.ft.calls == 0)
+            success = false; // filter did not do anything
+        if (!success) {
+            x.nfilters_skipped++;
+            continue;
+        }
+        x.filtered = true;
+        x.ph.filter_cto = x.ft.cto;
+        x.ph.n_mru = x.ft.n_mru;
+        // compress
+        x.c_ptr = o_ptr;
+        x.compressed = compress(x.ph, i_ptr, xs.i_len, o_ptr, cconf, nullptr);
+        if (x.compressed) {
+            try {
+                x.ph.overlap_overhead = findOverlapOverhead(x.ph, o_ptr, i_ptr, overlap_range);
+            } catch (...) {
+                // only relevant if compressWithFilters() does not prune this candidate
+                x.overlap_error = std::current_exception();
+            }
+        }
+        // restore - unfilter with verify
+        Filter tmp_ft = x.ft;
+        tmp_ft.unfilter(f_ptr, xs.f_len, true);
+        break;
+    }
+}
+
+// Compare a compression result with the best result so far: prefer a smaller
+// total size, then smaller loaders, then less overlap_overhead.
+static bool isBetterCandidate(const PackHeader &ph, unsigned lsize, unsigned hdr_c_len,
+                              const PackHeader &best_ph, unsigned best_lsize,
+                              unsigned best_hdr_c_len) {
+    if (ph.c_len + lsize + hdr_c_len < best_ph.c_len + best_lsize + best_hdr_c_len)
+        return true;
+    if (ph.c_len + lsize + hdr_c_len == best_ph.c_len + best_lsize + best_hdr_c_len) {
+        // prefer smaller loaders
+        if (lsize + hdr_c_len < best_lsize + best_hdr_c_len)
+            return true;
+        if (lsize + hdr_c_len == best_lsize + best_hdr_c_len) {
+            // prefer less overlap_overhead
+            if (ph.overlap_overhead < best_ph.overlap_overhead)
+                return true;
+        }
+    }
+    return false;
+}
+
 void Packer::compressWithFilters(upx_bytep i_ptr,
                                  unsigned const i_len,  // written and restored by filters
                                  upx_bytep const o_ptr, // where to put compressed output
@@ -1242,12 +1415,19 @@ void Packer::compressWithFilters(upx_bytep i_ptr,
                                  unsigned const overlap_range,
                                  upx_compress_config_t const *const cconf,
                                  int filter_strategy, // in+out for prepareFilters
-                                 bool const inhibit_compression_check) {
+                                 bool const inhibit_compression_check,
+                                 FilterCandidates *const precomputed) {
+    const int parm_filter_strategy = filter_strategy;
     parm_ft->buf_len = f_len;
     // struct copies
     const PackHeader orig_ph = this->ph;
     PackHeader best_ph = this->ph;
-    const Filter orig_ft = *parm_ft;
+    // the filters restore f_ptr[] after each try, so all of them can share
+    // the results of the cto scan
+    FilterScanCache scan_cache;
+    Filter tmp_ft = *parm_ft;
+    tmp_ft.scan_cache = &scan_cache;
+    const Filter orig_ft = tmp_ft;
     Filter best_ft = *parm_ft;
     //
     best_ph.c_len = i_len;
@@ -1292,116 +1472,226 @@ void Packer::compressWithFilters(upx_bytep i_ptr,
 
     // compress using all methods/filters
     int nfilters_success_total = 0;
-    for (int mm = 0; mm < nmethods; mm++) // for all methods
-    {
-#if 0  //{
-        printf("\nmethod %d (%d of %d)\n", methods[mm], 1+ mm, nmethods);
-#endif //}
-        assert(isValidCompressionMethod(methods[mm]));
-        unsigned hdr_c_len = 0;
-        if (hdr_ptr != nullptr && hdr_len) {
-            if (nfilters_success_total != 0 && o_tmp == o_ptr) {
-                // do not overwrite o_ptr
-                o_tmp_buf.allocForCompression(UPX_MAX(hdr_len, i_len));
-                o_tmp = o_tmp_buf;
+
+    // The candidates can be tried in parallel: either they have already been
+    // compressed by the caller (see PackUnix::packExtent), or they get
+    // compressed here if requested and if we can afford a work slot per
+    // thread (a private copy of i_ptr[], written by the filters, and a
+    // compression buffer).
+    FilterCandidates *xs = nullptr;
+    FilterCandidates local_xs;
+    unsigned nslots = 0;
+    unsigned slot_size = 0;
+    if (precomputed != nullptr) {
+        // must match the current state, else we silently fall back
+        const FilterCandidates &p = *precomputed;
+        if (p.nmethods == nmethods && p.nfilters == nfilters &&
+            p.filter_strategy == filter_strategy && p.addvalue == orig_ft.addvalue &&
+            p.i_len == i_len && f_ptr == i_ptr + p.f_off && p.f_len == f_len &&
+            memcmp(p.methods, methods, sizeof(methods[0]) * nmethods) == 0 &&
+            memcmp(p.filters, filters, sizeof(filters[0]) * nfilters) == 0)
+            xs = precomputed;
+    } else if (f_ptr >= i_ptr && f_ptr + f_len <= i_ptr + i_len && upx_get_threads() > 1) {
+        prepareFilterCandidates(local_xs, orig_ph, orig_ft, parm_filter_strategy, i_len,
+                                ptr_udiff_bytes(f_ptr, i_ptr), f_len);
+        const unsigned n = (unsigned) local_xs.v.size();
+        nslots = UPX_MIN(upx_get_threads(), n);
+        slot_size = mem_size(1, i_len, MemBuffer::getSizeForCompression(i_len));
+        while (nslots > 1 && !mem_size_valid(slot_size, nslots))
+            nslots--;
+        if (nslots > 1)
+            xs = &local_xs;
+    }
+
+    if (xs != nullptr) {
+        // Only filtering, compression and findOverlapOverhead() run in the
+        // worker threads; buildLoader() modifies the linker and therefore runs
+        // in this thread when the results are merged in the serial order, so
+        // the output is identical to the serial loop below.
+        unsigned hdr_c_lens[256];
+        int nfilters_success_mm[256];
+        MemBuffer hdr_buf;
+        if (hdr_ptr != nullptr && hdr_len)
+            hdr_buf.allocForCompression(hdr_len);
+        for (int mm = 0; mm < nmethods; mm++) {
+            assert(isValidCompressionMethod(methods[mm]));
+            hdr_c_lens[mm] = 0;
+            nfilters_success_mm[mm] = 0;
+            if (hdr_ptr != nullptr && hdr_len) {
+                int r = upx_compress(hdr_ptr, hdr_len, hdr_buf, &hdr_c_lens[mm], nullptr,
+                                     methods[mm], 10, nullptr, nullptr);
+                if (r != UPX_E_OK)
+                    throwInternalError("header compression failed");
+                if (hdr_c_lens[mm] >= hdr_len)
+                    throwInternalError("header compression size increase");
             }
-            int r = upx_compress(hdr_ptr, hdr_len, o_tmp, &hdr_c_len, nullptr, methods[mm], 10,
-                                 nullptr, nullptr);
-            if (r != UPX_E_OK)
-                throwInternalError("header compression failed");
-            if (hdr_c_len >= hdr_len)
-                throwInternalError("header compression size increase");
         }
-        int nfilters_success_mm = 0;
-        for (int ff = 0; ff < nfilters; ff++) // for all filters
-        {
-            assert(isValidFilter(filters[ff]));
-            // get fresh packheader
-            ph = orig_ph;
-            ph.method = methods[mm];
-            ph.filter = filters[ff];
-            ph.overlap_overhead = 0;
-            // get fresh filter
-            Filter ft = orig_ft;
-            ft.init(ph.filter, orig_ft.addvalue);
-            // filter
-            optimizeFilter(&ft, f_ptr, f_len);
-            bool success = ft.filter(f_ptr, f_len);
-            if (ft.id != 0 && ft.calls == 0) {
-                // filter did not do anything - no need to call ft.unfilter()
-                success = false;
-            }
-            if (!success) {
-                // filter failed or was useless
-                if (filter_strategy >= 0) {
-                    // adjust ui passes
-                    if (uip->ui_pass >= 0)
-                        uip->ui_pass++;
-                }
-                continue;
-            }
-            // filter success
-#if 0
-            printf("\nfilter: id 0x%02x size %6d, calls %5d/%5d/%3d/%5d/%5d, cto 0x%02x\n",
-                   ft.id, ft.buf_len, ft.calls, ft.noncalls, ft.wrongcalls, ft.firstcall, ft.lastcall, ft.cto);
-#endif
-            if (nfilters_success_total != 0 && o_tmp == o_ptr) {
-                o_tmp_buf.allocForCompression(i_len);
-                o_tmp = o_tmp_buf;
+
+        MemBuffer work;
+        const unsigned n = (unsigned) xs->v.size();
+        unsigned wave_size = n;
+        if (xs != precomputed) {
+            wave_size = nslots;
+            work.alloc(mem_size(slot_size, nslots));
+            (void) Filter::isValidFilter(0); // init the static filter_map in this thread
+        }
+        for (unsigned wave = 0; wave < n; wave += wave_size) {
+            const unsigned wn = UPX_MIN(wave_size, n - wave);
+            if (xs != precomputed) {
+                upx_parallel_for(wn, wn, [&](unsigned k) {
+                    upx_bytep const x_ptr = work + mem_size(slot_size, k);
+                    memcpy(x_ptr, i_ptr, i_len);
+                    compressFilterCandidate(xs->v[wave + k], *xs, x_ptr, x_ptr + i_len,
+                                            overlap_range, cconf);
+                });
             }
-            nfilters_success_total++;
-            nfilters_success_mm++;
-            ph.filter_cto = ft.cto;
-            ph.n_mru = ft.n_mru;
-            // compress
-            if (compress(i_ptr, i_len, o_tmp, cconf)) {
+            // merge in serial order
+            for (unsigned c = wave; c < wave + wn; c++) {
+                FilterCandidate &x = xs->v[c];
+                const unsigned hdr_c_len = hdr_c_lens[x.mm];
+                if (filter_strategy >= 0 && uip->ui_pass >= 0)
+                    uip->ui_pass += x.nfilters_skipped; // adjust ui passes
+                if (!x.filtered)
+                    continue;
+                nfilters_success_total++;
+                nfilters_success_mm[x.mm]++;
+                if (uip->ui_pass >= 0)
+                    uip->ui_pass++; // see compress()
+                // get fresh packheader and apply the results
+                ph = orig_ph;
+                ph.method = x.ph.method;
+                ph.filter = x.ph.filter;
+                ph.filter_cto = x.ph.filter_cto;
+                ph.n_mru = x.ph.n_mru;
+                ph.overlap_overhead = 0;
+                ph_mergeCompressResult(ph, x.ph, x.compressed);
+                if (!x.compressed)
+                    continue;
+                Filter ft = x.ft;
+                ft.buf = f_ptr;
                 unsigned lsize = 0;
-                // findOverlapOperhead() might be slow; omit if already too big.
+                // omit if already too big, just like the serial loop
                 if (ph.c_len + lsize + hdr_c_len <=
                     best_ph.c_len + best_ph_lsize + best_hdr_c_len) {
-                    // get results
-                    ph.overlap_overhead = findOverlapOverhead(o_tmp, i_ptr, overlap_range);
+                    if (x.overlap_error)
+                        std::rethrow_exception(x.overlap_error);
+                    ph.overlap_overhead = x.ph.overlap_overhead;
                     buildLoader(&ft);
                     lsize = getLoaderSize();
                     assert(lsize > 0);
                 }
-#if 0  //{
-                printf("\n%2d %02x: %d +%4d +%3d = %d  (best: %d +%4d +%3d = %d)\n", ph.method, ph.filter,
-                       ph.c_len, lsize, hdr_c_len, ph.c_len + lsize + hdr_c_len,
-                       best_ph.c_len, best_ph_lsize, best_hdr_c_len, best_ph.c_len + best_ph_lsize + best_hdr_c_len);
-#endif //}
-                bool update = false;
-                if (ph.c_len + lsize + hdr_c_len < best_ph.c_len + best_ph_lsize + best_hdr_c_len)
-                    update = true;
-                else if (ph.c_len + lsize + hdr_c_len ==
-                         best_ph.c_len + best_ph_lsize + best_hdr_c_len) {
-                    // prefer smaller loaders
-                    if (lsize + hdr_c_len < best_ph_lsize + best_hdr_c_len)
-                        update = true;
-                    else if (lsize + hdr_c_len == best_ph_lsize + best_hdr_c_len) {
-                        // prefer less overlap_overhead
-                        if (ph.overlap_overhead < best_ph.overlap_overhead)
-                            update = true;
-                    }
-                }
-                if (update) {
+                if (isBetterCandidate(ph, lsize, hdr_c_len, best_ph, best_ph_lsize,
+                                      best_hdr_c_len)) {
                     assert((int) ph.overlap_overhead > 0);
-                    // update o_ptr[] with best version
-                    if (o_tmp != o_ptr)
-                        memcpy(o_ptr, o_tmp, ph.c_len);
-                    // save compression results
+                    memcpy(o_ptr, x.c_ptr, ph.c_len);
                     best_ph = ph;
                     best_ph_lsize = lsize;
                     best_hdr_c_len = hdr_c_len;
                     best_ft = ft;
                 }
             }
-            // restore - unfilter with verify
-            ft.unfilter(f_ptr, f_len, true);
-            if (filter_strategy < 0)
-                break;
         }
-        assert(nfilters_success_mm > 0);
+        for (int mm = 0; mm < nmethods; mm++)
+            assert(nfilters_success_mm[mm] > 0);
+    } else {
+        for (int mm = 0; mm < nmethods; mm++) // for all methods
+        {
+#if 0  //{
+            printf("\nmethod %d (%d of %d)\n", methods[mm], 1+ mm, nmethods);
+#endif //}
+            assert(isValidCompressionMethod(methods[mm]));
+            unsigned hdr_c_len = 0;
+            if (hdr_ptr != nullptr && hdr_len) {
+                if (nfilters_success_total != 0 && o_tmp == o_ptr) {
+                    // do not overwrite o_ptr
+                    o_tmp_buf.allocForCompression(UPX_MAX(hdr_len, i_len));
+                    o_tmp = o_tmp_buf;
+                }
+                int r = upx_compress(hdr_ptr, hdr_len, o_tmp, &hdr_c_len, nullptr, methods[mm], 10,
+                                     nullptr, nullptr);
+                if (r != UPX_E_OK)
+                    throwInternalError("header compression failed");
+                if (hdr_c_len >= hdr_len)
+                    throwInternalError("header compression size increase");
+            }
+            int nfilters_success_mm = 0;
+            for (int ff = 0; ff < nfilters; ff++) // for all filters
+            {
+                assert(isValidFilter(filters[ff]));
+                // get fresh packheader
+                ph = orig_ph;
+                ph.method = methods[mm];
+                ph.filter = filters[ff];
+                ph.overlap_overhead = 0;
+                // get fresh filter
+                Filter ft = orig_ft;
+                ft.init(ph.filter, orig_ft.addvalue);
+                // filter
+                optimizeFilter(&ft, f_ptr, f_len);
+                bool success = ft.filter(f_ptr, f_len);
+                if (ft.id != 0 && ft.calls == 0) {
+                    // filter did not do anything - no need to call ft.unfilter()
+                    success = false;
+                }
+                if (!success) {
+                    // filter failed or was useless
+                    if (filter_strategy >= 0) {
+                        // adjust ui passes
+                        if (uip->ui_pass >= 0)
+                            uip->ui_pass++;
+                    }
+                    continue;
+                }
+                // filter success
+#if 0
+                printf("\nfilter: id 0x%02x size %6d, calls %5d/%5d/%3d/%5d/%5d, cto 0x%02x\n",
+                       ft.id, ft.buf_len, ft.calls, ft.noncalls, ft.wrongcalls, ft.firstcall, ft.lastcall, ft.cto);
+#endif
+                if (nfilters_success_total != 0 && o_tmp == o_ptr) {
+                    o_tmp_buf.allocForCompression(i_len);
+                    o_tmp = o_tmp_buf;
+                }
+                nfilters_success_total++;
+                nfilters_success_mm++;
+                ph.filter_cto = ft.cto;
+                ph.n_mru = ft.n_mru;
+                // compress
+                if (compress(i_ptr, i_len, o_tmp, cconf)) {
+                    unsigned lsize = 0;
+                    // findOverlapOperhead() might be slow; omit if already too big.
+                    if (ph.c_len + lsize + hdr_c_len <=
+                        best_ph.c_len + best_ph_lsize + best_hdr_c_len) {
+                        // get results
+                        ph.overlap_overhead = findOverlapOverhead(ph, o_tmp, i_ptr, overlap_range);
+                        buildLoader(&ft);
+                        lsize = getLoaderSize();
+                        assert(lsize > 0);
+                    }
+#if 0  //{
+                    printf("\n%2d %02x: %d +%4d +%3d = %d  (best: %d +%4d +%3d = %d)\n", ph.method, ph.filter,
+                           ph.c_len, lsize, hdr_c_len, ph.c_len + lsize + hdr_c_len,
+                           best_ph.c_len, best_ph_lsize, best_hdr_c_len, best_ph.c_len + best_ph_lsize + best_hdr_c_len);
+#endif //}
+                    if (isBetterCandidate(ph, lsize, hdr_c_len, best_ph, best_ph_lsize,
+                                          best_hdr_c_len)) {
+                        assert((int) ph.overlap_overhead > 0);
+                        // update o_ptr[] with best version
+                        if (o_tmp != o_ptr)
+                            memcpy(o_ptr, o_tmp, ph.c_len);
+                        // save compression results
+                        best_ph = ph;
+                        best_ph_lsize = lsize;
+                        best_hdr_c_len = hdr_c_len;
+                        best_ft = ft;
+                    }
+                }
+                // restore - unfilter with verify
+                ft.unfilter(f_ptr, f_len, true);
+                if (filter_strategy < 0)
+                    break;
+            }
+            assert(nfilters_success_mm > 0);
+        }
     }
 
     // postconditions 1)
@@ -1413,6 +1703,7 @@ void Packer::compressWithFilters(upx_bytep i_ptr,
 
     // copy back results
     this->ph = best_ph;
+    best_ft.scan_cache = nullptr; // local to this function or to precomputed
     *parm_ft = best_ft;
 
     // Finally, check compression ratio.
@@ -1447,7 +1738,8 @@ void Packer::compressWithFilters(Filter *ft, const unsigned overlap_range,
                                  upx_compress_config_t const *cconf, int filter_strategy,
                                  unsigned filter_off, unsigned ibuf_off, unsigned obuf_off,
                                  upx_bytep const hdr_ptr, unsigned hdr_len,
-                                 bool inhibit_compression_check) {
+                                 bool inhibit_compression_check,
+                                 FilterCandidates *precomputed) {
     ibuf.checkState();
     obuf.checkState();
 
@@ -1461,10 +1753,66 @@ void Packer::compressWithFilters(Filter *ft, const unsigned overlap_range,
 
     // call the first one in this file
     compressWithFilters(i_ptr, i_len, o_ptr, f_ptr, f_len, hdr_ptr, hdr_len, ft, overlap_range,
-                        cconf, filter_strategy, inhibit_compression_check);
+                        cconf, filter_strategy, inhibit_compression_check, precomputed);
 
     ibuf.checkState();
     obuf.checkState();
 }
 
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+#if DEBUG && !defined(DOCTEST_CONFIG_DISABLE) && 1
+
+// compare the single-pass analysis with a linear search that runs the
+// real decompressors through ph_testOverlappingDecompression()
+static bool check_overlap(int method) {
+    const unsigned u_len = 16384;
+    const unsigned max_overhead = 1024;
+    MemBuffer u_buf(u_len);
+    // runs of random bytes between repeated text, so that both literals
+    // and matches affect how far the decompressor reads ahead
+    upx_uint32_t x = 1;
+    for (unsigned i = 0; i < u_len; i++) {
+        x = x * 1103515245 + 12345;
+        u_buf[i] = (i & 512) ? (upx_byte) (x >> 24) : (upx_byte) "in-place"[i % 8];
+    }
+
+    MemBuffer c_buf;
+    c_buf.allocForCompression(u_len);
+    PackHeader ph;
+    ph.method = method;
+    ph.level = 3; // don't waste time
+    ph.u_len = u_len;
+    ph.c_len = c_buf.getSize();
+    int r = upx_compress(raw_bytes(u_buf, u_len), u_len, raw_bytes(c_buf, ph.c_len), &ph.c_len,
+                         nullptr, ph.method, ph.level, nullptr, &ph.compress_result);
+    if (r != UPX_E_OK || ph.c_len >= ph.u_len)
+        return false;
+
+    // ph_testOverlappingDecompression() reads the compressed data at
+    // buf[0], but passes buf - src_off on, so keep room in front of it
+    MemBuffer o_buf(u_len + max_overhead + ph.c_len);
+    const upx_bytep buf = raw_index_bytes(o_buf, u_len + max_overhead, ph.c_len);
+    memcpy(o_buf + (u_len + max_overhead), c_buf, ph.c_len);
+
+    unsigned expected = 0;
+    for (unsigned oo = 1; oo <= max_overhead && expected == 0; oo++)
+        if (ph_testOverlappingDecompression(ph, buf, raw_bytes(u_buf, u_len), oo))
+            expected = oo;
+    return expected != 0 && ph_findOverlapOverhead(ph, buf, raw_bytes(u_buf, u_len)) == expected;
+}
+
+TEST_CASE("ph_findOverlapOverhead") {
+    CHECK(check_overlap(M_NRV2B_LE32));
+    CHECK(check_overlap(M_NRV2D_LE32));
+    CHECK(check_overlap(M_NRV2E_LE32));
+    CHECK(check_overlap(M_NRV2B_8));
+    CHECK(check_overlap(M_NRV2E_LE16));
+    CHECK(check_overlap(M_LZMA));
+}
+
+#endif // DEBUG
+
 /* vim:set ts=4 sw=4 et: */
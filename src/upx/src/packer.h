@@ -29,14 +29,15 @@
 #ifndef UPX_PACKER_H__
 #define UPX_PACKER_H__ 1
 
+#include <vector>
 #include "util/membuffer.h"
+#include "filter.h"
 
 class InputFile;
 class OutputFile;
 class Packer;
 class PackMaster;
 class UiPacker;
-class Filter;
 
 /*************************************************************************
 //
@@ -47,12 +48,11 @@ class PackHeader final {
     friend class Packer;
 
     // these are strictly private to friend Packer
-    PackHeader();
-
     void putPackHeader(SPAN_S(upx_byte) p);
     bool decodePackHeaderFromBuf(SPAN_S(const upx_byte) b, int blen);
 
 public:
+    PackHeader();
     int getPackHeaderSize() const;
 
 public:
@@ -99,6 +99,7 @@ void ph_decompress(PackHeader &ph, SPAN_P(const upx_byte) in, SPAN_P(upx_byte) o
                    bool verify_checksum, Filter *ft);
 bool ph_testOverlappingDecompression(const PackHeader &ph, SPAN_P(const upx_byte) buf,
                                      unsigned overlap_overhead);
+void ph_mergeCompressResult(PackHeader &ph, const PackHeader &x, bool compressed);
 
 /*************************************************************************
 // abstract base class for packers
@@ -164,12 +165,53 @@ protected:
     // main compression drivers
     bool compress(SPAN_P(upx_byte) i_ptr, unsigned i_len, SPAN_P(upx_byte) o_ptr,
                   const upx_compress_config_t *cconf = nullptr);
+    // thread-safe core of compress(): only touches ph_, no ui if ui == nullptr
+    bool compress(PackHeader &ph_, SPAN_P(upx_byte) i_ptr, unsigned i_len,
+                  SPAN_P(upx_byte) o_ptr, const upx_compress_config_t *cconf,
+                  UiPacker *ui) const;
     void decompress(SPAN_P(const upx_byte) in, SPAN_P(upx_byte) out, bool verify_checksum = true,
                     Filter *ft = nullptr);
     virtual bool checkDefaultCompressionRatio(unsigned u_len, unsigned c_len) const;
     virtual bool checkCompressionRatio(unsigned u_len, unsigned c_len) const;
     virtual bool checkFinalCompressionRatio(const OutputFile *fo) const;
 
+    // Parallel support for compressWithFilters(): the method/filter
+    // candidates get filtered and compressed by compressFilterCandidate(),
+    // which is thread-safe, and compressWithFilters() then merges the
+    // results in the serial order.
+    struct FilterCandidate final {
+        FilterCandidate(const PackHeader &ph_, const Filter &ft_) : ph(ph_), ft(ft_) {}
+        PackHeader ph; // u_adler and c_adler are block-local, see ph_mergeCompressResult()
+        Filter ft;
+        int mm = 0;                 // index into FilterCandidates::methods[]
+        int ff_first = 0;           // range of FilterCandidates::filters[] to try
+        int ff_last = 0;            //   (until the first one succeeds)
+        upx_bytep c_ptr = nullptr;  // compressed data
+        int nfilters_skipped = 0;   // filters which failed or were useless
+        bool filtered = false;
+        bool compressed = false;
+        std::exception_ptr overlap_error; // from findOverlapOverhead()
+    };
+    struct FilterCandidates final {
+        int methods[256];
+        int nmethods = 0;
+        int filters[256];
+        int nfilters = 0;
+        int filter_strategy = 0; // as updated by prepareFilters()
+        unsigned addvalue = 0;   // Filter::addvalue
+        unsigned i_len = 0;
+        unsigned f_off = 0; // offset of the filtered part
+        unsigned f_len = 0;
+        std::vector<FilterCandidate> v;
+    };
+    void prepareFilterCandidates(FilterCandidates &xs, const PackHeader &ph_, const Filter &ft_,
+                                 int filter_strategy, unsigned i_len, unsigned f_off,
+                                 unsigned f_len) const;
+    void compressFilterCandidate(FilterCandidate &x, const FilterCandidates &xs,
+                                 upx_bytep i_ptr, // written and restored by filters
+                                 upx_bytep o_ptr, unsigned overlap_range,
+                                 upx_compress_config_t const *cconf) const;
+
     // high-level compression drivers
     void compressWithFilters(Filter *ft, const unsigned overlap_range,
                              const upx_compress_config_t *cconf, int filter_strategy = 0,
@@ -178,7 +220,8 @@ protected:
                              const upx_compress_config_t *cconf, int filter_strategy,
                              unsigned filter_buf_off, unsigned compress_ibuf_off,
                              unsigned compress_obuf_off, upx_bytep const hdr_ptr, unsigned hdr_len,
-                             bool inhibit_compression_check = false);
+                             bool inhibit_compression_check = false,
+                             FilterCandidates *precomputed = nullptr);
     // real compression driver
     void compressWithFilters(upx_bytep i_ptr, unsigned i_len, // written and restored by filters
                              upx_bytep o_ptr, upx_bytep f_ptr,
@@ -186,15 +229,18 @@ protected:
                              upx_bytep const hdr_ptr, unsigned hdr_len,
                              Filter *parm_ft, // updated
                              unsigned overlap_range, upx_compress_config_t const *cconf,
-                             int filter_strategy, bool inhibit_compression_check = false);
+                             int filter_strategy, bool inhibit_compression_check = false,
+                             FilterCandidates *precomputed = nullptr);
 
     // util for verifying overlapping decompresion
     //   non-destructive test
     virtual bool testOverlappingDecompression(const upx_bytep buf, const upx_bytep tbuf,
                                               unsigned overlap_overhead) const;
     //   non-destructive find
-    virtual unsigned findOverlapOverhead(const upx_bytep buf, const upx_bytep tbuf,
-                                         unsigned range = 0, unsigned upper_limit = ~0u) const;
+    //   (must be thread-safe, see compressWithFilters)
+    virtual unsigned findOverlapOverhead(const PackHeader &ph_, const upx_bytep buf,
+                                         const upx_bytep tbuf, unsigned range = 0,
+                                         unsigned upper_limit = ~0u) const;
     //   destructive decompress + verify
     void verifyOverlappingDecompression(Filter *ft = nullptr);
     void verifyOverlappingDecompression(upx_bytep o_ptr, unsigned o_size, Filter *ft = nullptr);
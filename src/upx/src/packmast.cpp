@@ -129,6 +129,109 @@ static Packer *try_unpack(Packer *p, void *user) {
     return nullptr;
 }
 
+/*************************************************************************
+// header sniffer
+//
+// Classifies the first bytes of a file by the signatures that the
+// readFileHeader()/canPack()/canUnpack() of the packers check first,
+// so that visitAllPackers() can skip the packers that would reject the
+// file anyway. A packer whose check does not depend on the header
+// (SNIFF_ANY: .com/.sys, and the generic PackUnix trailer) is always
+// tried, and an unknown header selects all packers.
+**************************************************************************/
+
+enum {
+    SNIFF_ANY = 1 << 0,
+    SNIFF_DOS = 1 << 1,        // MZ, ZM, BW, LE, PE, PMW1, Adam, coff
+    SNIFF_TOS = 1 << 2,        // 0x601a
+    SNIFF_BOOT = 1 << 3,       // i386 boot sector (bzImage)
+    SNIFF_ZIMAGE_ARM = 1 << 4, // 8 * "mov r0,r0"
+    SNIFF_PS1 = 1 << 5,        // PS-X EXE
+    SNIFF_MACH = 1 << 6,       // feedface, feedfacf
+    SNIFF_MACH_FAT = 1 << 7,   // cafebabe
+    SNIFF_ELF_I386 = 1 << 8,   // ELF by e_machine
+    SNIFF_ELF_AMD64 = 1 << 9,
+    SNIFF_ELF_ARM = 1 << 10,
+    SNIFF_ELF_ARM64 = 1 << 11,
+    SNIFF_ELF_PPC = 1 << 12,
+    SNIFF_ELF_MIPS = 1 << 13,
+    SNIFF_ELF = SNIFF_ELF_I386 | SNIFF_ELF_AMD64 | SNIFF_ELF_ARM | SNIFF_ELF_ARM64 |
+                SNIFF_ELF_PPC | SNIFF_ELF_MIPS,
+    SNIFF_ALL = ~0u
+};
+
+static unsigned sniffHeader(const upx_byte *b, unsigned len) {
+    unsigned r = SNIFF_ANY;
+    if (len >= 0x40) {
+        if (!memcmp(b, "MZ", 2) || !memcmp(b, "ZM", 2) || !memcmp(b, "BW", 2) ||
+            !memcmp(b, "LE", 2) || !memcmp(b, "PE\0\0", 4) || !memcmp(b, "PMW1", 4) ||
+            !memcmp(b, "Adam", 4) || get_le16(b) == 0x014c)
+            r |= SNIFF_DOS;
+        if (get_be16(b) == 0x601a)
+            r |= SNIFF_TOS;
+        if (!memcmp(b, "PS-X EXE", 8) || !memcmp(b, "EXE X-SP", 8))
+            r |= SNIFF_PS1;
+        const unsigned m = get_be32(b);
+        if ((m & ~1u) == 0xfeedface || (get_le32(b) & ~1u) == 0xfeedface)
+            r |= SNIFF_MACH;
+        if (m == 0xcafebabe)
+            r |= SNIFF_MACH_FAT;
+        unsigned j = 0;
+        while (j < 8 && get_le32(b + 4 * j) == 0xe1a00000)
+            j++;
+        if (j == 8)
+            r |= SNIFF_ZIMAGE_ARM;
+        if (!memcmp(b, "\x7f\x45\x4c\x46", 4)) {
+            const unsigned data = b[Elf32_Ehdr::EI_DATA];
+            const unsigned machine = data == Elf32_Ehdr::ELFDATA2LSB   ? get_le16(b + 18)
+                                     : data == Elf32_Ehdr::ELFDATA2MSB ? get_be16(b + 18)
+                                                                       : 0;
+            switch (machine) {
+            case Elf32_Ehdr::EM_386:
+                r |= SNIFF_ELF_I386;
+                break;
+            case Elf32_Ehdr::EM_X86_64:
+                r |= SNIFF_ELF_AMD64;
+                break;
+            case Elf32_Ehdr::EM_ARM:
+                r |= SNIFF_ELF_ARM;
+                break;
+            case Elf32_Ehdr::EM_AARCH64:
+                r |= SNIFF_ELF_ARM64;
+                break;
+            case Elf32_Ehdr::EM_PPC:
+            case Elf32_Ehdr::EM_PPC64:
+                r |= SNIFF_ELF_PPC;
+                break;
+            case Elf32_Ehdr::EM_MIPS:
+                r |= SNIFF_ELF_MIPS;
+                break;
+            default:
+                r |= SNIFF_ELF;
+                break;
+            }
+        }
+    }
+    if (len >= 0x200 && get_le16(b + 0x1fe) == 0xaa55)
+        r |= SNIFF_BOOT;
+    return r == SNIFF_ANY ? SNIFF_ALL : r;
+}
+
+static unsigned sniffFile(InputFile *f, const options_t *o) {
+    if (f == nullptr || o->o_unix.make_ptinterp) // PackLinuxElf32x86interp takes any file
+        return SNIFF_ALL;
+    upx_byte buf[0x200];
+    int len = 0;
+    try {
+        f->seek(0, SEEK_SET);
+        len = f->read(buf, sizeof(buf));
+        f->seek(0, SEEK_SET);
+    } catch (const IOException &) {
+        return SNIFF_ALL;
+    }
+    return sniffHeader(buf, len > 0 ? (unsigned) len : 0);
+}
+
 /*************************************************************************
 //
 **************************************************************************/
@@ -136,9 +239,13 @@ static Packer *try_unpack(Packer *p, void *user) {
 Packer *PackMaster::visitAllPackers(visit_func_t func, InputFile *f, const options_t *o,
                                     void *user) {
     Packer *p = nullptr;
+    const unsigned sniffed = sniffFile(f, o);
 
-#define D(Klass)                                                                                   \
+    // Klass is only tried if the file header matches one of its signatures
+#define D(Klass, sniff)                                                                            \
     ACC_BLOCK_BEGIN                                                                                \
+    if (!(sniffed & (sniff)))                                                                      \
+        break;                                                                                     \
     Klass *const kp = new Klass(f);                                                                \
     if (o->debug.debug_level)                                                                      \
         fprintf(stderr, "visitAllPackers: (ver=%d, fmt=%3d) %s\n", kp->getVersion(),               \
@@ -153,83 +260,83 @@ Packer *PackMaster::visitAllPackers(visit_func_t func, InputFile *f, const optio
     // .exe
     //
     if (!o->dos_exe.force_stub) {
-        D(PackDjgpp2);
-        D(PackTmt);
-        D(PackWcle);
-        D(PackW64Pep);
-        D(PackW32Pe);
+        D(PackDjgpp2, SNIFF_DOS);
+        D(PackTmt, SNIFF_DOS);
+        D(PackWcle, SNIFF_DOS);
+        D(PackW64Pep, SNIFF_DOS);
+        D(PackW32Pe, SNIFF_DOS);
     }
-    D(PackArmPe);
-    D(PackExe);
+    D(PackArmPe, SNIFF_DOS);
+    D(PackExe, SNIFF_DOS);
 
     //
     // atari
     //
-    D(PackTos);
+    D(PackTos, SNIFF_TOS);
 
     //
     // linux kernel
     //
-    D(PackVmlinuxARMEL);
-    D(PackVmlinuxARMEB);
-    D(PackVmlinuxPPC32);
-    D(PackVmlinuxPPC64LE);
-    D(PackVmlinuxAMD64);
-    D(PackVmlinuxI386);
-    D(PackVmlinuzI386);
-    D(PackBvmlinuzI386);
-    D(PackVmlinuzARMEL);
+    D(PackVmlinuxARMEL, SNIFF_ELF_ARM);
+    D(PackVmlinuxARMEB, SNIFF_ELF_ARM);
+    D(PackVmlinuxPPC32, SNIFF_ELF_PPC);
+    D(PackVmlinuxPPC64LE, SNIFF_ELF_PPC);
+    D(PackVmlinuxAMD64, SNIFF_ELF_AMD64);
+    D(PackVmlinuxI386, SNIFF_ELF_I386);
+    D(PackVmlinuzI386, SNIFF_BOOT);
+    D(PackBvmlinuzI386, SNIFF_BOOT);
+    D(PackVmlinuzARMEL, SNIFF_ZIMAGE_ARM);
 
     //
     // linux
     //
     if (!o->o_unix.force_execve) {
         if (o->o_unix.use_ptinterp) {
-            D(PackLinuxElf32x86interp);
+            D(PackLinuxElf32x86interp, SNIFF_ELF_I386);
         }
-        D(PackFreeBSDElf32x86);
-        D(PackNetBSDElf32x86);
-        D(PackOpenBSDElf32x86);
-        D(PackLinuxElf32x86);
-        D(PackLinuxElf64amd);
-        D(PackLinuxElf32armLe);
-        D(PackLinuxElf32armBe);
-        D(PackLinuxElf64arm);
-        D(PackLinuxElf32ppc);
-        D(PackLinuxElf64ppc);
-        D(PackLinuxElf64ppcle);
-        D(PackLinuxElf32mipsel);
-        D(PackLinuxElf32mipseb);
-        D(PackLinuxI386sh);
+        D(PackFreeBSDElf32x86, SNIFF_ELF_I386);
+        D(PackNetBSDElf32x86, SNIFF_ELF_I386);
+        D(PackOpenBSDElf32x86, SNIFF_ELF_I386);
+        D(PackLinuxElf32x86, SNIFF_ELF_I386);
+        D(PackLinuxElf64amd, SNIFF_ELF_AMD64);
+        D(PackLinuxElf32armLe, SNIFF_ELF_ARM);
+        D(PackLinuxElf32armBe, SNIFF_ELF_ARM);
+        D(PackLinuxElf64arm, SNIFF_ELF_ARM64);
+        D(PackLinuxElf32ppc, SNIFF_ELF_PPC);
+        D(PackLinuxElf64ppc, SNIFF_ELF_PPC);
+        D(PackLinuxElf64ppcle, SNIFF_ELF_PPC);
+        D(PackLinuxElf32mipsel, SNIFF_ELF_MIPS);
+        D(PackLinuxElf32mipseb, SNIFF_ELF_MIPS);
+        D(PackLinuxI386sh, SNIFF_ANY);
     }
-    D(PackBSDI386);
-    D(PackMachFat);   // cafebabe conflict
-    D(PackLinuxI386); // cafebabe conflict
+    D(PackBSDI386, SNIFF_ANY);
+    D(PackMachFat, SNIFF_MACH_FAT);   // cafebabe conflict
+    D(PackLinuxI386, SNIFF_ANY); // cafebabe conflict
 
     //
     // psone
     //
-    D(PackPs1);
+    D(PackPs1, SNIFF_PS1);
 
     //
     // .sys and .com
     //
-    D(PackSys);
-    D(PackCom);
+    D(PackSys, SNIFF_ANY);
+    D(PackCom, SNIFF_ANY);
 
     // Mach (macOS)
-    D(PackDylibAMD64);
-    D(PackMachPPC32); // TODO: this works with upx 3.91..3.94 but got broken in 3.95; FIXME
-    D(PackMachI386);
-    D(PackMachAMD64);
-    D(PackMachARMEL);
-    D(PackMachARM64EL);
+    D(PackDylibAMD64, SNIFF_MACH);
+    D(PackMachPPC32, SNIFF_MACH); // TODO: this works with upx 3.91..3.94 but got broken in 3.95; FIXME
+    D(PackMachI386, SNIFF_MACH);
+    D(PackMachAMD64, SNIFF_MACH);
+    D(PackMachARMEL, SNIFF_MACH);
+    D(PackMachARM64EL, SNIFF_MACH);
 
     // 2010-03-12  omit these because PackMachBase<T>::pack4dylib (p_mach.cpp)
     // does not understand what the Darwin (Apple Mac OS X) dynamic loader
     // assumes about .dylib file structure.
-    //   D(PackDylibI386);
-    //   D(PackDylibPPC32);
+    //   D(PackDylibI386, SNIFF_MACH);
+    //   D(PackDylibPPC32, SNIFF_MACH);
 
     return nullptr;
 #undef D
@@ -291,4 +398,43 @@ void PackMaster::fileInfo() {
     p->doFileInfo();
 }
 
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+#if DEBUG && !defined(DOCTEST_CONFIG_DISABLE) && 1
+
+TEST_CASE("sniffHeader") {
+    upx_byte b[0x200];
+    memset(b, 0, sizeof(b));
+    CHECK(sniffHeader(b, sizeof(b)) == (unsigned) SNIFF_ALL);
+    CHECK(sniffHeader(b, 0) == (unsigned) SNIFF_ALL);
+    memcpy(b, "MZ", 2);
+    CHECK(sniffHeader(b, sizeof(b)) == (SNIFF_ANY | SNIFF_DOS));
+    CHECK(sniffHeader(b, 0x3f) == (unsigned) SNIFF_ALL);
+    set_le16(b + 0x1fe, 0xaa55); // EFI bzImage
+    CHECK(sniffHeader(b, sizeof(b)) == (SNIFF_ANY | SNIFF_DOS | SNIFF_BOOT));
+    memset(b, 0, sizeof(b));
+    memcpy(b, "\x7f\x45\x4c\x46\x02\x01\x01", 7);
+    set_le16(b + 18, Elf64_Ehdr::EM_X86_64);
+    CHECK(sniffHeader(b, sizeof(b)) == (SNIFF_ANY | SNIFF_ELF_AMD64));
+    b[Elf64_Ehdr::EI_DATA] = Elf64_Ehdr::ELFDATA2MSB;
+    set_be16(b + 18, Elf64_Ehdr::EM_PPC64);
+    CHECK(sniffHeader(b, sizeof(b)) == (SNIFF_ANY | SNIFF_ELF_PPC));
+    set_be16(b + 18, 0x1234); // unknown machine
+    CHECK(sniffHeader(b, sizeof(b)) == (SNIFF_ANY | SNIFF_ELF));
+    memset(b, 0, sizeof(b));
+    set_le32(b, 0xfeedfacf);
+    CHECK(sniffHeader(b, sizeof(b)) == (SNIFF_ANY | SNIFF_MACH));
+    set_be32(b, 0xfeedface);
+    CHECK(sniffHeader(b, sizeof(b)) == (SNIFF_ANY | SNIFF_MACH));
+    set_be32(b, 0xcafebabe);
+    CHECK(sniffHeader(b, sizeof(b)) == (SNIFF_ANY | SNIFF_MACH_FAT));
+    for (unsigned j = 0; j < 8; j++)
+        set_le32(b + 4 * j, 0xe1a00000);
+    CHECK(sniffHeader(b, sizeof(b)) == (SNIFF_ANY | SNIFF_ZIMAGE_ARM));
+}
+
+#endif // DEBUG
+
 /* vim:set ts=4 sw=4 et: */
@@ -31,6 +31,8 @@
 #include "packer.h"
 #include "pefile.h"
 #include "linker.h"
+#include <algorithm>
+#include <string>
 
 #define FILLVAL 0
 
@@ -226,32 +228,48 @@ int __acc_cdecl_qsort PeFile::Interval::compare(const void *p1, const void *p2)
     return 0;
 }
 
+// grow geometrically, so that adding n intervals is O(n)
+void PeFile::Interval::reserve(unsigned n) {
+    if (n <= capacity)
+        return;
+    unsigned newcap = capacity ? capacity : 16;
+    while (newcap < n)
+        newcap = newcap < 0x40000000 ? 2 * newcap : n;
+    void *p = realloc(ivarr, mem_size(sizeof(interval), newcap));
+    if (p == nullptr)
+        throwOutOfMemoryException();
+    ivarr = (interval *) p;
+    capacity = newcap;
+}
+
 void PeFile::Interval::add(unsigned start, unsigned len) {
     if (ivnum == capacity)
-        ivarr = (interval *) realloc(ivarr, (capacity += 15) * sizeof(interval));
+        reserve(ivnum + 1);
     ivarr[ivnum].start = start;
     ivarr[ivnum++].len = len;
 }
 
 void PeFile::Interval::add(const Interval *iv) {
+    reserve(ivnum + iv->ivnum);
     for (unsigned ic = 0; ic < iv->ivnum; ic++)
         add(iv->ivarr[ic].start, iv->ivarr[ic].len);
 }
 
+// sort, then coalesce overlapping and adjacent intervals in a single sweep
 void PeFile::Interval::flatten() {
     if (!ivnum)
         return;
     qsort(ivarr, ivnum, sizeof(interval), Interval::compare);
-    for (unsigned ic = 0; ic < ivnum - 1; ic++) {
-        unsigned jc;
-        for (jc = ic + 1; jc < ivnum && ivarr[ic].start + ivarr[ic].len >= ivarr[jc].start; jc++)
-            if (ivarr[ic].start + ivarr[ic].len < ivarr[jc].start + ivarr[jc].len)
-                ivarr[ic].len = ivarr[jc].start + ivarr[jc].len - ivarr[ic].start;
-        if (jc > ic + 1) {
-            memmove(ivarr + ic + 1, ivarr + jc, sizeof(interval) * (ivnum - jc));
-            ivnum -= jc - ic - 1;
-        }
+    unsigned last = 0;
+    for (unsigned ic = 1; ic < ivnum; ic++) {
+        interval &cur = ivarr[last];
+        if (cur.start + cur.len >= ivarr[ic].start) {
+            if (cur.start + cur.len < ivarr[ic].start + ivarr[ic].len)
+                cur.len = ivarr[ic].start + ivarr[ic].len - cur.start;
+        } else
+            ivarr[++last] = ivarr[ic];
     }
+    ivnum = last + 1;
 }
 
 void PeFile::Interval::clear() {
@@ -316,7 +334,7 @@ void PeFile::Reloc::add(unsigned pos, unsigned type) {
 void PeFile::Reloc::finish(upx_byte *&p, unsigned &siz) {
     unsigned prev = 0xffffffff;
     set_le32(start + 1024 + 4 * counts[0]++, 0xf0000000);
-    qsort(start + 1024, counts[0], 4, le32_compare);
+    sort_le32(start + 1024, counts[0]);
 
     rel = (reloc *) start;
     rel1 = (LE16 *) start;
@@ -392,13 +410,7 @@ void PeFile32::processRelocs() // pass1
 
     // remove duplicated records
     for (ic = 1; ic <= 3; ic++) {
-        qsort(fix[ic], xcounts[ic], 4, le32_compare);
-        unsigned prev = ~0u;
-        unsigned jc = 0;
-        for (unsigned kc = 0; kc < xcounts[ic]; kc++)
-            if (fix[ic][kc] != prev)
-                prev = fix[ic][jc++] = fix[ic][kc];
-
+        unsigned const jc = sort_le32_unique(fix[ic], xcounts[ic]);
         NO_printf("xcounts[%u] %u->%u\n", ic, xcounts[ic], jc);
         xcounts[ic] = jc;
     }
@@ -491,13 +503,7 @@ void PeFile64::processRelocs() // pass1
 
     // remove duplicated records
     for (ic = 1; ic <= 15; ic++) {
-        qsort(fix[ic], xcounts[ic], 4, le32_compare);
-        unsigned prev = ~0u;
-        unsigned jc = 0;
-        for (unsigned kc = 0; kc < xcounts[ic]; kc++)
-            if (fix[ic][kc] != prev)
-                prev = fix[ic][jc++] = fix[ic][kc];
-
+        unsigned const jc = sort_le32_unique(fix[ic], xcounts[ic]);
         NO_printf("xcounts[%u] %u->%u\n", ic, xcounts[ic], jc);
         xcounts[ic] = jc;
     }
@@ -568,11 +574,33 @@ LE32 &PeFile::ODADDR(unsigned x) { return oddirs[x].vaddr; }
  */
 
 class PeFile::ImportLinker : public ElfLinkerAMD64 {
-    struct tstr : private ::noncopyable {
-        char *s = nullptr;
-        explicit tstr(char *str) : s(str) {}
-        ~tstr() { delete[] s; }
-        operator char *() const { return s; }
+    // The names of the sections and the keys of the indices below are
+    // allocated from an arena that lives as long as the linker.
+    class NameArena : private ::noncopyable {
+        std::vector<char *> blocks;
+        char *ptr = nullptr;
+        size_t avail = 0;
+
+    public:
+        ~NameArena() {
+            for (char *block : blocks)
+                delete[] block;
+        }
+        char *alloc(size_t len) {
+            if (len > avail) {
+                avail = len > 65536 ? len : 65536;
+                blocks.push_back(ptr = New(char, avail));
+            }
+            char *r = ptr;
+            ptr += len;
+            avail -= len;
+            return r;
+        }
+        std::string_view dup(const char *str, size_t len) {
+            char *r = alloc(len + 1);
+            memcpy(r, str, len + 1);
+            return std::string_view(r, len);
+        }
     };
 
     // encoding of dll and proc names are required, so that our special
@@ -588,30 +616,6 @@ class PeFile::ImportLinker : public ElfLinkerAMD64 {
         return buf;
     }
 
-    static char *name_for_dll(const char *dll, char first_char) {
-        assert(dll);
-        unsigned l = strlen(dll);
-        assert(l > 0);
-
-        char *name = New(char, 3 * l + 2);
-        assert(name);
-        name[0] = first_char;
-        char *n = name + 1 + 2 * l;
-        do {
-            *n++ = tolower(*dll);
-        } while (*dll++);
-        return encode_name(name + 1 + 2 * l, name + 1) - 1;
-    }
-
-    static char *name_for_proc(const char *dll, const char *proc, char first_char, char separator) {
-        unsigned len = 1 + 2 * strlen(dll) + 1 + 2 * strlen(proc) + 1 + 1;
-        tstr dlln(name_for_dll(dll, first_char));
-        char *procn = New(char, len);
-        upx_safe_snprintf(procn, len, "%s%c", (const char *) dlln, separator);
-        encode_name(proc, procn + strlen(procn));
-        return procn;
-    }
-
     static const char zeros[sizeof(import_desc)];
 
     enum {
@@ -630,68 +634,135 @@ class PeFile::ImportLinker : public ElfLinkerAMD64 {
 
     unsigned thunk_size; // 4 or 8 bytes
 
-    void add(const char *dll, const char *proc, unsigned ordinal) {
-        tstr sdll(name_for_dll(dll, dll_name_id));
-        tstr desc_name(name_for_dll(dll, descriptor_id));
+    // Hashed index of the dlls (by lower case name) and of their procs, so
+    // that add() and getAddress() do not have to build and look up section
+    // names. The thunk of the first proc of a dll uses thunk_separator_first.
+    struct Thunk {
+        const Section *first = nullptr;
+        const Section *other = nullptr;
+    };
+    struct Dll {
+        const char *enc = nullptr; // encoded lower case name
+        size_t enc_len = 0;
+        const Section *name_section = nullptr;
+        const Section *empty_thunk = nullptr; // see infoWarning() below
+        std::unordered_map<std::string_view, Thunk> procs;
+    };
+    std::unordered_map<std::string_view, Dll> dlls;
+    NameArena arena;
+    mutable std::string lower; // lookup key
+    const Symbol *und_symbol = nullptr;
+
+    void set_lower(const char *dll) const {
+        assert(dll);
+        lower.clear();
+        for (; *dll; dll++)
+            lower += (char) tolower(*dll);
+    }
+
+    const Dll *findDll(const char *dll) const {
+        set_lower(dll);
+        auto it = dlls.find(lower);
+        return it == dlls.end() ? nullptr : &it->second;
+    }
+
+    // first_char + encoded dll [+ separator + encoded proc] + suffix
+    const char *name_for(const Dll &d, char first_char, char separator = 0,
+                         const char *proc = nullptr, const char *suffix = "") {
+        size_t const plen = separator ? strlen(proc) : 0;
+        size_t const slen = strlen(suffix);
+        char *name = arena.alloc(1 + d.enc_len + 1 + 2 * plen + slen + 1);
+        char *n = name;
+        *n++ = first_char;
+        memcpy(n, d.enc, d.enc_len);
+        n += d.enc_len;
+        if (separator) {
+            *n++ = separator;
+            encode_name(proc, n);
+            n += 2 * plen;
+        }
+        memcpy(n, suffix, slen + 1);
+        return name;
+    }
 
+    void add(const char *dll, const char *proc, unsigned ordinal) {
         char tsep = thunk_separator;
-        if (findSection(sdll, false) == nullptr) {
+        Section *desc = nullptr;
+        set_lower(dll);
+        assert(!lower.empty());
+        auto dit = dlls.find(lower);
+        if (dit == dlls.end()) {
             tsep = thunk_separator_first;
-            addSection(sdll, dll, strlen(dll) + 1, 0); // name of the dll
-            addSymbol(sdll, sdll, 0);
-
-            addSection(desc_name, zeros, sizeof(zeros), 0); // descriptor
-            addRelocation(desc_name, offsetof(import_desc, dllname), "R_X86_64_32", sdll, 0);
+            dit = dlls.emplace(arena.dup(lower.c_str(), lower.size()), Dll()).first;
+            Dll &nd = dit->second;
+            nd.enc_len = 2 * lower.size();
+            nd.enc = encode_name(dit->first.data(), arena.alloc(nd.enc_len + 1));
+
+            const char *const sdll = name_for(nd, dll_name_id);
+            Section *const dll_section = addSection(sdll, dll, strlen(dll) + 1, 0); // the dll
+            const Symbol *const dll_symbol = addSymbol(sdll, dll_section, 0);
+            nd.name_section = dll_section;
+
+            desc = addSection(name_for(nd, descriptor_id), zeros, sizeof(zeros), 0); // descriptor
+            addRelocation(desc, offsetof(import_desc, dllname), "R_X86_64_32", dll_symbol, 0);
         }
-        tstr thunk(proc == nullptr ? name_for_dll(dll, thunk_id)
-                                   : name_for_proc(dll, proc, thunk_id, tsep));
-
-        if (findSection(thunk, false) != nullptr)
+        Dll &d = dit->second;
+
+        const Section **slot = &d.empty_thunk;
+        if (proc != nullptr) {
+            auto pit = d.procs.find(proc);
+            if (pit == d.procs.end())
+                pit = d.procs.emplace(arena.dup(proc, strlen(proc)), Thunk()).first;
+            slot = tsep == thunk_separator_first ? &pit->second.first : &pit->second.other;
+        }
+        if (*slot != nullptr)
             return; // we already have this dll/proc
-        addSection(thunk, zeros, thunk_size, 0);
-        addSymbol(thunk, thunk, 0);
+        const char *const thunk =
+            proc == nullptr ? name_for(d, thunk_id) : name_for(d, thunk_id, tsep, proc);
+        Section *const thunk_section = addSection(thunk, zeros, thunk_size, 0);
+        const Symbol *const thunk_symbol = addSymbol(thunk, thunk_section, 0);
+        *slot = thunk_section;
         if (tsep == thunk_separator_first) {
-            addRelocation(desc_name, offsetof(import_desc, iat), "R_X86_64_32", thunk, 0);
+            addRelocation(desc, offsetof(import_desc, iat), "R_X86_64_32", thunk_symbol, 0);
 
-            tstr last_thunk(name_for_proc(dll, "X", thunk_id, thunk_separator_last));
+            const char *const last_thunk = name_for(d, thunk_id, thunk_separator_last, "X");
             addSection(last_thunk, zeros, thunk_size, 0);
         }
 
         const char *reltype = thunk_size == 4 ? "R_X86_64_32" : "R_X86_64_64";
         if (ordinal != 0u) {
-            addRelocation(thunk, 0, reltype, "*UND*", ordinal | (1ull << (thunk_size * 8 - 1)));
+            addRelocation(thunk_section, 0, reltype, und_symbol,
+                          ordinal | (1ull << (thunk_size * 8 - 1)));
         } else if (proc != nullptr) {
-            tstr proc_name(name_for_proc(dll, proc, proc_name_id, procname_separator));
-            addSection(proc_name, zeros, 2, 1); // 2 bytes of word aligned "hint"
-            addSymbol(proc_name, proc_name, 0);
-            addRelocation(thunk, 0, reltype, proc_name, 0);
+            const char *const proc_name = name_for(d, proc_name_id, procname_separator, proc);
+            // 2 bytes of word aligned "hint"
+            Section *const proc_section = addSection(proc_name, zeros, 2, 1);
+            addRelocation(thunk_section, 0, reltype, addSymbol(proc_name, proc_section, 0), 0);
 
-            strcat(proc_name, "X");
-            addSection(proc_name, proc, strlen(proc), 0); // the name of the symbol
+            addSection(name_for(d, proc_name_id, procname_separator, proc, "X"), proc,
+                       strlen(proc), 0); // the name of the symbol
         } else
             infoWarning("empty import: %s", dll);
     }
 
-    static int __acc_cdecl_qsort compare(const void *p1, const void *p2) {
-        const Section *s1 = *(const Section *const *) p1;
-        const Section *s2 = *(const Section *const *) p2;
-        return strcmp(s1->name, s2->name);
-    }
-
     virtual void alignCode(unsigned len) override { alignWithByte(len, 0); }
 
-    const Section *getThunk(const char *dll, const char *proc, char tsep) const {
-        assert(dll);
+    const Section *getThunk(const char *dll, const char *proc) const {
         assert(proc);
-        tstr thunk(name_for_proc(dll, proc, thunk_id, tsep));
-        return findSection(thunk, false);
+        const Dll *d = findDll(dll);
+        if (d != nullptr) {
+            auto it = d->procs.find(proc);
+            if (it != d->procs.end())
+                return it->second.first ? it->second.first : it->second.other;
+        }
+        return nullptr;
     }
 
 public:
     explicit ImportLinker(unsigned thunk_size_) : thunk_size(thunk_size_) {
         assert(thunk_size == 4 || thunk_size == 8);
         addSection("*UND*", nullptr, 0, 0);
-        addSymbol("*UND*", "*UND*", 0);
+        und_symbol = addSymbol("*UND*", "*UND*", 0);
         addSection("*ZSTART", nullptr, 0, 0);
         addSymbol("*ZSTART", "*ZSTART", 0);
         Section *s = addSection("Dzero", zeros, sizeof(import_desc), 0);
@@ -727,7 +798,9 @@ public:
         outputlen = 0;
 
         // sort the sections by name before adding them all
-        qsort(sections, nsections, sizeof(Section *), ImportLinker::compare);
+        std::sort(sections, sections + nsections, [](const Section *s1, const Section *s2) {
+            return strcmp(s1->name, s2->name) < 0;
+        });
 
         for (unsigned ic = 0; ic < nsections; ic++)
             addLoader(sections[ic]->name);
@@ -750,9 +823,8 @@ public:
     upx_uint64_t getAddress(const C1 *dll, const C2 *proc) const {
         ACC_COMPILE_TIME_ASSERT(sizeof(C1) == 1) // "char" or "unsigned char"
         ACC_COMPILE_TIME_ASSERT(sizeof(C2) == 1) // "char" or "unsigned char"
-        const Section *s = getThunk((const char *) dll, (const char *) proc, thunk_separator_first);
-        if (s == nullptr &&
-            (s = getThunk((const char *) dll, (const char *) proc, thunk_separator)) == nullptr)
+        const Section *s = getThunk((const char *) dll, (const char *) proc);
+        if (s == nullptr)
             throwInternalError("entry not found");
         return s->offset;
     }
@@ -764,8 +836,8 @@ public:
         char ord[1 + 5 + 1];
         upx_safe_snprintf(ord, sizeof(ord), "%c%05u", ordinal_id, ordinal);
 
-        const Section *s = getThunk((const char *) dll, ord, thunk_separator_first);
-        if (s == nullptr && (s = getThunk((const char *) dll, ord, thunk_separator)) == nullptr)
+        const Section *s = getThunk((const char *) dll, ord);
+        if (s == nullptr)
             throwInternalError("entry not found");
         return s->offset;
     }
@@ -773,15 +845,16 @@ public:
     template <typename C>
     upx_uint64_t getAddress(const C *dll) const {
         ACC_COMPILE_TIME_ASSERT(sizeof(C) == 1) // "char" or "unsigned char"
-        tstr sdll(name_for_dll((const char *) dll, dll_name_id));
-        return findSection(sdll, true)->offset;
+        const Dll *d = findDll((const char *) dll);
+        if (d == nullptr)
+            throwInternalError("entry not found");
+        return d->name_section->offset;
     }
 
     template <typename C>
     upx_uint64_t hasDll(const C *dll) const {
         ACC_COMPILE_TIME_ASSERT(sizeof(C) == 1) // "char" or "unsigned char"
-        tstr sdll(name_for_dll((const char *) dll, dll_name_id));
-        return findSection(sdll, false) != nullptr;
+        return findDll((const char *) dll) != nullptr;
     }
 };
 const char PeFile::ImportLinker::zeros[sizeof(import_desc)] = {0};
@@ -3066,4 +3139,107 @@ void PeFile64::processTls(Reloc *r, const Interval *iv, unsigned a) {
  <offset of extra info 4>
 */
 
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+#if DEBUG && !defined(DOCTEST_CONFIG_DISABLE) && 1
+
+namespace {
+struct PeFileTest : public PeFile {
+    using PeFile::ImportLinker;
+    using PeFile::Interval;
+};
+} // namespace
+
+TEST_CASE("PeFile::Interval") {
+    typedef PeFileTest::Interval Interval;
+    const unsigned n = 1000000;
+    const unsigned space = 1u << 22;
+    std::vector<upx_byte> want(space + 32), got(space + 32);
+    Interval a(nullptr), b(nullptr);
+    upx_uint32_t seed = 0x27182818;
+    for (unsigned i = 0; i < n; i++) {
+        seed = seed * 1103515245 + 12345;
+        const unsigned start = (seed >> 8) % space;
+        const unsigned len = 1 + (seed & 15);
+        memset(&want[start], 1, len);
+        (i & 1 ? a : b).add(start, len);
+    }
+    a.add(&b);
+    CHECK(a.ivnum == n);
+    a.flatten();
+    for (unsigned ic = 0; ic < a.ivnum; ic++) {
+        if (ic > 0) // sorted, and neither overlapping nor adjacent
+            CHECK(a.ivarr[ic - 1].start + a.ivarr[ic - 1].len < a.ivarr[ic].start);
+        memset(&got[a.ivarr[ic].start], 1, a.ivarr[ic].len);
+    }
+    CHECK(want == got);
+
+    Interval c(nullptr);
+    c.add(10u, 5u);
+    c.add(0u, 10u);
+    c.add(20u, 0u);
+    c.add(12u, 1u);
+    c.flatten();
+    CHECK(c.ivnum == 2);
+    CHECK((c.ivarr[0].start == 0 && c.ivarr[0].len == 15));
+    CHECK((c.ivarr[1].start == 20 && c.ivarr[1].len == 0));
+}
+
+// build the import table of a synthetic PE with 20000 imports, and check
+// every descriptor and thunk against getAddress()
+TEST_CASE("PeFile::ImportLinker") {
+    typedef PeFileTest::ImportLinker ImportLinker;
+    const unsigned n = 20000;
+    const unsigned ndlls = 97;
+    const unsigned base = 0x1000; // the rva of the import table
+    for (unsigned thunk_size = 4; thunk_size <= 8; thunk_size += 4) {
+        ImportLinker il(thunk_size);
+        char dll[32], proc[32];
+        for (unsigned i = 0; i < n; i++) {
+            snprintf(dll, sizeof(dll), "%s%u.dll", (i & 1) ? "Dll" : "DLL", i % ndlls);
+            if (i % 5 == 0) {
+                il.add(dll, 1 + i / ndlls);
+            } else {
+                snprintf(proc, sizeof(proc), "Proc%u", i);
+                il.add(dll, proc);
+            }
+        }
+        CHECK(il.hasDll("dll5.DLL"));
+        CHECK(!il.hasDll("dll5"));
+        const unsigned len = il.build();
+        il.relocate_import(base);
+        int olen = 0;
+        const upx_byte *const out = il.getLoader(&olen);
+        CHECK(olen == (int) len);
+
+        unsigned dlls = 0, thunks = 0, ordinals = 0;
+        for (const upx_byte *desc = out; get_le32(desc + 12) != 0; desc += 20) {
+            const char *const name = (const char *) out + get_le32(desc + 12) - base;
+            CHECK(il.getAddress(name) == get_le32(desc + 12));
+            for (unsigned t = get_le32(desc + 16);; t += thunk_size) {
+                const upx_byte *const thunk = out + t - base;
+                const upx_uint64_t v = thunk_size == 4 ? get_le32(thunk) : get_le64(thunk);
+                if (v == 0)
+                    break;
+                if (v >> (thunk_size * 8 - 1)) {
+                    CHECK(il.getAddress(name, (unsigned) (v & 0xffff)) == t);
+                    ordinals++;
+                } else {
+                    const char *const pname = (const char *) out + v - base + 2; // skip the hint
+                    CHECK(il.getAddress(name, pname) == t);
+                }
+                thunks++;
+            }
+            dlls++;
+        }
+        CHECK(dlls == ndlls);
+        CHECK(thunks == n);
+        CHECK(ordinals == n / 5);
+    }
+}
+
+#endif // DEBUG
+
 /* vim:set ts=4 sw=4 et: */
@@ -338,6 +338,7 @@ protected:
         void dump() const;
 
     private:
+        void reserve(unsigned n);
         static int __acc_cdecl_qsort compare(const void *p1, const void *p2);
     };
 
@@ -64,6 +64,101 @@ static forceinline bool use_simple_mcheck() {
 static forceinline constexpr bool use_simple_mcheck() { return true; }
 #endif
 
+/*************************************************************************
+// size-class pool
+//
+// A pack allocates buffers of the same few sizes over and over (e.g. one
+// set per block in PackUnix::packExtent), so freed blocks are kept in
+// per-thread free lists, one per power-of-two size class, and are handed
+// out again by alloc(). Blocks keep their simple-mcheck canaries, which are
+// rewritten for the requested size on every alloc().
+// Disabled together with simple-mcheck, as recycled memory would hide
+// use-after-free errors from ASan and valgrind.
+**************************************************************************/
+
+namespace {
+struct BufferPool final {
+    enum : unsigned {
+        MIN_CLASS = 12,          // 4 KiB; smaller blocks go directly to malloc()
+        MAX_CLASS = 30,          // 1 GiB; above the largest possible MemBuffer
+        MAX_BLOCKS_PER_CLASS = 4,
+    };
+    static constexpr size_t MAX_CACHED_BYTES = 256 * 1024 * 1024;
+
+    void *blocks[MAX_CLASS - MIN_CLASS + 1][MAX_BLOCKS_PER_CLASS] = {};
+    unsigned count[MAX_CLASS - MIN_CLASS + 1] = {};
+    size_t cached_bytes = 0;
+
+    ~BufferPool() noexcept { release(); }
+
+    void release() noexcept {
+        for (unsigned k = 0; k <= MAX_CLASS - MIN_CLASS; k++) {
+            while (count[k] > 0)
+                ::free(blocks[k][--count[k]]);
+        }
+        cached_bytes = 0;
+    }
+
+    // return the size class of a raw allocation, or 0 if it is not pooled
+    static unsigned size_class(size_t bytes) noexcept {
+        if (bytes <= (size_t(1) << MIN_CLASS))
+            return bytes == (size_t(1) << MIN_CLASS) ? unsigned(MIN_CLASS) : 0u;
+        if (bytes > (size_t(1) << MAX_CLASS))
+            return 0;
+        unsigned k = MIN_CLASS;
+        while ((size_t(1) << k) < bytes)
+            k++;
+        return k;
+    }
+};
+} // namespace
+
+static BufferPool &thread_buffer_pool() {
+    static thread_local BufferPool pool;
+    return pool;
+}
+
+static forceinline bool use_buffer_pool() { return use_simple_mcheck(); }
+
+// NOTE: like malloc() the returned memory is uninitialized; callers must
+//   pass the same "bytes" to pool_free() that they passed to pool_malloc()
+static void *pool_malloc(size_t bytes, upx_std_atomic(upx_uint64_t) & hits,
+                         upx_std_atomic(upx_uint64_t) & misses) {
+    const unsigned k = use_buffer_pool() ? BufferPool::size_class(bytes) : 0;
+    if (k == 0)
+        return ::malloc(bytes);
+    BufferPool &pool = thread_buffer_pool();
+    unsigned &n = pool.count[k - BufferPool::MIN_CLASS];
+    if (n > 0) {
+        hits += 1;
+        pool.cached_bytes -= size_t(1) << k;
+        return pool.blocks[k - BufferPool::MIN_CLASS][--n];
+    }
+    misses += 1;
+    return ::malloc(size_t(1) << k);
+}
+
+static void pool_free(void *p, size_t bytes) {
+    const unsigned k = use_buffer_pool() ? BufferPool::size_class(bytes) : 0;
+    if (k != 0) {
+        BufferPool &pool = thread_buffer_pool();
+        unsigned &n = pool.count[k - BufferPool::MIN_CLASS];
+        const size_t class_bytes = size_t(1) << k;
+        if (n < BufferPool::MAX_BLOCKS_PER_CLASS &&
+            pool.cached_bytes + class_bytes <= BufferPool::MAX_CACHED_BYTES) {
+            pool.blocks[k - BufferPool::MIN_CLASS][n++] = p;
+            pool.cached_bytes += class_bytes;
+            return;
+        }
+    }
+    ::free(p);
+}
+
+/*static*/ void MemBuffer::releasePool() {
+    if (use_buffer_pool())
+        thread_buffer_pool().release();
+}
+
 /*************************************************************************
 //
 **************************************************************************/
@@ -203,7 +298,7 @@ void MemBuffer::alloc(upx_uint64_t size) {
     assert(size > 0);
     debug_set(debug.last_return_address_alloc, upx_return_address());
     size_t bytes = mem_size(1, size, use_simple_mcheck() ? 32 : 0);
-    unsigned char *p = (unsigned char *) malloc(bytes);
+    unsigned char *p = (unsigned char *) pool_malloc(bytes, stats.pool_hits, stats.pool_misses);
     NO_printf("MemBuffer::alloc %llu: %p\n", size, p);
     if (!p)
         throwOutOfMemoryException();
@@ -238,9 +333,9 @@ void MemBuffer::dealloc() {
             set_ne32(b + b_size_in_bytes, 0);
             set_ne32(b + b_size_in_bytes + 4, 0);
             //
-            ::free(b - 16);
+            pool_free(b - 16, mem_size(1, b_size_in_bytes, 32));
         } else
-            ::free(b);
+            pool_free(b, b_size_in_bytes);
         b = nullptr;
         b_size_in_bytes = 0;
     } else {
@@ -277,6 +372,46 @@ TEST_CASE("MemBuffer") {
     }
 }
 
+TEST_CASE("MemBuffer pool") {
+    MemBuffer::releasePool();
+    const upx_uint64_t hits = MemBuffer::getPoolHits();
+    const upx_uint64_t misses = MemBuffer::getPoolMisses();
+    void *p = nullptr;
+    {
+        MemBuffer mb(100000);
+        p = mb.getVoidPtr();
+        mb.fill(0, mb.getSize(), 0x55);
+    }
+    {
+        // same size class => same block, with fresh canaries
+        MemBuffer mb(70000);
+        if (use_buffer_pool()) {
+            CHECK(mb.getVoidPtr() == p);
+            CHECK(MemBuffer::getPoolHits() == hits + 1);
+            CHECK(MemBuffer::getPoolMisses() == misses + 1);
+        }
+        mb.checkState();
+        mb.fill(0, mb.getSize(), 0xaa);
+        mb.checkState();
+    }
+    {
+        // small blocks are not pooled
+        MemBuffer mb(64);
+        CHECK(MemBuffer::getPoolMisses() == misses + (use_buffer_pool() ? 1 : 0));
+    }
+    MemBuffer::releasePool();
+    {
+        MemBuffer mb(100000);
+        CHECK(MemBuffer::getPoolMisses() == misses + (use_buffer_pool() ? 2 : 0));
+    }
+    MemBuffer::releasePool();
+    CHECK(BufferPool::size_class(4095) == 0);
+    CHECK(BufferPool::size_class(4096) == 12);
+    CHECK(BufferPool::size_class(4097) == 13);
+    CHECK(BufferPool::size_class(size_t(1) << 30) == 30);
+    CHECK(BufferPool::size_class((size_t(1) << 30) + 1) == 0);
+}
+
 TEST_CASE("MemBuffer::getSizeForCompression") {
     CHECK_THROWS(MemBuffer::getSizeForCompression(0));
     CHECK_THROWS(MemBuffer::getSizeForDecompression(0));
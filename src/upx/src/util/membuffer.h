@@ -91,6 +91,11 @@ public:
     void checkState() const;
     unsigned getSize() const { return b_size_in_bytes; }
 
+    // freed buffers are recycled through a per-thread pool, see membuffer.cpp
+    static void releasePool(); // free the cached buffers of the calling thread
+    static upx_uint64_t getPoolHits() { return stats.pool_hits; }
+    static upx_uint64_t getPoolMisses() { return stats.pool_misses; }
+
     // explicit converstion
     void *getVoidPtr() { return (void *) b; }
     const void *getVoidPtr() const { return (const void *) b; }
@@ -116,6 +121,8 @@ private:
         upx_std_atomic(upx_uint32_t) global_alloc_counter;
         upx_std_atomic(upx_uint64_t) global_total_bytes;
         upx_std_atomic(upx_uint64_t) global_total_active_bytes;
+        upx_std_atomic(upx_uint64_t) pool_hits;
+        upx_std_atomic(upx_uint64_t) pool_misses;
     };
     static Stats stats;
 #if DEBUG
@@ -0,0 +1,170 @@
+/* threads.cpp --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2023 Markus Franz Xaver Johannes Oberhumer
+   Copyright (C) 1996-2023 Laszlo Molnar
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer              Laszlo Molnar
+   <markus@oberhumer.com>               <ezerotven+github@gmail.com>
+ */
+
+#include "../conf.h"
+#include "threads.h"
+
+/*************************************************************************
+//
+**************************************************************************/
+
+unsigned upx_get_threads() noexcept {
+#if (WITH_THREADS)
+    unsigned n = opt->threads > 0 ? (unsigned) opt->threads : 0;
+    if (n == 0)
+        n = std::thread::hardware_concurrency();
+    if (n == 0) // not computable
+        n = 1;
+    return UPX_MIN(n, 64u);
+#else
+    return 1;
+#endif
+}
+
+/*************************************************************************
+// ThreadPool
+**************************************************************************/
+
+#if (WITH_THREADS)
+
+ThreadPool::ThreadPool(unsigned nthreads) {
+    workers.reserve(nthreads);
+    for (unsigned t = 0; t < nthreads; t++) {
+        try {
+            workers.emplace_back([this]() { workerLoop(); });
+        } catch (const std::system_error &) {
+            break; // cannot create more threads - continue with what we have
+        }
+    }
+}
+
+ThreadPool::~ThreadPool() noexcept {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        queue.clear();
+    }
+    cond.notify_all();
+    for (auto &t : workers)
+        t.join();
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task) {
+    std::packaged_task<void()> pt(std::move(task));
+    std::future<void> f = pt.get_future();
+    if (workers.empty()) {
+        pt(); // no threads at all - run the task right here
+        return f;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(pt));
+    }
+    cond.notify_one();
+    return f;
+}
+
+void ThreadPool::workerLoop() noexcept {
+    for (;;) {
+        std::packaged_task<void()> pt;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (stopping)
+                return;
+            pt = std::move(queue.front());
+            queue.pop_front();
+        }
+        pt(); // exceptions are stored in the future
+    }
+}
+
+#endif // WITH_THREADS
+
+/*************************************************************************
+//
+**************************************************************************/
+
+TEST_CASE("upx_parallel_for") {
+    for (unsigned nthreads = 0; nthreads <= 5; nthreads++) {
+        unsigned v[100];
+        memset(v, 0, sizeof(v));
+        upx_parallel_for(100, nthreads, [&](unsigned i) { v[i] += i + 1; });
+        for (unsigned i = 0; i < 100; i++)
+            CHECK(v[i] == i + 1);
+    }
+    upx_parallel_for(0, 4, [](unsigned) { throwInternalError("empty range"); });
+}
+
+TEST_CASE("upx_parallel_for exceptions") {
+    for (unsigned nthreads = 1; nthreads <= 4; nthreads++) {
+        upx_std_atomic(unsigned) count;
+        count = 0;
+        const char *msg = nullptr;
+        try {
+            upx_parallel_for(16, nthreads, [&](unsigned i) {
+                count += 1;
+                if (i == 3)
+                    throwInternalError("task 3");
+                if (i == 9)
+                    throwCantPack("task 9");
+            });
+        } catch (const Throwable &e) {
+            msg = e.getMsg();
+        }
+        REQUIRE(msg != nullptr);
+        CHECK(strcmp(msg, "task 3") == 0);
+        // the serial loop stops at the first exception
+        CHECK(count == (nthreads == 1 ? 4u : 16u));
+    }
+}
+
+#if (WITH_THREADS)
+TEST_CASE("ThreadPool") {
+    ThreadPool pool(3);
+    CHECK(pool.getThreads() <= 3);
+    unsigned v[64];
+    memset(v, 0, sizeof(v));
+    std::vector<std::future<void> > futures;
+    for (unsigned i = 0; i < 64; i++)
+        futures.push_back(pool.submit([&v, i]() {
+            if (i == 42)
+                throwCantPack("task 42");
+            v[i] = i + 1;
+        }));
+    for (unsigned i = 0; i < 64; i++) {
+        if (i == 42)
+            CHECK_THROWS(futures[i].get());
+        else {
+            futures[i].get();
+            CHECK(v[i] == i + 1);
+        }
+    }
+}
+#endif
+
+/* vim:set ts=4 sw=4 et: */
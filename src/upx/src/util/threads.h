@@ -0,0 +1,143 @@
+/* threads.h --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2023 Markus Franz Xaver Johannes Oberhumer
+   Copyright (C) 1996-2023 Laszlo Molnar
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer              Laszlo Molnar
+   <markus@oberhumer.com>               <ezerotven+github@gmail.com>
+ */
+
+#pragma once
+#ifndef UPX_THREADS_H__
+#define UPX_THREADS_H__ 1
+
+#include <exception>
+#include <vector>
+#if (WITH_THREADS)
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#endif
+
+/*************************************************************************
+// number of worker threads as requested by "--threads=N"
+// (0 means "use all available CPUs"); always 1 if !WITH_THREADS
+**************************************************************************/
+
+unsigned upx_get_threads() noexcept;
+
+/*************************************************************************
+// upx_parallel_for - run task(i) for all i in [0, n) using up to
+// nthreads threads (including the calling thread)
+//
+// The task must not touch the UI or any shared Packer state.
+// If tasks throw, the exception of the lowest index is rethrown
+// in the calling thread after all threads have finished.
+**************************************************************************/
+
+template <class Task>
+void upx_parallel_for(unsigned n, unsigned nthreads, const Task &task) {
+    if (nthreads > n)
+        nthreads = n;
+#if (WITH_THREADS)
+    if (nthreads > 1) {
+        std::atomic<unsigned> next_index(0);
+        std::vector<std::exception_ptr> errors(n);
+        auto worker = [&]() noexcept {
+            for (;;) {
+                const unsigned i = next_index.fetch_add(1);
+                if (i >= n)
+                    break;
+                try {
+                    task(i);
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        threads.reserve(nthreads - 1);
+        for (unsigned t = 1; t < nthreads; t++) {
+            try {
+                threads.emplace_back(worker);
+            } catch (const std::system_error &) {
+                break; // cannot create more threads - continue with what we have
+            }
+        }
+        worker();
+        for (auto &t : threads)
+            t.join();
+        for (auto &e : errors)
+            if (e)
+                std::rethrow_exception(e);
+        return;
+    }
+#else
+    UNUSED(nthreads);
+#endif
+    for (unsigned i = 0; i < n; i++)
+        task(i);
+}
+
+/*************************************************************************
+// ThreadPool - a fixed number of worker threads serving a FIFO queue
+//
+// submit() returns a std::future; get() rethrows any exception of the task.
+// The destructor discards all tasks which have not been started yet and
+// waits for the running ones.
+**************************************************************************/
+
+#if (WITH_THREADS)
+
+class ThreadPool final {
+public:
+    explicit ThreadPool(unsigned nthreads);
+    ~ThreadPool() noexcept;
+
+    std::future<void> submit(std::function<void()> task);
+    unsigned getThreads() const noexcept { return (unsigned) workers.size(); }
+
+private:
+    void workerLoop() noexcept;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::packaged_task<void()> > queue;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+
+    // disable copy and move
+    ThreadPool(const ThreadPool &) DELETED_FUNCTION;
+    ThreadPool &operator=(const ThreadPool &) DELETED_FUNCTION;
+    ThreadPool(ThreadPool &&) DELETED_FUNCTION;
+    ThreadPool &operator=(ThreadPool &&) DELETED_FUNCTION;
+};
+
+#endif // WITH_THREADS
+
+#endif /* already included */
+
+/* vim:set ts=4 sw=4 et: */
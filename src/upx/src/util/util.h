@@ -108,6 +108,11 @@ int find_le64(const void *b, int blen, upx_uint64_t what);
 
 int mem_replace(void *b, int blen, const void *what, int wlen, const void *r);
 
+// sort an array of n le32 values in place, like qsort(b, n, 4, le32_compare)
+void sort_le32(void *b, unsigned n);
+// same, and remove duplicates; returns the new number of values
+unsigned sort_le32_unique(void *b, unsigned n);
+
 char *fn_basename(const char *name);
 int fn_strcmp(const char *n1, const char *n2);
 char *fn_strlwr(char *n);
@@ -318,6 +318,8 @@ int do_files(int i, int argc, char *argv[]) {
             main_set_exit_code(EXIT_ERROR);
             return -1; // fatal error
         }
+        // buffers are recycled within one file only
+        MemBuffer::releasePool();
     }
 
     if (opt->cmd == CMD_COMPRESS)
@@ -0,0 +1,98 @@
+// Round trip of the LLVM loader payload kernel: everything encryptPayload()
+// encodes must come back from decryptPayload() and each of its vector paths.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "payload_kernel.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* what, unsigned int size) {
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s, size %u\n", what, size);
+        ++failures;
+    }
+}
+
+template <unsigned int NumKeys>
+void roundTrip(const std::vector<unsigned char>& plain, unsigned int size, const unsigned char (&keys)[NumKeys]) {
+    std::vector<unsigned char> encrypted(size + 1), decrypted(size + 1, 0xCC);
+    encryptPayload(plain.data(), encrypted.data(), size, keys);
+    decryptPayload(encrypted.data(), decrypted.data(), size, keys);
+    check(std::equal(plain.begin(), plain.begin() + size, decrypted.begin()), "decryptPayload", size);
+    check(decrypted[size] == 0xCC, "decryptPayload writes past the end", size);
+
+#ifdef PAYLOAD_X86
+    unsigned char pad[256];
+    buildPayloadPad(keys, pad);
+    std::vector<unsigned char> sse2(size + 1, 0xCC);
+    const unsigned int sse2Done = decryptPayloadSse2(encrypted.data(), sse2.data(), size, pad);
+    check(sse2Done == size / 16 * 16, "decryptPayloadSse2 block count", size);
+    decryptPayloadScalar(encrypted.data(), sse2.data(), sse2Done, size, pad);
+    check(std::equal(plain.begin(), plain.begin() + size, sse2.begin()), "decryptPayloadSse2", size);
+    check(sse2[size] == 0xCC, "decryptPayloadSse2 writes past the end", size);
+
+    if (cpuHasAvx2()) {
+        std::vector<unsigned char> avx2(size + 1, 0xCC);
+        const unsigned int avx2Done = decryptPayloadAvx2(encrypted.data(), avx2.data(), size, pad);
+        check(avx2Done == size / 32 * 32, "decryptPayloadAvx2 block count", size);
+        decryptPayloadScalar(encrypted.data(), avx2.data(), avx2Done, size, pad);
+        check(std::equal(plain.begin(), plain.begin() + size, avx2.begin()), "decryptPayloadAvx2", size);
+        check(avx2[size] == 0xCC, "decryptPayloadAvx2 writes past the end", size);
+    }
+#endif
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 gen(12345);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<unsigned char> plain(1 << 20);
+    for (unsigned char& c : plain) {
+        c = static_cast<unsigned char>(byte(gen));
+    }
+
+    // Same key count as the loader, and the extremes allowed by the static_assert
+    const unsigned char keys4[4] = {0x3A, 0xC5, 0x01, 0xFF};
+    const unsigned char keys1[1] = {0x5D};
+    unsigned char keys256[256];
+    for (unsigned char& k : keys256) {
+        k = static_cast<unsigned char>(byte(gen));
+    }
+
+    std::vector<unsigned int> sizes;
+    for (unsigned int size = 0; size <= 600; ++size) {
+        sizes.push_back(size);
+    }
+    for (unsigned int size : {4095u, 4096u, 4097u, 65535u, 65536u, 65567u, 1u << 20}) {
+        sizes.push_back(size);
+    }
+    for (unsigned int size : sizes) {
+        roundTrip(plain, size, keys4);
+        roundTrip(plain, size, keys1);
+        roundTrip(plain, size, keys256);
+    }
+
+    // The key stream itself: byte i is keys[i % n] ^ (i & 0xFF)
+    std::vector<unsigned char> zeros(1000, 0), stream(1000);
+    encryptPayload(zeros.data(), stream.data(), 1000, keys4);
+    for (unsigned int i = 0; i < 1000; ++i) {
+        check(stream[i] == (unsigned char)(keys4[i % 4] ^ (i & 0xFF)), "key stream", i);
+    }
+
+    if (failures != 0) {
+        std::fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+#ifdef PAYLOAD_X86
+    std::printf("payload kernel: %zu sizes ok (AVX2 %s)\n", sizes.size(), cpuHasAvx2() ? "tested" : "not available");
+#else
+    std::printf("payload kernel: %zu sizes ok\n", sizes.size());
+#endif
+    return 0;
+}
@@ -0,0 +1,89 @@
+// Newline handling of the source protection I/O: MappedFile::textView() must
+// read a file like a text-mode std::ifstream and FileSink must write it like a
+// text-mode std::ofstream, which is what the passes used before streaming.
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include "mapped_file.h"
+#include "text_sink.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* what, const std::string& text) {
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s, input of %zu bytes\n", what, text.size());
+        ++failures;
+    }
+}
+
+std::string readBinary(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void writeBinary(const std::string& path, const std::string& content) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(content.data(), std::streamsize(content.size()));
+}
+
+void compareWithStreams(const std::string& content) {
+    const std::string path = "text_mode_test.input";
+    const std::string sinkPath = "text_mode_test.sink";
+    const std::string streamPath = "text_mode_test.stream";
+    writeBinary(path, content);
+
+    std::ifstream stream(path);
+    const std::string expected((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    stream.close();
+
+    MappedFile file;
+    check(file.open(path), "MappedFile::open", content);
+    std::string storage;
+    const std::string_view text = file.textView(storage);
+    check(text == expected, "textView differs from a text-mode ifstream", content);
+
+    FileSink sink(sinkPath);
+    sink.write(text);
+    check(sink.finish(), "FileSink::finish", content);
+    std::ofstream(streamPath) << expected;
+    check(readBinary(sinkPath) == readBinary(streamPath), "FileSink differs from a text-mode ofstream", content);
+
+    std::remove(path.c_str());
+    std::remove(sinkPath.c_str());
+    std::remove(streamPath.c_str());
+}
+
+} // namespace
+
+int main() {
+    // crlfToLf() is what textView() applies on Windows
+    std::string storage;
+    check(crlfToLf("a\r\nb\r\n", storage) == "a\nb\n", "crlfToLf", "a\r\nb\r\n");
+    check(crlfToLf("\r\n\r\n", storage) == "\n\n", "crlfToLf", "\r\n\r\n");
+    check(crlfToLf("a\rb\n\r", storage) == "a\rb\n\r", "crlfToLf keeps lone CR", "a\rb\n\r");
+    const std::string_view unix = "int main() {\n}\n";
+    check(crlfToLf(unix, storage).data() == unix.data(), "crlfToLf copies text without CRLF", std::string(unix));
+
+    for (const char* content : {"", "int main() {\n    return 0;\n}\n", "int main() {\r\n    return 0;\r\n}\r\n",
+                                "mixed\r\nline\nendings\r\r\n", "no newline at the end\r",
+                                "const char* s = \"a\\r\\n\";\r\n"}) {
+        compareWithStreams(content);
+    }
+    // Longer than the FileSink buffer, with CRLF pairs across its boundary
+    std::string large;
+    while (large.size() < 200 * 1024) {
+        large += "line " + std::to_string(large.size()) + "\r\n";
+    }
+    compareWithStreams(large);
+
+    if (failures != 0) {
+        std::fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    std::printf("text mode: ok\n");
+    return 0;
+}
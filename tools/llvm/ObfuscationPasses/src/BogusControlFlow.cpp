@@ -0,0 +1,110 @@
+#include "BogusControlFlow.h"
+#include "OpaquePredicate.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/xxhash.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include <random>
+
+using namespace llvm;
+
+namespace obfuscation {
+
+namespace {
+
+// The copy ends in a branch instead of the original terminator and must be
+// valid IR that is never run: no EH pads, no tokens, no musttail calls, and
+// nothing that may not be duplicated
+bool canSplit(const BasicBlock& block) {
+    if (block.isEHPad() || block.isLandingPad()) {
+        return false;
+    }
+    for (const Instruction& instruction : block) {
+        if (instruction.getType()->isTokenTy()) {
+            return false;
+        }
+        if (const auto* call = dyn_cast<CallBase>(&instruction)) {
+            if (call->cannotDuplicate() || call->isConvergent()) {
+                return false;
+            }
+            if (const auto* callInst = dyn_cast<CallInst>(call); callInst && callInst->isMustTailCall()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Alter the copy so it is not an exact duplicate of the live block: the
+// second operand of its 32-bit arithmetic becomes the opaque value
+void scramble(BasicBlock& copy, const OpaquePredicate& predicate) {
+    IRBuilder<> builder(&copy, copy.getFirstInsertionPt());
+    Value* opaque = predicate.load(builder);
+    for (Instruction& instruction : copy) {
+        auto* binary = dyn_cast<BinaryOperator>(&instruction);
+        if (binary && binary->getType() == opaque->getType()) {
+            binary->setOperand(1, opaque);
+        }
+    }
+}
+
+} // namespace
+
+PreservedAnalyses BogusControlFlowPass::run(Function& function, FunctionAnalysisManager&) {
+    return addBogusFlow(function, options) ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
+bool BogusControlFlowPass::addBogusFlow(Function& function, const BogusControlFlowOptions& options) {
+    if (function.isDeclaration() || options.probability == 0) {
+        return false;
+    }
+
+    // The entry block keeps its allocas in place and is never split
+    std::mt19937 random(static_cast<uint32_t>(xxHash64(function.getName())) ^ 0xB0605u);
+    SmallVector<BasicBlock*, 32> selected;
+    for (BasicBlock& block : function) {
+        if (&block != &function.getEntryBlock() && canSplit(block) && random() % 100 < options.probability) {
+            selected.push_back(&block);
+        }
+    }
+    if (selected.empty()) {
+        return false;
+    }
+
+    OpaquePredicate predicate(function);
+    for (BasicBlock* head : selected) {
+        // head keeps the PHIs, body everything else; the copy only gets
+        // head as its predecessor and body as its successor, so all values
+        // it uses from elsewhere still dominate it
+        BasicBlock* body = head->splitBasicBlock(head->getFirstNonPHI(), head->getName() + ".body");
+
+        ValueToValueMapTy mapping;
+        BasicBlock* copy = CloneBasicBlock(body, mapping, ".bogus", &function);
+        copy->moveAfter(body);
+        copy->getTerminator()->eraseFromParent();
+        for (Instruction& instruction : *copy) {
+            RemapInstruction(&instruction, mapping, RF_IgnoreMissingLocals | RF_NoModuleLevelChanges);
+        }
+
+        scramble(*copy, predicate);
+        IRBuilder<> copyBuilder(copy);
+        if (options.loop) {
+            copyBuilder.CreateCondBr(predicate.alwaysTrue(copyBuilder), body, copy);
+        } else {
+            copyBuilder.CreateBr(body);
+        }
+
+        head->getTerminator()->eraseFromParent();
+        IRBuilder<> headBuilder(head);
+        headBuilder.CreateCondBr(predicate.alwaysTrue(headBuilder), body, copy);
+    }
+    return true;
+}
+
+} // namespace obfuscation
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "llvm/IR/PassManager.h"
+
+namespace obfuscation {
+
+// Parameters of BogusControlFlowPass, see below
+struct BogusControlFlowOptions {
+    unsigned probability = 30;
+    bool loop = false;
+};
+
+// Bogus control flow: a block is split behind an opaque predicate that is
+// always true. The never-taken side holds an altered copy of the block, which
+// then jumps into the real one, so both look like live paths.
+//
+// Pipeline syntax: bogusflow<prob=N;loop>. prob is the percentage of blocks
+// that are split (default 30); with loop the copy can also branch back to
+// itself. The choice of blocks is derived from the function name.
+class BogusControlFlowPass : public llvm::PassInfoMixin<BogusControlFlowPass> {
+public:
+    explicit BogusControlFlowPass(BogusControlFlowOptions options = BogusControlFlowOptions()) : options(options) {}
+
+    llvm::PreservedAnalyses run(llvm::Function& function, llvm::FunctionAnalysisManager& analysisManager);
+
+    static bool addBogusFlow(llvm::Function& function, const BogusControlFlowOptions& options);
+
+private:
+    BogusControlFlowOptions options;
+};
+
+} // namespace obfuscation
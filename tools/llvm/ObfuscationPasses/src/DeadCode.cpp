@@ -0,0 +1,104 @@
+#include "DeadCode.h"
+#include "OpaquePredicate.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/xxhash.h"
+
+#include <random>
+
+using namespace llvm;
+
+namespace obfuscation {
+
+namespace {
+
+// A few random 32-bit operations on value
+Value* junk(IRBuilderBase& builder, Value* value, std::mt19937& random) {
+    const unsigned steps = 2 + random() % 4;
+    for (unsigned i = 0; i < steps; i++) {
+        Value* constant = builder.getInt32(random() | 1);
+        switch (random() % 4) {
+        case 0:
+            value = builder.CreateAdd(value, constant, "dead");
+            break;
+        case 1:
+            value = builder.CreateMul(value, constant, "dead");
+            break;
+        case 2:
+            value = builder.CreateXor(value, constant, "dead");
+            break;
+        default:
+            value = builder.CreateLShr(value, builder.getInt32(1 + random() % 31), "dead");
+            break;
+        }
+    }
+    return value;
+}
+
+} // namespace
+
+PreservedAnalyses DeadCodePass::run(Function& function, FunctionAnalysisManager&) {
+    return insertDeadCode(function, options) ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
+bool DeadCodePass::insertDeadCode(Function& function, const DeadCodeOptions& options) {
+    if (function.isDeclaration() || options.probability == 0) {
+        return false;
+    }
+
+    // The entry block keeps its allocas in place and is never split
+    std::mt19937 random(static_cast<uint32_t>(xxHash64(function.getName())) ^ 0xDEADu);
+    SmallVector<BasicBlock*, 32> selected;
+    for (BasicBlock& block : function) {
+        if (&block != &function.getEntryBlock() && !block.isEHPad() && random() % 100 < options.probability) {
+            selected.push_back(&block);
+        }
+    }
+    if (selected.empty()) {
+        return false;
+    }
+
+    LLVMContext& context = function.getContext();
+    OpaquePredicate predicate(function);
+    for (BasicBlock* head : selected) {
+        BasicBlock* body = head->splitBasicBlock(head->getFirstNonPHI(), head->getName() + ".live");
+        BasicBlock* dead = BasicBlock::Create(context, head->getName() + ".dead", &function, body);
+
+        IRBuilder<> builder(dead);
+        Value* value = junk(builder, predicate.load(builder), random);
+        if (options.complex) {
+            // for (i = 0; i != n; i++) value = junk(value) ^ i
+            BasicBlock* loop = BasicBlock::Create(context, head->getName() + ".dead.loop", &function, body);
+            builder.CreateBr(loop);
+            BasicBlock* preheader = dead;
+
+            builder.SetInsertPoint(loop);
+            PHINode* index = builder.CreatePHI(builder.getInt32Ty(), 2, "dead.i");
+            PHINode* accumulator = builder.CreatePHI(builder.getInt32Ty(), 2, "dead.acc");
+            Value* next = builder.CreateXor(junk(builder, accumulator, random), index, "dead");
+            Value* nextIndex = builder.CreateAdd(index, builder.getInt32(1), "dead.i.next");
+            Value* done = builder.CreateICmpEQ(nextIndex, builder.getInt32(4 + random() % 12));
+            index->addIncoming(builder.getInt32(0), preheader);
+            index->addIncoming(nextIndex, loop);
+            accumulator->addIncoming(value, preheader);
+            accumulator->addIncoming(next, loop);
+
+            BasicBlock* exit = BasicBlock::Create(context, head->getName() + ".dead.exit", &function, body);
+            builder.CreateCondBr(done, exit, loop);
+            builder.SetInsertPoint(exit);
+            value = next;
+        }
+        predicate.store(builder, value);
+        builder.CreateBr(body);
+
+        head->getTerminator()->eraseFromParent();
+        builder.SetInsertPoint(head);
+        builder.CreateCondBr(predicate.alwaysFalse(builder), dead, body);
+    }
+    return true;
+}
+
+} // namespace obfuscation
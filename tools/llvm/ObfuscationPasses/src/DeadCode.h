@@ -0,0 +1,32 @@
+#pragma once
+
+#include "llvm/IR/PassManager.h"
+
+namespace obfuscation {
+
+// Parameters of DeadCodePass, see below
+struct DeadCodeOptions {
+    unsigned probability = 30;
+    bool complex = false;
+};
+
+// Dead code insertion: blocks get a branch on an opaque predicate that is
+// always false, leading to generated arithmetic that looks live but never
+// runs.
+//
+// Pipeline syntax: deadcode<prob=N;complex>. prob is the percentage of blocks
+// that get dead code (default 30); with complex the dead code contains a
+// loop. The choice of blocks and the code are derived from the function name.
+class DeadCodePass : public llvm::PassInfoMixin<DeadCodePass> {
+public:
+    explicit DeadCodePass(DeadCodeOptions options = DeadCodeOptions()) : options(options) {}
+
+    llvm::PreservedAnalyses run(llvm::Function& function, llvm::FunctionAnalysisManager& analysisManager);
+
+    static bool insertDeadCode(llvm::Function& function, const DeadCodeOptions& options);
+
+private:
+    DeadCodeOptions options;
+};
+
+} // namespace obfuscation
@@ -1 +1,163 @@
- 
\ No newline at end of file
+#include "Flattening.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/xxhash.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+using namespace llvm;
+
+namespace obfuscation {
+
+namespace {
+
+// Only plain branches, switches and returns can be routed through the
+// dispatcher; exception handling edges, indirect branches and token values
+// (which cannot be spilled to the stack) make the function ineligible.
+bool canFlatten(const Function& function) {
+    if (function.isDeclaration() || function.size() < 2) {
+        return false;
+    }
+
+    for (const BasicBlock& block : function) {
+        if (block.isEHPad() || block.hasAddressTaken()) {
+            return false;
+        }
+        const Instruction* terminator = block.getTerminator();
+        if (!isa<BranchInst>(terminator) && !isa<SwitchInst>(terminator) &&
+            !isa<ReturnInst>(terminator) && !isa<UnreachableInst>(terminator)) {
+            return false;
+        }
+        for (const Instruction& instruction : block) {
+            if (instruction.getType()->isTokenTy()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Distinct, non-sequential case values: multiplying by an odd constant is a
+// bijection modulo 2^32 and so is the XOR with the per-function seed
+uint32_t caseValue(uint32_t seed, uint32_t index) {
+    return (index * 0x9E3779B1u) ^ seed;
+}
+
+} // namespace
+
+PreservedAnalyses FlatteningPass::run(Function& function, FunctionAnalysisManager&) {
+    return flatten(function) ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
+bool FlatteningPass::flatten(Function& function) {
+    if (!canFlatten(function)) {
+        return false;
+    }
+
+    LLVMContext& context = function.getContext();
+    Type* stateType = Type::getInt32Ty(context);
+    BasicBlock* entry = &function.getEntryBlock();
+
+    // PHIs are demoted while the original edges still exist
+    SmallVector<PHINode*, 16> phis;
+    for (BasicBlock& block : function) {
+        for (PHINode& phi : block.phis()) {
+            phis.push_back(&phi);
+        }
+    }
+    for (PHINode* phi : phis) {
+        DemotePHIToStack(phi);
+    }
+
+    // The entry block stays in front of the dispatcher and must end in an
+    // unconditional branch, so only one initial state is stored there
+    auto* entryBranch = dyn_cast<BranchInst>(entry->getTerminator());
+    if (!entryBranch || entryBranch->isConditional()) {
+        entry->splitBasicBlock(entry->getTerminator(), "flatten.first");
+        entryBranch = cast<BranchInst>(entry->getTerminator());
+    }
+
+    SmallVector<BasicBlock*, 32> blocks;
+    for (BasicBlock& block : function) {
+        if (&block != entry) {
+            blocks.push_back(&block);
+        }
+    }
+
+    const uint32_t seed = static_cast<uint32_t>(xxHash64(function.getName()));
+    DenseMap<BasicBlock*, ConstantInt*> caseOf;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        caseOf[blocks[i]] = ConstantInt::get(context, APInt(32, caseValue(seed, static_cast<uint32_t>(i))));
+    }
+
+    // entry -> dispatch -> case block -> latch -> dispatch -> ...
+    const unsigned allocaAddressSpace = function.getParent()->getDataLayout().getAllocaAddrSpace();
+    auto* state = new AllocaInst(stateType, allocaAddressSpace, "flatten.state", &entry->front());
+    new StoreInst(caseOf.lookup(entryBranch->getSuccessor(0)), state, entryBranch);
+
+    BasicBlock* dispatch = BasicBlock::Create(context, "flatten.dispatch", &function, entry->getNextNode());
+    BasicBlock* latch = BasicBlock::Create(context, "flatten.latch", &function);
+    BasicBlock* defaultCase = BasicBlock::Create(context, "flatten.default", &function, latch);
+    BranchInst::Create(latch, defaultCase);
+    BranchInst::Create(dispatch, latch);
+    entryBranch->setSuccessor(0, dispatch);
+
+    auto* current = new LoadInst(stateType, state, "flatten.case", dispatch);
+    SwitchInst* dispatcher = SwitchInst::Create(current, defaultCase, blocks.size(), dispatch);
+    for (BasicBlock* block : blocks) {
+        dispatcher->addCase(caseOf.lookup(block), block);
+    }
+
+    // Every edge between original blocks becomes "store next state; br latch"
+    for (BasicBlock* block : blocks) {
+        Instruction* terminator = block->getTerminator();
+        if (auto* branch = dyn_cast<BranchInst>(terminator)) {
+            Value* next = caseOf.lookup(branch->getSuccessor(0));
+            if (branch->isConditional()) {
+                next = SelectInst::Create(branch->getCondition(), next, caseOf.lookup(branch->getSuccessor(1)),
+                                          "flatten.next", branch);
+            }
+            new StoreInst(next, state, branch);
+            BranchInst::Create(latch, block);
+            branch->eraseFromParent();
+        } else if (auto* switchInst = dyn_cast<SwitchInst>(terminator)) {
+            // The switch stays; each distinct target gets an edge block that selects it
+            DenseMap<BasicBlock*, BasicBlock*> edges;
+            for (unsigned i = 0; i < switchInst->getNumSuccessors(); i++) {
+                BasicBlock* successor = switchInst->getSuccessor(i);
+                BasicBlock*& edge = edges[successor];
+                if (!edge) {
+                    edge = BasicBlock::Create(context, "flatten.edge", &function, latch);
+                    new StoreInst(caseOf.lookup(successor), state, edge);
+                    BranchInst::Create(latch, edge);
+                }
+                switchInst->setSuccessor(i, edge);
+            }
+        }
+    }
+
+    // Values used outside their defining block no longer dominate those uses.
+    // The entry block still dominates everything and is left alone.
+    SmallVector<Instruction*, 32> escaping;
+    for (BasicBlock& block : function) {
+        if (&block == entry) {
+            continue;
+        }
+        for (Instruction& instruction : block) {
+            if (instruction.isUsedOutsideOfBlock(&block)) {
+                escaping.push_back(&instruction);
+            }
+        }
+    }
+    for (Instruction* instruction : escaping) {
+        DemoteRegToStack(*instruction);
+    }
+
+    return true;
+}
+
+} // namespace obfuscation
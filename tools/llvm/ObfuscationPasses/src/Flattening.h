@@ -0,0 +1,21 @@
+#pragma once
+
+#include "llvm/IR/PassManager.h"
+
+namespace obfuscation {
+
+// Control flow flattening: every basic block of a function becomes a case of
+// one dispatch switch driven by a state variable on the stack, so the
+// original CFG is no longer visible in the branch structure.
+//
+// The pass only touches the function it is run on and keeps no state between
+// runs (case numbers are derived from the function name), so independent
+// functions can be processed concurrently.
+class FlatteningPass : public llvm::PassInfoMixin<FlatteningPass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Function& function, llvm::FunctionAnalysisManager& analysisManager);
+
+    static bool flatten(llvm::Function& function);
+};
+
+} // namespace obfuscation
@@ -0,0 +1,47 @@
+#include "OpaquePredicate.h"
+
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace llvm;
+
+namespace obfuscation {
+
+OpaquePredicate::OpaquePredicate(Function& function) {
+    LLVMContext& context = function.getContext();
+    Type* type = Type::getInt32Ty(context);
+    BasicBlock& entry = function.getEntryBlock();
+    const unsigned allocaAddressSpace = function.getParent()->getDataLayout().getAllocaAddrSpace();
+
+    // The slot is stored right after the allocas at the top of the entry block
+    slot = new AllocaInst(type, allocaAddressSpace, "opaque.slot", &entry.front());
+    BasicBlock::iterator position = entry.getFirstInsertionPt();
+    while (isa<AllocaInst>(*position)) {
+        ++position;
+    }
+    IRBuilder<> builder(&entry, position);
+    builder.CreateStore(builder.getInt32(static_cast<uint32_t>(xxHash64(function.getName()))), slot, true);
+}
+
+Value* OpaquePredicate::load(IRBuilderBase& builder) const {
+    return builder.CreateLoad(slot->getAllocatedType(), slot, true, "opaque.x");
+}
+
+void OpaquePredicate::store(IRBuilderBase& builder, Value* value) const {
+    builder.CreateStore(value, slot, true);
+}
+
+Value* OpaquePredicate::alwaysTrue(IRBuilderBase& builder) const {
+    Value* x = load(builder);
+    Value* product = builder.CreateMul(x, builder.CreateAdd(x, builder.getInt32(1)));
+    return builder.CreateICmpEQ(builder.CreateAnd(product, builder.getInt32(1)), builder.getInt32(0), "opaque.true");
+}
+
+Value* OpaquePredicate::alwaysFalse(IRBuilderBase& builder) const {
+    Value* x = load(builder);
+    Value* product = builder.CreateMul(x, builder.CreateAdd(x, builder.getInt32(1)));
+    return builder.CreateICmpNE(builder.CreateAnd(product, builder.getInt32(1)), builder.getInt32(0), "opaque.false");
+}
+
+} // namespace obfuscation
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+
+namespace obfuscation {
+
+// Conditions whose value is fixed but not visible to the optimizer, for the
+// passes that add never-taken edges. They read a stack slot that the entry
+// block initializes with a volatile store, so no global state is involved and
+// functions can still be processed independently.
+class OpaquePredicate {
+public:
+    // Adds the stack slot to the function's entry block
+    explicit OpaquePredicate(llvm::Function& function);
+
+    // x * (x + 1) is even for every x, also with wrapping
+    llvm::Value* alwaysTrue(llvm::IRBuilderBase& builder) const;
+    llvm::Value* alwaysFalse(llvm::IRBuilderBase& builder) const;
+
+    // The opaque value itself, as junk input
+    llvm::Value* load(llvm::IRBuilderBase& builder) const;
+    // Junk output; only for code that never runs, it changes the value
+    void store(llvm::IRBuilderBase& builder, llvm::Value* value) const;
+
+private:
+    llvm::AllocaInst* slot;
+};
+
+} // namespace obfuscation
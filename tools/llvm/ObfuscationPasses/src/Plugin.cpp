@@ -0,0 +1,130 @@
+#include "BogusControlFlow.h"
+#include "DeadCode.h"
+#include "Flattening.h"
+#include "StringObfuscation.h"
+#include "Substitution.h"
+
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+using namespace llvm;
+using namespace obfuscation;
+
+namespace {
+
+// Options are pass parameters, "subst<prob=70;all>", rather than cl::opt
+// flags: a Windows plugin links its own copy of LLVM, whose command-line
+// options opt never parses
+class PassParameters {
+public:
+    // False if text does not name pass
+    bool parse(StringRef text, StringRef pass) {
+        if (!text.consume_front(pass)) {
+            return false;
+        }
+        if (text.empty()) {
+            return true;
+        }
+        if (!text.consume_front("<") || !text.consume_back(">")) {
+            return false;
+        }
+        text.split(parameters, ';', -1, false);
+        return true;
+    }
+
+    // Consumes "name"; true if it was given
+    bool flag(StringRef name) {
+        for (auto it = parameters.begin(); it != parameters.end(); ++it) {
+            if (*it == name) {
+                parameters.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Consumes "name=N" with N in 0..100; false if it is malformed
+    bool percentage(StringRef name, unsigned& value) {
+        for (auto it = parameters.begin(); it != parameters.end(); ++it) {
+            StringRef parameter = *it;
+            if (parameter.consume_front(name) && parameter.consume_front("=")) {
+                if (parameter.getAsInteger(10, value) || value > 100) {
+                    return false;
+                }
+                parameters.erase(it);
+                return true;
+            }
+        }
+        return true;
+    }
+
+    // All parameters were understood
+    bool done() const { return parameters.empty(); }
+
+private:
+    SmallVector<StringRef, 4> parameters;
+};
+
+bool parseFunctionPass(StringRef name, FunctionPassManager& passManager) {
+    PassParameters parameters;
+    if (parameters.parse(name, "flatten")) {
+        if (!parameters.done()) {
+            return false;
+        }
+        passManager.addPass(FlatteningPass());
+        return true;
+    }
+    if (parameters.parse(name, "subst")) {
+        SubstitutionOptions options;
+        options.all = parameters.flag("all");
+        if (!parameters.percentage("prob", options.probability) || !parameters.done()) {
+            return false;
+        }
+        passManager.addPass(SubstitutionPass(options));
+        return true;
+    }
+    if (parameters.parse(name, "bogusflow")) {
+        BogusControlFlowOptions options;
+        options.loop = parameters.flag("loop");
+        if (!parameters.percentage("prob", options.probability) || !parameters.done()) {
+            return false;
+        }
+        passManager.addPass(BogusControlFlowPass(options));
+        return true;
+    }
+    if (parameters.parse(name, "deadcode")) {
+        DeadCodeOptions options;
+        options.complex = parameters.flag("complex");
+        if (!parameters.percentage("prob", options.probability) || !parameters.done()) {
+            return false;
+        }
+        passManager.addPass(DeadCodePass(options));
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+// New pass manager entry point:
+//   opt -load-pass-plugin=LLVMObfuscation.dll -passes=flatten input.bc
+// Function passes: flatten, subst, bogusflow, deadcode; module pass: stringobf.
+// A pipeline starting with a function pass is wrapped in function(...) by
+// opt, so list module passes first or nest explicitly:
+//   -passes='function(flatten,subst<prob=70>),stringobf'
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+    return {LLVM_PLUGIN_API_VERSION, "LLVMObfuscation", LLVM_VERSION_STRING, [](PassBuilder& passBuilder) {
+                passBuilder.registerPipelineParsingCallback(
+                    [](StringRef name, FunctionPassManager& passManager, ArrayRef<PassBuilder::PipelineElement>) {
+                        return parseFunctionPass(name, passManager);
+                    });
+                passBuilder.registerPipelineParsingCallback(
+                    [](StringRef name, ModulePassManager& passManager, ArrayRef<PassBuilder::PipelineElement>) {
+                        if (name == "stringobf") {
+                            passManager.addPass(StringObfuscationPass());
+                            return true;
+                        }
+                        return false;
+                    });
+            }};
+}
@@ -0,0 +1,99 @@
+#include "StringObfuscation.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/xxhash.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+using namespace llvm;
+
+namespace obfuscation {
+
+namespace {
+
+// Key stream: byte i is (seed + i * 131) mod 256, cheap to recompute in IR
+uint8_t keyByte(uint32_t seed, uint64_t index) {
+    return static_cast<uint8_t>(seed + index * 131);
+}
+
+// Only module-private, constant, non-empty i8 arrays are safe to rewrite:
+// nothing outside the module can read them before the constructor runs
+bool canEncrypt(const GlobalVariable& global) {
+    if (!global.isConstant() || !global.hasLocalLinkage() || !global.hasDefinitiveInitializer()) {
+        return false;
+    }
+    if (global.hasSection() || global.isThreadLocal()) { // llvm.metadata and friends
+        return false;
+    }
+    const auto* data = dyn_cast<ConstantDataArray>(global.getInitializer());
+    return data && data->getElementType()->isIntegerTy(8) && data->getNumElements() > 0;
+}
+
+} // namespace
+
+PreservedAnalyses StringObfuscationPass::run(Module& module, ModuleAnalysisManager&) {
+    return encryptStrings(module) ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
+bool StringObfuscationPass::encryptStrings(Module& module) {
+    SmallVector<GlobalVariable*, 32> strings;
+    for (GlobalVariable& global : module.globals()) {
+        if (canEncrypt(global)) {
+            strings.push_back(&global);
+        }
+    }
+    if (strings.empty()) {
+        return false;
+    }
+
+    LLVMContext& context = module.getContext();
+    Function* decrypt = Function::Create(FunctionType::get(Type::getVoidTy(context), false),
+                                         GlobalValue::InternalLinkage, "obf.decrypt_strings", module);
+    BasicBlock* block = BasicBlock::Create(context, "entry", decrypt);
+    IRBuilder<> builder(block);
+
+    for (GlobalVariable* global : strings) {
+        auto* data = cast<ConstantDataArray>(global->getInitializer());
+        const uint32_t seed = static_cast<uint32_t>(xxHash64(global->getName()));
+        const uint64_t size = data->getNumElements();
+
+        SmallVector<uint8_t, 64> encrypted;
+        for (uint64_t i = 0; i < size; i++) {
+            encrypted.push_back(static_cast<uint8_t>(data->getElementAsInteger(i)) ^ keyByte(seed, i));
+        }
+        global->setInitializer(ConstantDataArray::get(context, encrypted));
+        // Written at startup now, so it moves out of read-only data
+        global->setConstant(false);
+        global->setUnnamedAddr(GlobalValue::UnnamedAddr::None);
+
+        // for (i = 0; i != size; i++) global[i] ^= seed + i * 131
+        BasicBlock* preheader = builder.GetInsertBlock();
+        BasicBlock* loop = BasicBlock::Create(context, "decrypt", decrypt);
+        BasicBlock* exit = BasicBlock::Create(context, "decrypt.done", decrypt);
+        builder.CreateBr(loop);
+        builder.SetInsertPoint(loop);
+        PHINode* index = builder.CreatePHI(builder.getInt64Ty(), 2, "i");
+        Value* address = builder.CreateInBoundsGEP(global->getValueType(), global, {builder.getInt64(0), index});
+        Value* key = builder.CreateTrunc(builder.CreateAdd(builder.CreateMul(index, builder.getInt64(131)),
+                                                           builder.getInt64(seed)),
+                                         builder.getInt8Ty());
+        Value* byte = builder.CreateLoad(builder.getInt8Ty(), address);
+        builder.CreateStore(builder.CreateXor(byte, key), address);
+        Value* next = builder.CreateAdd(index, builder.getInt64(1), "i.next");
+        index->addIncoming(builder.getInt64(0), preheader);
+        index->addIncoming(next, loop);
+        builder.CreateCondBr(builder.CreateICmpEQ(next, builder.getInt64(size)), exit, loop);
+        builder.SetInsertPoint(exit);
+    }
+    builder.CreateRetVoid();
+
+    // Priority 0 runs before the constructors of the program
+    appendToGlobalCtors(module, decrypt, 0);
+    return true;
+}
+
+} // namespace obfuscation
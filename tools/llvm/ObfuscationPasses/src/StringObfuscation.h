@@ -0,0 +1,20 @@
+#pragma once
+
+#include "llvm/IR/PassManager.h"
+
+namespace obfuscation {
+
+// String encryption: constant byte arrays private to the module (string
+// literals) are stored XOR-encrypted and decrypted in place by a constructor
+// that runs before any other, so the plain text is not in the binary.
+//
+// Pipeline syntax: stringobf. It is a module pass; the keys are derived from
+// the names of the globals.
+class StringObfuscationPass : public llvm::PassInfoMixin<StringObfuscationPass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Module& module, llvm::ModuleAnalysisManager& analysisManager);
+
+    static bool encryptStrings(llvm::Module& module);
+};
+
+} // namespace obfuscation
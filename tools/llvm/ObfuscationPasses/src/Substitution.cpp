@@ -0,0 +1,93 @@
+#include "Substitution.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/NoFolder.h"
+#include "llvm/Support/xxhash.h"
+
+#include <random>
+
+using namespace llvm;
+
+namespace obfuscation {
+
+namespace {
+
+bool isBitwise(unsigned opcode) {
+    return opcode == Instruction::And || opcode == Instruction::Or || opcode == Instruction::Xor;
+}
+
+// The replacement, built in front of the original instruction. NoFolder:
+// constant operands must not fold the sequence back into one constant.
+Value* rewrite(BinaryOperator& instruction) {
+    IRBuilder<NoFolder> builder(&instruction);
+    Value* a = instruction.getOperand(0);
+    Value* b = instruction.getOperand(1);
+    Value* zero = Constant::getNullValue(instruction.getType());
+
+    switch (instruction.getOpcode()) {
+    case Instruction::Add: // a - (0 - b)
+        return builder.CreateSub(a, builder.CreateSub(zero, b, "subst.neg"), "subst.add");
+    case Instruction::Sub: // a + (0 - b)
+        return builder.CreateAdd(a, builder.CreateSub(zero, b, "subst.neg"), "subst.sub");
+    case Instruction::And: // (a ^ ~b) & a
+        return builder.CreateAnd(builder.CreateXor(a, builder.CreateNot(b, "subst.not")), a, "subst.and");
+    case Instruction::Or: // (a & b) | (a ^ b)
+        return builder.CreateOr(builder.CreateAnd(a, b), builder.CreateXor(a, b), "subst.or");
+    case Instruction::Xor: // (a & ~b) | (~a & b)
+        return builder.CreateOr(builder.CreateAnd(a, builder.CreateNot(b, "subst.not")),
+                                builder.CreateAnd(builder.CreateNot(a, "subst.not"), b), "subst.xor");
+    default:
+        return nullptr;
+    }
+}
+
+} // namespace
+
+PreservedAnalyses SubstitutionPass::run(Function& function, FunctionAnalysisManager&) {
+    if (!substitute(function, options)) {
+        return PreservedAnalyses::all();
+    }
+    // Only instructions change, the CFG stays as it was
+    PreservedAnalyses preserved;
+    preserved.preserveSet<CFGAnalyses>();
+    return preserved;
+}
+
+bool SubstitutionPass::substitute(Function& function, const SubstitutionOptions& options) {
+    if (function.isDeclaration() || options.probability == 0) {
+        return false;
+    }
+
+    // Collected first: the replacements are binary operators themselves
+    std::mt19937 random(static_cast<uint32_t>(xxHash64(function.getName())));
+    SmallVector<BinaryOperator*, 32> selected;
+    for (Instruction& instruction : instructions(function)) {
+        auto* binary = dyn_cast<BinaryOperator>(&instruction);
+        if (!binary || !binary->getType()->isIntOrIntVectorTy()) {
+            continue;
+        }
+        const unsigned opcode = binary->getOpcode();
+        if (opcode != Instruction::Add && opcode != Instruction::Sub && !(options.all && isBitwise(opcode))) {
+            continue;
+        }
+        if (random() % 100 < options.probability) {
+            selected.push_back(binary);
+        }
+    }
+
+    for (BinaryOperator* instruction : selected) {
+        // nsw/nuw are dropped: the wrapping result is a valid refinement
+        Value* replacement = rewrite(*instruction);
+        replacement->takeName(instruction);
+        instruction->replaceAllUsesWith(replacement);
+        instruction->eraseFromParent();
+    }
+    return !selected.empty();
+}
+
+} // namespace obfuscation
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "llvm/IR/PassManager.h"
+
+namespace obfuscation {
+
+// Parameters of SubstitutionPass, see below
+struct SubstitutionOptions {
+    unsigned probability = 50;
+    bool all = false;
+};
+
+// Instruction substitution: integer add and sub (and with `all` also and, or
+// and xor) are replaced by longer sequences computing the same value, e.g.
+// a + b becomes a - (0 - b).
+//
+// Pipeline syntax: subst<prob=N;all>. prob is the percentage of eligible
+// instructions that are rewritten (default 50). Which ones is derived from
+// the function name, so the pass keeps no state between functions.
+class SubstitutionPass : public llvm::PassInfoMixin<SubstitutionPass> {
+public:
+    explicit SubstitutionPass(SubstitutionOptions options = SubstitutionOptions()) : options(options) {}
+
+    llvm::PreservedAnalyses run(llvm::Function& function, llvm::FunctionAnalysisManager& analysisManager);
+
+    static bool substitute(llvm::Function& function, const SubstitutionOptions& options);
+
+private:
+    SubstitutionOptions options;
+};
+
+} // namespace obfuscation
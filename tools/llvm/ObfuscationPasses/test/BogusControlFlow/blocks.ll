@@ -0,0 +1,71 @@
+; RUN: opt -load-pass-plugin=%plugin -passes='bogusflow<prob=100>,verify' -S %s -o %t.ll
+; RUN: FileCheck %s < %t.ll
+; RUN: lli %t.ll
+; RUN: opt -load-pass-plugin=%plugin -passes='bogusflow<prob=100;loop>,verify' -S %s -o %t.loop.ll
+; RUN: FileCheck %s --check-prefix=LOOP < %t.loop.ll
+; RUN: lli %t.loop.ll
+
+; Every block but the entry is split behind an always-true opaque predicate;
+; the never-taken side is an altered copy that joins the live block.
+
+define i32 @sum(i32 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %loop ]
+  %acc.next = add i32 %acc, %i
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 %acc.next
+}
+
+; CHECK-LABEL: define i32 @sum(
+; CHECK:         %opaque.slot = alloca i32
+; CHECK:         store volatile i32 {{-?[0-9]+}}, i32* %opaque.slot
+; CHECK:       loop:
+; CHECK-NEXT:    %i = phi
+; CHECK-NEXT:    %acc = phi
+; CHECK:         [[TRUE:%opaque.true[0-9]*]] = icmp eq i32
+; CHECK-NEXT:    br i1 [[TRUE]], label %loop.body, label %loop.body.bogus
+; CHECK:       loop.body.bogus:
+; CHECK:         br label %loop.body
+
+; LOOP:        loop.body.bogus:
+; LOOP:          br i1 %opaque.true{{[0-9]*}}, label %loop.body, label %loop.body.bogus
+
+; Landing pads are not split
+define void @may_throw() {
+entry:
+  ret void
+}
+
+declare i32 @__gxx_personality_v0(...)
+
+define i32 @with_invoke() personality i32 (...)* @__gxx_personality_v0 {
+entry:
+  invoke void @may_throw() to label %ok unwind label %lpad
+
+ok:
+  ret i32 0
+
+lpad:
+  %lp = landingpad { i8*, i32 } cleanup
+  ret i32 1
+}
+
+; CHECK-LABEL: define i32 @with_invoke(
+; CHECK:       lpad:
+; CHECK-NEXT:    %lp = landingpad
+
+define i32 @main() {
+entry:
+  %s = call i32 @sum(i32 10)
+  %ok = icmp eq i32 %s, 45
+  %ret = select i1 %ok, i32 0, i32 1
+  ret i32 %ret
+}
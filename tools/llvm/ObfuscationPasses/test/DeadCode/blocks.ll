@@ -0,0 +1,48 @@
+; RUN: opt -load-pass-plugin=%plugin -passes='deadcode<prob=100>,verify' -S %s -o %t.ll
+; RUN: FileCheck %s < %t.ll
+; RUN: lli %t.ll
+; RUN: opt -load-pass-plugin=%plugin -passes='deadcode<prob=100;complex>,verify' -S %s -o %t.complex.ll
+; RUN: FileCheck %s --check-prefix=COMPLEX < %t.complex.ll
+; RUN: lli %t.complex.ll
+
+; Every block but the entry branches on an always-false opaque predicate to
+; generated code that rejoins the live part of the block.
+
+define i32 @pick(i32 %x) {
+entry:
+  %neg = icmp slt i32 %x, 0
+  br i1 %neg, label %minus, label %exit
+
+minus:
+  %m = sub i32 0, %x
+  br label %exit
+
+exit:
+  %r = phi i32 [ %m, %minus ], [ %x, %entry ]
+  ret i32 %r
+}
+
+; CHECK-LABEL: define i32 @pick(
+; CHECK:       minus:
+; CHECK:         [[FALSE:%opaque.false[0-9]*]] = icmp ne i32
+; CHECK-NEXT:    br i1 [[FALSE]], label %minus.dead, label %minus.live
+; CHECK:       minus.dead:
+; CHECK:         store volatile i32 %{{.*}}, i32* %opaque.slot
+; CHECK-NEXT:    br label %minus.live
+; CHECK:       exit:
+; CHECK-NEXT:    %r = phi
+
+; COMPLEX:     minus.dead.loop:
+; COMPLEX:       br i1 %{{.*}}, label %minus.dead.exit, label %minus.dead.loop
+; COMPLEX:     minus.dead.exit:
+; COMPLEX-NEXT:  store volatile i32
+
+define i32 @main() {
+entry:
+  %a = call i32 @pick(i32 -5)
+  %b = call i32 @pick(i32 7)
+  %s = add i32 %a, %b
+  %ok = icmp eq i32 %s, 12
+  %ret = select i1 %ok, i32 0, i32 1
+  ret i32 %ret
+}
@@ -0,0 +1,110 @@
+"""Flatten modules of N and 8*N functions and fail if the flattened copies
+differ: every function must be transformed on its own, so its size cannot
+depend on how many other functions the module has.
+
+The size is counted in blocks and instructions of the opt output, which is
+deterministic. Pass --timing to also compare the wall-clock cost of the pass;
+that check depends on the machine load and is not run by lit."""
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+GENERATOR = os.path.join(os.path.dirname(__file__), "gen_functions.py")
+FACTOR = 8
+
+DEFINE = re.compile(r"^define .*@(\w+)\(")
+LABEL = re.compile(r"^[\w.$-]+:")
+
+
+def function_sizes(ir):
+    """Map each function name to its (blocks, instructions)."""
+    sizes = {}
+    name = None
+    for line in ir.splitlines():
+        match = DEFINE.match(line)
+        if match:
+            name = match.group(1)
+            sizes[name] = [1, 0]  # the entry block has no label
+        elif name is None:
+            continue
+        elif line.startswith("}"):
+            name = None
+        elif LABEL.match(line):
+            sizes[name][0] += 1
+        elif line.startswith("  ") and line.strip():
+            sizes[name][1] += 1
+    return {key: tuple(value) for key, value in sizes.items()}
+
+
+def generate(tmp, count):
+    path = os.path.join(tmp, "m%d.ll" % count)
+    with open(path, "w") as out:
+        subprocess.run([sys.executable, GENERATOR, str(count)], stdout=out, check=True)
+    return path
+
+
+def flatten(plugin, path):
+    return subprocess.run(["opt", "-load-pass-plugin=" + plugin, "-passes=flatten", "-S", path],
+                          stdout=subprocess.PIPE, universal_newlines=True, check=True).stdout
+
+
+def best_time(plugin, path, passes, runs=3):
+    best = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        subprocess.run(["opt", "-load-pass-plugin=" + plugin, "-passes=" + passes,
+                        "-disable-output", path], check=True)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def check_sizes(plugin, tmp, base):
+    counts = (base, base * FACTOR)
+    sizes = [function_sizes(flatten(plugin, generate(tmp, count))) for count in counts]
+    functions = [{size for key, size in module.items() if key != "main"} for module in sizes]
+    print("flattened function sizes (blocks, instructions): %s for %d functions, %s for %d"
+          % (sorted(functions[0]), counts[0], sorted(functions[1]), counts[1]))
+    # The generated functions only differ in constants
+    if len(functions[0]) != 1 or functions[0] != functions[1]:
+        print("FAIL: the flattened size of a function depends on the module")
+        return False
+    return True
+
+
+def check_timing(plugin, tmp, base):
+    costs = []
+    for count in (base, base * FACTOR):
+        path = generate(tmp, count)
+        # Parsing and verification are not part of the pass cost
+        baseline = best_time(plugin, path, "verify")
+        flattened = best_time(plugin, path, "flatten,verify")
+        costs.append(max(flattened - baseline, 1e-3))
+
+    ratio = costs[1] / costs[0]
+    print("flatten cost: %.3fs for %d functions, %.3fs for %d (x%.1f)"
+          % (costs[0], base, costs[1], base * FACTOR, ratio))
+    # Linear cost gives about x8; anything quadratic would be near x64
+    if ratio > FACTOR * 3:
+        print("FAIL: flattening cost grows faster than linearly")
+        return False
+    return True
+
+
+def main():
+    args = [arg for arg in sys.argv[1:] if arg != "--timing"]
+    plugin, base = args[0], int(args[1])
+    with tempfile.TemporaryDirectory() as tmp:
+        ok = check_sizes(plugin, tmp, base)
+        if ok and "--timing" in sys.argv[1:]:
+            ok = check_timing(plugin, tmp, base)
+    print("PASS" if ok else "FAIL")
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
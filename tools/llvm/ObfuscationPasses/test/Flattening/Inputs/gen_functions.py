@@ -0,0 +1,51 @@
+"""Print a module with N copies of a small function that has a loop, a
+diamond and PHIs, plus one function that calls every copy."""
+
+import sys
+
+TEMPLATE = """
+define i32 @f{n}(i32 %x) {{
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %join ]
+  %acc = phi i32 [ %x, %entry ], [ %acc.next, %join ]
+  %even = icmp eq i32 %i, {n}
+  br i1 %even, label %left, label %right
+
+left:
+  %l = add i32 %acc, {n}
+  br label %join
+
+right:
+  %r = xor i32 %acc, %i
+  br label %join
+
+join:
+  %acc.next = phi i32 [ %l, %left ], [ %r, %right ]
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, 8
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 %acc.next
+}}
+"""
+
+
+def main():
+    count = int(sys.argv[1])
+    for n in range(count):
+        sys.stdout.write(TEMPLATE.format(n=n))
+
+    sys.stdout.write("\ndefine i32 @main() {\nentry:\n")
+    previous = "0"
+    for n in range(count):
+        sys.stdout.write("  %%v%d = call i32 @f%d(i32 %s)\n" % (n, n, previous))
+        previous = "%%v%d" % n
+    sys.stdout.write("  ret i32 0\n}\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,84 @@
+; RUN: opt -load-pass-plugin=%plugin -passes=flatten -S %s -o %t.ll
+; RUN: FileCheck %s < %t.ll
+; RUN: lli %t.ll
+
+; A loop with PHIs and a conditional exit: every original block is reached
+; through the dispatcher and the result is unchanged.
+
+define i32 @sum_odd(i32 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  %sum = phi i32 [ 0, %entry ], [ %sum.next, %latch ]
+  %bit = and i32 %i, 1
+  %odd = icmp ne i32 %bit, 0
+  br i1 %odd, label %add, label %latch
+
+add:
+  %added = add i32 %sum, %i
+  br label %latch
+
+latch:
+  %sum.next = phi i32 [ %added, %add ], [ %sum, %loop ]
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 %sum.next
+}
+
+; CHECK-LABEL: define i32 @sum_odd(
+; CHECK-NOT:   phi
+; CHECK:       flatten.dispatch:
+; CHECK-NEXT:    %flatten.case = load i32
+; CHECK-NEXT:    switch i32 %flatten.case, label %flatten.default [
+; CHECK-COUNT-4:   i32 {{-?[0-9]+}}, label
+; CHECK-NEXT:    ]
+; CHECK:       select i1 %odd, i32
+; CHECK:       br label %flatten.latch
+; CHECK:       flatten.latch:
+; CHECK-NEXT:    br label %flatten.dispatch
+
+; Conditional entry terminators are moved out of the entry block
+define i32 @clamp(i32 %x) {
+entry:
+  %neg = icmp slt i32 %x, 0
+  br i1 %neg, label %zero, label %keep
+
+zero:
+  ret i32 0
+
+keep:
+  ret i32 %x
+}
+
+; CHECK-LABEL: define i32 @clamp(
+; CHECK:       entry:
+; CHECK:         br label %flatten.dispatch
+; CHECK:       flatten.first:
+; CHECK:         select i1
+
+; Single-block functions are left alone
+define i32 @identity(i32 %x) {
+entry:
+  ret i32 %x
+}
+
+; CHECK-LABEL: define i32 @identity(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    ret i32 %x
+
+define i32 @main() {
+entry:
+  %a = call i32 @sum_odd(i32 10)
+  %b = call i32 @clamp(i32 -5)
+  %c = call i32 @clamp(i32 7)
+  %ab = add i32 %a, %b
+  %abc = add i32 %ab, %c
+  %ok = icmp eq i32 %abc, 32
+  %ret = select i1 %ok, i32 0, i32 1
+  ret i32 %ret
+}
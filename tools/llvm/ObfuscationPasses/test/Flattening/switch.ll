@@ -0,0 +1,73 @@
+; RUN: opt -load-pass-plugin=%plugin -passes=flatten -S %s -o %t.ll
+; RUN: FileCheck %s < %t.ll
+; RUN: lli %t.ll
+
+; Switch terminators keep their cases; each distinct target is reached
+; through an edge block that stores its state.
+
+define i32 @classify(i32 %x) {
+entry:
+  br label %dispatch
+
+dispatch:
+  switch i32 %x, label %other [
+    i32 1, label %one
+    i32 2, label %two
+    i32 3, label %two
+  ]
+
+one:
+  br label %exit
+
+two:
+  br label %exit
+
+other:
+  br label %exit
+
+exit:
+  %r = phi i32 [ 10, %one ], [ 20, %two ], [ 30, %other ]
+  ret i32 %r
+}
+
+; CHECK-LABEL: define i32 @classify(
+; CHECK:         switch i32 %x, label %flatten.edge
+; CHECK-COUNT-3:   i32 {{[0-9]}}, label %flatten.edge
+; CHECK-COUNT-3: flatten.edge{{[0-9]*}}:
+; CHECK-NOT:     phi
+
+; Exception handling edges cannot go through the dispatcher
+define void @may_throw() {
+entry:
+  ret void
+}
+
+declare i32 @__gxx_personality_v0(...)
+
+define i32 @with_invoke() personality i32 (...)* @__gxx_personality_v0 {
+entry:
+  invoke void @may_throw() to label %ok unwind label %lpad
+
+ok:
+  ret i32 0
+
+lpad:
+  %lp = landingpad { i8*, i32 } cleanup
+  ret i32 1
+}
+
+; CHECK-LABEL: define i32 @with_invoke(
+; CHECK-NOT:   flatten.dispatch
+; CHECK:       ret i32 1
+
+define i32 @main() {
+entry:
+  %a = call i32 @classify(i32 1)
+  %b = call i32 @classify(i32 3)
+  %c = call i32 @classify(i32 9)
+  %ab = add i32 %a, %b
+  %abc = add i32 %ab, %c
+  %ok = icmp eq i32 %abc, 60
+  %ret = select i1 %ok, i32 0, i32 1
+  ret i32 %ret
+}
@@ -0,0 +1,48 @@
+; RUN: opt -load-pass-plugin=%plugin -passes='function(flatten,subst<prob=70;all>,bogusflow<prob=60;loop>,deadcode<prob=70;complex>),stringobf,verify' -S %s -o %t.ll
+; RUN: FileCheck %s < %t.ll
+; RUN: lli %t.ll
+
+; The pipeline SpectreGuard runs at obfuscation level 3, over one parse of
+; the module.
+
+@message = private unnamed_addr constant [4 x i8] c"abc\00"
+
+define i32 @checksum(i8* %s) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %body ]
+  %acc = phi i32 [ 7, %entry ], [ %acc.next, %body ]
+  %p = getelementptr i8, i8* %s, i64 %i
+  %c = load i8, i8* %p
+  %end = icmp eq i8 %c, 0
+  br i1 %end, label %exit, label %body
+
+body:
+  %cz = zext i8 %c to i32
+  %mul = mul i32 %acc, 31
+  %acc.next = add i32 %mul, %cz
+  %i.next = add i64 %i, 1
+  br label %loop
+
+exit:
+  ret i32 %acc
+}
+
+; CHECK:       @message = private global [4 x i8]
+; CHECK-LABEL: define i32 @checksum(
+; CHECK:       flatten.dispatch:
+; CHECK:       .bogus:
+; CHECK:       .dead:
+; CHECK-LABEL: define internal void @obf.decrypt_strings()
+
+define i32 @main() {
+entry:
+  %s = getelementptr [4 x i8], [4 x i8]* @message, i64 0, i64 0
+  %sum = call i32 @checksum(i8* %s)
+  ; ((7 * 31 + 97) * 31 + 98) * 31 + 99
+  %ok = icmp eq i32 %sum, 304891
+  %ret = select i1 %ok, i32 0, i32 1
+  ret i32 %ret
+}
@@ -0,0 +1,37 @@
+; RUN: opt -load-pass-plugin=%plugin -passes=stringobf,verify -S %s -o %t.ll
+; RUN: FileCheck %s < %t.ll
+; RUN: lli %t.ll
+
+; Private constant byte arrays are stored encrypted and decrypted by a
+; constructor; anything visible outside the module is left alone.
+
+@greeting = private unnamed_addr constant [6 x i8] c"hello\00"
+@table = internal constant [3 x i8] c"\01\02\03"
+@exported = constant [4 x i8] c"keep"
+@words = private constant [2 x i32] [i32 1, i32 2]
+
+; CHECK:     @greeting = private global [6 x i8] c"
+; CHECK-NOT: hello
+; CHECK:     @table = internal global [3 x i8]
+; CHECK:     @exported = constant [4 x i8] c"keep"
+; CHECK:     @words = private constant [2 x i32]
+; CHECK:     @llvm.global_ctors = appending global {{.*}} i32 0, void ()* @obf.decrypt_strings
+
+; CHECK-LABEL: define internal void @obf.decrypt_strings()
+
+define i32 @main() {
+entry:
+  %h = getelementptr [6 x i8], [6 x i8]* @greeting, i64 0, i64 1
+  %e = load i8, i8* %h
+  %t = getelementptr [3 x i8], [3 x i8]* @table, i64 0, i64 2
+  %three = load i8, i8* %t
+  %z = getelementptr [6 x i8], [6 x i8]* @greeting, i64 0, i64 5
+  %nul = load i8, i8* %z
+  %ok.e = icmp eq i8 %e, 101
+  %ok.t = icmp eq i8 %three, 3
+  %ok.z = icmp eq i8 %nul, 0
+  %ok.et = and i1 %ok.e, %ok.t
+  %ok = and i1 %ok.et, %ok.z
+  %ret = select i1 %ok, i32 0, i32 1
+  ret i32 %ret
+}
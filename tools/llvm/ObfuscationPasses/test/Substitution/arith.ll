@@ -0,0 +1,58 @@
+; RUN: opt -load-pass-plugin=%plugin -passes='subst<prob=100;all>' -S %s -o %t.ll
+; RUN: FileCheck %s < %t.ll
+; RUN: lli %t.ll
+; RUN: opt -load-pass-plugin=%plugin -passes='subst<prob=100>' -S %s | FileCheck %s --check-prefix=ARITH
+; RUN: opt -load-pass-plugin=%plugin -passes='subst<prob=0;all>' -S %s | FileCheck %s --check-prefix=NONE
+; RUN: not opt -load-pass-plugin=%plugin -passes='subst<prob=101>' -disable-output %s 2>&1 | FileCheck %s --check-prefix=BAD
+
+; Every operator keeps its value, including constant operands and vectors.
+
+define i32 @mix(i32 %a, i32 %b) {
+entry:
+  %add = add nsw i32 %a, %b
+  %sub = sub i32 %add, 7
+  %and = and i32 %sub, %b
+  %or = or i32 %and, %a
+  %xor = xor i32 %or, 1234
+  ret i32 %xor
+}
+
+; CHECK-LABEL: define i32 @mix(
+; CHECK-NOT:     add nsw
+; CHECK:         %add = sub i32 %a
+; CHECK:         %sub = add i32 %add
+; CHECK:         %and = and
+; CHECK:         %or = or
+; CHECK:         %xor = or
+; CHECK:         ret i32 %xor
+
+; ARITH-LABEL: define i32 @mix(
+; ARITH:         %add = sub i32 %a
+; ARITH:         %and = and i32 %sub, %b
+; ARITH:         %xor = xor i32 %or, 1234
+
+; NONE:        %add = add nsw i32 %a, %b
+
+; BAD: unknown pass name 'subst<prob=101>'
+
+define <4 x i32> @vec(<4 x i32> %a, <4 x i32> %b) {
+entry:
+  %x = xor <4 x i32> %a, %b
+  ret <4 x i32> %x
+}
+
+; CHECK-LABEL: define <4 x i32> @vec(
+; CHECK:         %x = or <4 x i32>
+
+define i32 @main() {
+entry:
+  %m = call i32 @mix(i32 1000, i32 -77)
+  ; ((((1000 - 77) - 7) & -77) | 1000) ^ 1234
+  %ok.m = icmp eq i32 %m, 1834
+  %v = call <4 x i32> @vec(<4 x i32> <i32 1, i32 2, i32 3, i32 4>, <4 x i32> <i32 4, i32 3, i32 2, i32 1>)
+  %v0 = extractelement <4 x i32> %v, i32 0
+  %ok.v = icmp eq i32 %v0, 5
+  %ok = and i1 %ok.m, %ok.v
+  %ret = select i1 %ok, i32 0, i32 1
+  ret i32 %ret
+}
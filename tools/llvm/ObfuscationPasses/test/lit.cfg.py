@@ -0,0 +1,15 @@
+import os
+
+import lit.formats
+
+config.name = 'LLVMObfuscation'
+config.test_format = lit.formats.ShTest(True)
+config.suffixes = ['.ll', '.test']
+config.excludes = ['Inputs']
+config.test_source_root = os.path.dirname(__file__)
+
+# opt, lli and FileCheck come from the LLVM the plugin was built against
+config.environment['PATH'] = os.pathsep.join((config.llvm_tools_dir, os.environ.get('PATH', '')))
+
+config.substitutions.append(('%plugin', config.plugin_path))
+config.substitutions.append(('%python', config.python_executable))